@@ -0,0 +1,340 @@
+#include "bench.h"
+#include "culling.h"
+#include "headless.h"
+#include "light_clusters.h"
+#include "mesh.h"
+#include "mipmap.h"
+#include "scene.h"
+#include "stb_image.h"
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+namespace {
+
+using Clock = std::chrono::high_resolution_clock;
+
+// Lights the gallery is filled up to by the lighting benchmarks
+const int LIGHT_COUNTS[] = { 5, 16, 64, 256, 1024, 4096 };
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Tiles the gallery roomCount times, 30 units apart, to mimic large deployments
+Scene buildTiledScene(int roomCount) {
+    Scene room = buildGalleryScene();
+    Scene scene;
+    for (int r = 0; r < roomCount; ++r) {
+        glm::vec3 offset(30.0f * (r % 16), 0.0f, 30.0f * (r / 16));
+        for (size_t i = 0; i < room.objects.size(); ++i) {
+            if (room.objects[i].dynamic)
+                scene.dynamicObjects.push_back((unsigned int)scene.objects.size());
+            Transform transform = room.transforms[i];
+            transform.position += offset;
+            scene.objects.push_back(room.objects[i]);
+            scene.transforms.push_back(transform);
+            scene.modelMatrices.push_back(composeTransform(transform));
+        }
+    }
+    return scene;
+}
+
+// Per-frame matrix cost: rebuilding every model matrix (the old render loop)
+// against re-evaluating only the dynamic objects of the prebaked scene table.
+int benchSceneMatrices() {
+    const int FRAMES = 1000;
+    const int ROOM_COUNTS[] = { 1, 100, 500 };
+
+    for (int roomCount : ROOM_COUNTS) {
+        Scene scene = buildTiledScene(roomCount);
+        float checksum = 0.0f;
+
+        Clock::time_point start = Clock::now();
+        for (int frame = 0; frame < FRAMES; ++frame) {
+            float time = frame / 60.0f;
+            for (size_t i = 0; i < scene.objects.size(); ++i) {
+                scene.modelMatrices[i] = scene.objects[i].dynamic ? spinningCubeMatrix(time)
+                                                                  : composeTransform(scene.transforms[i]);
+            }
+            checksum += scene.modelMatrices[frame % scene.modelMatrices.size()][3][0];
+        }
+        double rebuildMs = elapsedMs(start) / FRAMES;
+
+        start = Clock::now();
+        for (int frame = 0; frame < FRAMES; ++frame) {
+            updateDynamicObjects(scene, frame / 60.0f);
+            checksum += scene.modelMatrices[frame % scene.modelMatrices.size()][3][0];
+        }
+        double prebakedMs = elapsedMs(start) / FRAMES;
+
+        std::cout << roomCount << " room(s), " << scene.objects.size() << " objects: "
+                  << "rebuild " << rebuildMs * 1000.0 << " us/frame, "
+                  << "prebaked " << prebakedMs * 1000.0 << " us/frame"
+                  << " (checksum " << checksum << ")" << std::endl;
+    }
+    return 0;
+}
+
+// SoA frustum test with and without SIMD over a large tiled gallery, looking
+// down the first row of rooms
+int benchCulling() {
+    const int FRAMES = 1000;
+    Scene scene = buildTiledScene(500);
+    SceneBounds bounds = buildSceneBounds(scene);
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.5f, 3.0f), glm::vec3(1.0f, 1.5f, 3.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1280.0f / 720.0f, 0.1f, 100.0f);
+    Frustum frustum = extractFrustum(projection * view);
+
+    std::vector<uint8_t> scalarVisible, simdVisible;
+    int visible = 0;
+
+    Clock::time_point start = Clock::now();
+    for (int frame = 0; frame < FRAMES; ++frame)
+        visible = cullSceneBoundsScalar(frustum, bounds, scalarVisible);
+    double scalarMs = elapsedMs(start) / FRAMES;
+
+    start = Clock::now();
+    for (int frame = 0; frame < FRAMES; ++frame)
+        visible = cullSceneBounds(frustum, bounds, simdVisible);
+    double simdMs = elapsedMs(start) / FRAMES;
+
+    bool match = scalarVisible == simdVisible;
+    std::cout << scene.objects.size() << " objects, " << visible << " visible: "
+              << "scalar " << scalarMs * 1000.0 << " us/frame, "
+              << "SIMD " << simdMs * 1000.0 << " us/frame"
+              << (match ? "" : " (MISMATCH)") << std::endl;
+    return match ? 0 : -1;
+}
+
+// Full mip chains of the largest gallery textures, every filter on every
+// instruction set; the SIMD chains must match the scalar one
+int benchMipmaps() {
+    const char* PATHS[] = { "textures/painting.png", "textures/wall.jpg" };
+    const int RUNS = 3;
+    const MipSimd SIMD_LEVELS[] = { MipSimd::Scalar, MipSimd::SSE2, MipSimd::AVX2 };
+    const MipSimd best = bestMipSimd();
+
+    int result = 0;
+    for (const char* path : PATHS) {
+        int width, height, components;
+        unsigned char* pixels = stbi_load(path, &width, &height, &components, 4);
+        if (!pixels) {
+            std::cout << "Failed to load texture: " << path << std::endl;
+            result = -1;
+            continue;
+        }
+
+        for (MipFilter filter : { MipFilter::Box, MipFilter::Kaiser }) {
+            std::vector<uint8_t> reference;
+            std::cout << path << " " << width << "x" << height << ", "
+                      << (filter == MipFilter::Box ? "box" : "Kaiser") << ":";
+            for (MipSimd simd : SIMD_LEVELS) {
+                if ((int)simd > (int)best)
+                    continue;
+
+                std::vector<uint8_t> data;
+                std::vector<MipLevel> levels;
+                double bestMs = 1e30;
+                for (int run = 0; run < RUNS; ++run) {
+                    Clock::time_point start = Clock::now();
+                    buildMipChain(pixels, width, height, filter, data, levels, simd);
+                    bestMs = std::min(bestMs, elapsedMs(start));
+                }
+
+                // Summation order differs between paths, allow one step of rounding
+                int maxDifference = 0;
+                if (reference.empty())
+                    reference = data;
+                for (size_t i = 0; i < data.size(); ++i)
+                    maxDifference = std::max(maxDifference, std::abs(data[i] - reference[i]));
+                if (maxDifference > 1)
+                    result = -1;
+
+                std::cout << " " << mipSimdName(simd) << " " << bestMs << " ms"
+                          << (maxDifference > 1 ? " (MISMATCH)" : "");
+            }
+            std::cout << std::endl;
+        }
+        stbi_image_free(pixels);
+    }
+    return result;
+}
+
+// Indexed UV sphere of rings x segments quads, two triangles each, with its
+// vertex and triangle order shuffled as an unoptimised export might leave it
+MeshData buildShuffledSphere(int rings, int segments) {
+    MeshData mesh;
+    for (int ring = 0; ring <= rings; ++ring) {
+        float theta = glm::pi<float>() * ring / rings;
+        for (int segment = 0; segment <= segments; ++segment) {
+            float phi = glm::two_pi<float>() * segment / segments;
+            float vertex[MESH_VERTEX_FLOATS] = { std::sin(theta) * std::cos(phi), std::cos(theta),
+                                                 std::sin(theta) * std::sin(phi), (float)segment / segments,
+                                                 (float)ring / rings, 0.0f, 0.0f, 0.0f, 0.0f };
+            mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + MESH_VERTEX_FLOATS);
+        }
+    }
+    std::vector<uint32_t> triangles;
+    for (int ring = 0; ring < rings; ++ring) {
+        for (int segment = 0; segment < segments; ++segment) {
+            uint32_t corner = (uint32_t)(ring * (segments + 1) + segment);
+            uint32_t below = corner + segments + 1;
+            uint32_t quad[6] = { corner, below, corner + 1, corner + 1, below, below + 1 };
+            triangles.insert(triangles.end(), quad, quad + 6);
+        }
+    }
+
+    std::mt19937 random(1);
+    int vertexCount = (int)mesh.vertices.size() / MESH_VERTEX_FLOATS;
+    std::vector<uint32_t> remap(vertexCount);
+    std::iota(remap.begin(), remap.end(), 0u);
+    std::shuffle(remap.begin(), remap.end(), random);
+    std::vector<float> vertices(mesh.vertices.size());
+    for (int v = 0; v < vertexCount; ++v)
+        std::copy_n(&mesh.vertices[v * MESH_VERTEX_FLOATS], MESH_VERTEX_FLOATS,
+                    &vertices[remap[v] * MESH_VERTEX_FLOATS]);
+    mesh.vertices.swap(vertices);
+
+    std::vector<int> order(triangles.size() / 3);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), random);
+    for (int t : order)
+        for (int corner = 0; corner < 3; ++corner)
+            mesh.indices.push_back(remap[triangles[t * 3 + corner]]);
+    return mesh;
+}
+
+void printMeshStats(const char* pass, const MeshData& mesh) {
+    int vertexCount = (int)mesh.vertices.size() / MESH_VERTEX_FLOATS;
+    MeshCacheStats cache = analyzeVertexCache(mesh.indices, vertexCount, MESH_STATS_CACHE_SIZE);
+    float fetch = analyzeVertexFetch(mesh.indices, vertexCount, MESH_VERTEX_FLOATS * sizeof(float));
+    std::cout << pass << ": ACMR " << cache.acmr << ", ATVR " << cache.atvr << ", fetch ratio " << fetch << std::endl;
+}
+
+// Each mesh pass in turn on a shuffled sphere, where unlike on the gallery's
+// quad and box there is reuse for them to find
+int benchMeshes() {
+    MeshData mesh = buildShuffledSphere(60, 60);
+    std::cout << "Sphere: " << mesh.indices.size() / 3 << " triangles, "
+              << mesh.vertices.size() / MESH_VERTEX_FLOATS << " vertices" << std::endl;
+    printMeshStats("Shuffled", mesh);
+
+    Clock::time_point start = Clock::now();
+    optimizeVertexCache(mesh.indices, (int)mesh.vertices.size() / MESH_VERTEX_FLOATS);
+    double cacheMs = elapsedMs(start);
+    printMeshStats("Vertex cache", mesh);
+
+    start = Clock::now();
+    optimizeOverdraw(mesh.indices, mesh.vertices, MESH_OVERDRAW_THRESHOLD);
+    double overdrawMs = elapsedMs(start);
+    printMeshStats("Overdraw", mesh);
+
+    start = Clock::now();
+    optimizeVertexFetch(mesh);
+    double fetchMs = elapsedMs(start);
+    printMeshStats("Vertex fetch", mesh);
+
+    std::cout << "Passes took " << cacheMs << ", " << overdrawMs << " and " << fetchMs << " ms" << std::endl;
+    return 0;
+}
+
+// Cluster light binning from the hub, looking down an arm, with the gallery
+// filled up to each light count; one thread against every core, which must
+// produce the same lists
+int benchLightClusters() {
+    const int FRAMES = 200;
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.5f, 3.0f), glm::vec3(0.0f, 1.5f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    ClusterFrustum frustum = { view, glm::radians(45.0f), 1280.0f / 720.0f, 0.1f, 100.0f };
+    LightClusterBuilder* single = createLightClusterBuilder(1);
+    LightClusterBuilder* parallel = createLightClusterBuilder();
+
+    int result = 0;
+    for (int lightCount : LIGHT_COUNTS) {
+        Scene scene = buildGalleryScene();
+        addScatteredLights(scene, lightCount);
+
+        Clock::time_point start = Clock::now();
+        for (int frame = 0; frame < FRAMES; ++frame)
+            buildLightClusters(*single, scene.lights, frustum);
+        double singleMs = elapsedMs(start) / FRAMES;
+
+        start = Clock::now();
+        for (int frame = 0; frame < FRAMES; ++frame)
+            buildLightClusters(*parallel, scene.lights, frustum);
+        double parallelMs = elapsedMs(start) / FRAMES;
+
+        bool match = single->clusterRanges == parallel->clusterRanges && single->lightIndices == parallel->lightIndices;
+        if (!match)
+            result = -1;
+        double averageLights = (double)single->lightIndices.size() / LIGHT_CLUSTER_COUNT;
+        std::cout << lightCount << " lights: " << single->lightIndices.size() << " list entries, "
+                  << averageLights << " per cluster on average, at most " << single->maxClusterLights << ", "
+                  << "1 thread " << singleMs * 1000.0 << " us/frame, " << lightClusterThreads(*parallel)
+                  << " threads " << parallelMs * 1000.0 << " us/frame" << (match ? "" : " (MISMATCH)") << std::endl;
+    }
+
+    destroyLightClusterBuilder(single);
+    destroyLightClusterBuilder(parallel);
+    return result;
+}
+
+// Forward against tiled deferred shading of the hub view, rendered headless,
+// for the same light counts. Forward shading is per instance up to
+// MAX_FRAME_LIGHTS and clustered past it. Neither path reads baked light.
+int benchDeferred() {
+    const int FRAMES = 10;
+
+    for (int lightCount : LIGHT_COUNTS) {
+        HeadlessResult results[2];
+        for (int deferred = 0; deferred < 2; ++deferred) {
+            HeadlessOptions options;
+            options.frames = FRAMES;
+            options.fixedCamera = true;
+            options.report = false;
+            options.result = &results[deferred];
+            options.renderer.lightCount = lightCount;
+            options.renderer.deferredShading = deferred != 0;
+            options.renderer.lightmap = false;
+            options.renderer.probes = false;
+            if (runHeadless(options) != 0)
+                return -1;
+        }
+        std::cout << lightCount << " lights: forward " << results[0].gpu.avg << " ms GPU, " << results[0].cpu.avg
+                  << " ms CPU, " << results[0].lightListEntries << " cluster list entries, deferred "
+                  << results[1].gpu.avg << " ms GPU, " << results[1].cpu.avg << " ms CPU, "
+                  << results[1].lightListEntries << " tile list entries" << std::endl;
+    }
+    return 0;
+}
+
+} // namespace
+
+int runBenchmark(const char* name) {
+    if (std::strcmp(name, "scene") == 0)
+        return benchSceneMatrices();
+    if (std::strcmp(name, "culling") == 0)
+        return benchCulling();
+    if (std::strcmp(name, "mipmaps") == 0)
+        return benchMipmaps();
+    if (std::strcmp(name, "lights") == 0)
+        return benchLightClusters();
+    if (std::strcmp(name, "deferred") == 0)
+        return benchDeferred();
+    if (std::strcmp(name, "meshes") == 0)
+        return benchMeshes();
+
+    std::cout << "Unknown benchmark: " << name << "\nAvailable: scene, culling, mipmaps, lights, deferred, meshes"
+              << std::endl;
+    return -1;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// CPU microbenchmarks, run with "--bench <name>" instead of opening a window,
+// and "deferred", which renders headless. Prints the results and returns the
+// process exit code.
+int runBenchmark(const char* name);
@@ -0,0 +1,294 @@
+#include "block_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Principal axis of the block's colors by power iteration on the covariance
+void principalAxis(const float (*points)[4], int channels, const float* mean, float* axis) {
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b)
+                covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+        }
+    }
+
+    for (int c = 0; c < channels; ++c)
+        axis[c] = 1.0f;
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {};
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b)
+                next[a] += covariance[a][b] * axis[b];
+        }
+        float length = 0.0f;
+        for (int c = 0; c < channels; ++c)
+            length = std::max(length, std::fabs(next[c]));
+        if (length < 1e-6f)
+            return; // Flat block, any axis works
+        for (int c = 0; c < channels; ++c)
+            axis[c] = next[c] / length;
+    }
+}
+
+// Extremes of the block projected onto its principal axis
+void fitEndpoints(const uint8_t* rgba, int channels, float* low, float* high) {
+    float points[16][4];
+    float mean[4] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            points[i][c] = rgba[i * 4 + c];
+            mean[c] += points[i][c] / 16.0f;
+        }
+    }
+
+    float axis[4];
+    principalAxis(points, channels, mean, axis);
+
+    float minT = 0.0f, maxT = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c)
+            t += (points[i][c] - mean[c]) * axis[c];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+
+    float axisLength = 0.0f;
+    for (int c = 0; c < channels; ++c)
+        axisLength += axis[c] * axis[c];
+    axisLength = std::max(axisLength, 1e-6f);
+    for (int c = 0; c < channels; ++c) {
+        low[c] = std::min(std::max(mean[c] + axis[c] * minT / axisLength, 0.0f), 255.0f);
+        high[c] = std::min(std::max(mean[c] + axis[c] * maxT / axisLength, 0.0f), 255.0f);
+    }
+}
+
+uint16_t packRGB565(const float* color) {
+    int r = (int)std::lround(color[0] * 31.0f / 255.0f);
+    int g = (int)std::lround(color[1] * 63.0f / 255.0f);
+    int b = (int)std::lround(color[2] * 31.0f / 255.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t packed, int* color) {
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+int colorDistance(const uint8_t* texel, const int* color, int channels) {
+    int distance = 0;
+    for (int c = 0; c < channels; ++c) {
+        int d = texel[c] - color[c];
+        distance += d * d;
+    }
+    return distance;
+}
+
+// Four-color BC1 block: both endpoints, then 2-bit indices
+void encodeColorBlock(const uint8_t* rgba, uint8_t* out) {
+    float low[4], high[4];
+    fitEndpoints(rgba, 3, low, high);
+
+    uint16_t color0 = packRGB565(high);
+    uint16_t color1 = packRGB565(low);
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        unpackRGB565(color0, palette[0]);
+        unpackRGB565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestDistance = colorDistance(rgba + i * 4, palette[0], 3);
+            for (int p = 1; p < 4; ++p) {
+                int distance = colorDistance(rgba + i * 4, palette[p], 3);
+                if (distance < bestDistance) {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+        }
+    }
+
+    out[0] = color0 & 0xff;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 0xff;
+    out[3] = color1 >> 8;
+    std::memcpy(out + 4, &indices, 4);
+}
+
+// BC4 block for the alpha channel: two endpoints, eight interpolated values
+void encodeAlphaBlock(const uint8_t* rgba, uint8_t* out) {
+    int alpha0 = 0, alpha1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        alpha0 = std::max(alpha0, (int)rgba[i * 4 + 3]);
+        alpha1 = std::min(alpha1, (int)rgba[i * 4 + 3]);
+    }
+    out[0] = (uint8_t)alpha0;
+    out[1] = (uint8_t)alpha1;
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1) {
+        int palette[8] = { alpha0, alpha1 };
+        for (int p = 1; p < 7; ++p)
+            palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+
+        for (int i = 0; i < 16; ++i) {
+            int alpha = rgba[i * 4 + 3];
+            int best = 0;
+            for (int p = 1; p < 8; ++p) {
+                if (std::abs(palette[p] - alpha) < std::abs(palette[best] - alpha))
+                    best = p;
+            }
+            indices |= (uint64_t)best << (i * 3);
+        }
+    }
+    for (int b = 0; b < 6; ++b)
+        out[2 + b] = (uint8_t)(indices >> (b * 8));
+}
+
+// Writes bits into a block from the least significant bit up
+struct BitWriter {
+    uint8_t* out;
+    int position;
+
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; ++i, ++position) {
+            if ((value >> i) & 1)
+                out[position >> 3] |= (uint8_t)(1 << (position & 7));
+        }
+    }
+};
+
+const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Mode 6 stores 7 bits per channel plus a shared low bit per endpoint; picks
+// the low bit that reconstructs the endpoint best
+void quantizeBC7Endpoint(const float* endpoint, int* quantized, int* pBit) {
+    int bestError = -1;
+    for (int p = 0; p < 2; ++p) {
+        int error = 0, candidate[4];
+        for (int c = 0; c < 4; ++c) {
+            candidate[c] = std::min(std::max((int)std::lround((endpoint[c] - p) / 2.0f), 0), 127);
+            int d = ((candidate[c] << 1) | p) - (int)std::lround(endpoint[c]);
+            error += d * d;
+        }
+        if (bestError < 0 || error < bestError) {
+            bestError = error;
+            *pBit = p;
+            std::copy(candidate, candidate + 4, quantized);
+        }
+    }
+}
+
+} // namespace
+
+size_t blockBytes(BlockFormat format) {
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t compressedImageSize(BlockFormat format, int width, int height) {
+    return (size_t)std::max(1, (width + 3) / 4) * std::max(1, (height + 3) / 4) * blockBytes(format);
+}
+
+void encodeBC1Block(const uint8_t* rgba, uint8_t* out) {
+    encodeColorBlock(rgba, out);
+}
+
+void encodeBC3Block(const uint8_t* rgba, uint8_t* out) {
+    encodeAlphaBlock(rgba, out);
+    encodeColorBlock(rgba, out + 8);
+}
+
+void encodeBC7Block(const uint8_t* rgba, uint8_t* out) {
+    float low[4], high[4];
+    fitEndpoints(rgba, 4, low, high);
+
+    int endpoints[2][4], pBits[2];
+    quantizeBC7Endpoint(low, endpoints[0], &pBits[0]);
+    quantizeBC7Endpoint(high, endpoints[1], &pBits[1]);
+
+    int palette[16][4];
+    for (int c = 0; c < 4; ++c) {
+        int e0 = (endpoints[0][c] << 1) | pBits[0];
+        int e1 = (endpoints[1][c] << 1) | pBits[1];
+        for (int p = 0; p < 16; ++p)
+            palette[p][c] = ((64 - BC7_WEIGHTS[p]) * e0 + BC7_WEIGHTS[p] * e1 + 32) >> 6;
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestDistance = colorDistance(rgba + i * 4, palette[0], 4);
+        for (int p = 1; p < 16; ++p) {
+            int distance = colorDistance(rgba + i * 4, palette[p], 4);
+            if (distance < bestDistance) {
+                best = p;
+                bestDistance = distance;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // The first index is stored without its top bit, which must be zero
+    if (indices[0] >= 8) {
+        std::swap(endpoints[0], endpoints[1]);
+        std::swap(pBits[0], pBits[1]);
+        for (int& index : indices)
+            index = 15 - index;
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter writer = { out, 0 };
+    writer.write(1 << 6, 7); // Mode 6
+    for (int c = 0; c < 4; ++c) {
+        writer.write(endpoints[0][c], 7);
+        writer.write(endpoints[1][c], 7);
+    }
+    writer.write(pBits[0], 1);
+    writer.write(pBits[1], 1);
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; ++i)
+        writer.write(indices[i], 4);
+}
+
+std::vector<uint8_t> compressImage(BlockFormat format, const uint8_t* rgba, int width, int height) {
+    int blocksX = std::max(1, (width + 3) / 4);
+    int blocksY = std::max(1, (height + 3) / 4);
+    size_t size = blockBytes(format);
+    std::vector<uint8_t> blocks(blocksX * blocksY * size);
+
+    uint8_t texels[64];
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            for (int y = 0; y < 4; ++y) {
+                int sourceY = std::min(by * 4 + y, height - 1);
+                for (int x = 0; x < 4; ++x) {
+                    int sourceX = std::min(bx * 4 + x, width - 1);
+                    std::memcpy(texels + (y * 4 + x) * 4, rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+                }
+            }
+
+            uint8_t* out = &blocks[(by * blocksX + bx) * size];
+            if (format == BlockFormat::BC1)
+                encodeBC1Block(texels, out);
+            else if (format == BlockFormat::BC3)
+                encodeBC3Block(texels, out);
+            else
+                encodeBC7Block(texels, out);
+        }
+    }
+    return blocks;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// GPU block-compressed formats, each block covers 4x4 texels
+enum class BlockFormat {
+    BC1, // RGB, 8 bytes per block
+    BC3, // RGB + separate alpha, 16 bytes per block
+    BC7, // RGBA at higher quality, 16 bytes per block (mode 6 only)
+};
+
+size_t blockBytes(BlockFormat format);
+
+// Bytes needed for a width x height image, partial blocks round up
+size_t compressedImageSize(BlockFormat format, int width, int height);
+
+// Compresses one block of 16 RGBA8 texels, row by row
+void encodeBC1Block(const uint8_t* rgba, uint8_t* out);
+void encodeBC3Block(const uint8_t* rgba, uint8_t* out);
+void encodeBC7Block(const uint8_t* rgba, uint8_t* out);
+
+// Compresses a whole RGBA8 image. Blocks past the right or bottom edge repeat
+// the last column or row.
+std::vector<uint8_t> compressImage(BlockFormat format, const uint8_t* rgba, int width, int height);
@@ -0,0 +1,301 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_SSE2 1
+#endif
+
+namespace {
+
+const int SAH_BINS = 12;
+const int LEAF_TRIANGLES = 4;
+const int MAX_DEPTH = 64;
+
+// Hits closer than this to the origin are the surface the ray left
+const float MIN_HIT_DISTANCE = 1e-4f;
+
+struct Bounds {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void grow(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+    void grow(const Bounds& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+    float area() const {
+        glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+};
+
+Bounds triangleBounds(const BvhTriangle& triangle) {
+    Bounds bounds;
+    bounds.grow(triangle.v0);
+    bounds.grow(triangle.v0 + triangle.edge1);
+    bounds.grow(triangle.v0 + triangle.edge2);
+    return bounds;
+}
+
+glm::vec3 triangleCentroid(const BvhTriangle& triangle) {
+    return triangle.v0 + (triangle.edge1 + triangle.edge2) / 3.0f;
+}
+
+// Splits nodes[index], covering triangles [first, first + count), until its
+// leaves are small or no split pays for itself
+void buildNode(Bvh& bvh, uint32_t index, uint32_t first, uint32_t count, int depth) {
+    Bounds bounds, centroids;
+    for (uint32_t i = first; i < first + count; ++i) {
+        bounds.grow(triangleBounds(bvh.triangles[i]));
+        centroids.grow(triangleCentroid(bvh.triangles[i]));
+    }
+    bvh.nodes[index].boundsMin = bounds.min;
+    bvh.nodes[index].boundsMax = bounds.max;
+    bvh.nodes[index].first = first;
+    bvh.nodes[index].count = (uint16_t)count;
+    bvh.nodes[index].axis = 0;
+    if (count <= (uint32_t)LEAF_TRIANGLES || depth >= MAX_DEPTH)
+        return;
+
+    // Cheapest bin boundary on any axis, by surface area times triangles
+    float bestCost = bounds.area() * count;
+    int bestAxis = -1, bestSplit = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = centroids.max[axis] - centroids.min[axis];
+        if (extent <= 0.0f)
+            continue;
+        Bounds bins[SAH_BINS];
+        int binCounts[SAH_BINS] = {};
+        float scale = SAH_BINS / extent;
+        for (uint32_t i = first; i < first + count; ++i) {
+            const BvhTriangle& triangle = bvh.triangles[i];
+            int bin = std::min(SAH_BINS - 1, (int)((triangleCentroid(triangle)[axis] - centroids.min[axis]) * scale));
+            bins[bin].grow(triangleBounds(triangle));
+            ++binCounts[bin];
+        }
+
+        float rightAreas[SAH_BINS];
+        int rightCounts[SAH_BINS];
+        Bounds right;
+        int rightCount = 0;
+        for (int bin = SAH_BINS - 1; bin > 0; --bin) {
+            right.grow(bins[bin]);
+            rightCount += binCounts[bin];
+            rightAreas[bin] = right.area();
+            rightCounts[bin] = rightCount;
+        }
+        Bounds left;
+        int leftCount = 0;
+        for (int split = 1; split < SAH_BINS; ++split) {
+            left.grow(bins[split - 1]);
+            leftCount += binCounts[split - 1];
+            if (leftCount == 0 || rightCounts[split] == 0)
+                continue;
+            float cost = left.area() * leftCount + rightAreas[split] * rightCounts[split];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+    if (bestAxis < 0)
+        return;
+
+    float scale = SAH_BINS / (centroids.max[bestAxis] - centroids.min[bestAxis]);
+    BvhTriangle* middle = std::partition(
+        &bvh.triangles[first], &bvh.triangles[first] + count, [&](const BvhTriangle& triangle) {
+            int bin = (int)((triangleCentroid(triangle)[bestAxis] - centroids.min[bestAxis]) * scale);
+            return std::min(SAH_BINS - 1, bin) < bestSplit;
+        });
+    uint32_t leftCount = (uint32_t)(middle - &bvh.triangles[first]);
+
+    uint32_t children = (uint32_t)bvh.nodes.size();
+    bvh.nodes.resize(children + 2);
+    bvh.nodes[index].first = children;
+    bvh.nodes[index].count = 0;
+    bvh.nodes[index].axis = (uint16_t)bestAxis;
+    buildNode(bvh, children, first, leftCount, depth + 1);
+    buildNode(bvh, children + 1, first + leftCount, count - leftCount, depth + 1);
+}
+
+#ifndef BVH_SSE2
+
+// One lane at a time, the same tests as the SSE2 path
+void traceRay(const Bvh& bvh, glm::vec3 origin, glm::vec3 direction, float& nearest, int32_t& hit) {
+    glm::vec3 inverse = 1.0f / direction;
+    uint32_t stack[MAX_DEPTH * 2];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const BvhNode& node = bvh.nodes[stack[--size]];
+        glm::vec3 t1 = (node.boundsMin - origin) * inverse;
+        glm::vec3 t2 = (node.boundsMax - origin) * inverse;
+        glm::vec3 tLow = glm::min(t1, t2), tHigh = glm::max(t1, t2);
+        float tNear = std::max(std::max(tLow.x, tLow.y), std::max(tLow.z, 0.0f));
+        float tFar = std::min(std::min(tHigh.x, tHigh.y), std::min(tHigh.z, nearest));
+        if (!(tNear <= tFar))
+            continue;
+
+        if (node.count == 0) {
+            bool negative = direction[node.axis] < 0.0f;
+            stack[size++] = node.first + (negative ? 0 : 1);
+            stack[size++] = node.first + (negative ? 1 : 0);
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+            const BvhTriangle& triangle = bvh.triangles[i];
+            glm::vec3 p = glm::cross(direction, triangle.edge2);
+            float det = glm::dot(triangle.edge1, p);
+            if (std::abs(det) < 1e-12f)
+                continue;
+            float inverseDet = 1.0f / det;
+            glm::vec3 s = origin - triangle.v0;
+            float u = glm::dot(s, p) * inverseDet;
+            glm::vec3 q = glm::cross(s, triangle.edge1);
+            float v = glm::dot(direction, q) * inverseDet;
+            float t = glm::dot(triangle.edge2, q) * inverseDet;
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > MIN_HIT_DISTANCE && t < nearest) {
+                nearest = t;
+                hit = (int32_t)i;
+            }
+        }
+    }
+}
+
+#endif
+
+} // namespace
+
+Bvh buildBvh(std::vector<BvhTriangle> triangles) {
+    Bvh bvh;
+    bvh.triangles = std::move(triangles);
+    if (bvh.triangles.empty())
+        return bvh;
+    bvh.nodes.reserve(bvh.triangles.size() * 2);
+    bvh.nodes.resize(1);
+    buildNode(bvh, 0, 0, (uint32_t)bvh.triangles.size(), 0);
+    return bvh;
+}
+
+void tracePacket(const Bvh& bvh, const RayPacket& packet, PacketHits& hits) {
+    for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+        hits.t[lane] = packet.tMax[lane];
+        hits.triangle[lane] = -1;
+    }
+    if (bvh.nodes.empty())
+        return;
+
+#ifdef BVH_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 ox = _mm_load_ps(packet.originX), oy = _mm_load_ps(packet.originY), oz = _mm_load_ps(packet.originZ);
+    __m128 dx = _mm_load_ps(packet.directionX), dy = _mm_load_ps(packet.directionY),
+           dz = _mm_load_ps(packet.directionZ);
+    __m128 invX = _mm_div_ps(one, dx), invY = _mm_div_ps(one, dy), invZ = _mm_div_ps(one, dz);
+    __m128 nearest = _mm_load_ps(hits.t);
+    __m128i nearestTriangle = _mm_set1_epi32(-1);
+    const __m128 active = _mm_cmpgt_ps(nearest, zero);
+    const __m128 minDistance = _mm_set1_ps(MIN_HIT_DISTANCE);
+
+    uint32_t stack[MAX_DEPTH * 2];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const BvhNode& node = bvh.nodes[stack[--size]];
+
+        // Slab test of all four rays, against each ray's nearest hit so far
+        __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), ox), invX);
+        __m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), ox), invX);
+        __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), oy), invY);
+        __m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), oy), invY);
+        __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), oz), invZ);
+        __m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), oz), invZ);
+        __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)),
+                                  _mm_max_ps(_mm_min_ps(t1z, t2z), zero));
+        __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)),
+                                 _mm_min_ps(_mm_max_ps(t1z, t2z), nearest));
+        int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(tNear, tFar), active));
+        if (!mask)
+            continue;
+
+        if (node.count == 0) {
+            // Near child first, as seen by the first lane still in the node
+            int lane = 0;
+            while (!((mask >> lane) & 1))
+                ++lane;
+            const float* direction[3] = { packet.directionX, packet.directionY, packet.directionZ };
+            bool negative = direction[node.axis][lane] < 0.0f;
+            stack[size++] = node.first + (negative ? 0 : 1);
+            stack[size++] = node.first + (negative ? 1 : 0);
+            continue;
+        }
+
+        // Moller-Trumbore against each triangle, four rays at once
+        for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+            const BvhTriangle& triangle = bvh.triangles[i];
+            __m128 e1x = _mm_set1_ps(triangle.edge1.x), e1y = _mm_set1_ps(triangle.edge1.y),
+                   e1z = _mm_set1_ps(triangle.edge1.z);
+            __m128 e2x = _mm_set1_ps(triangle.edge2.x), e2y = _mm_set1_ps(triangle.edge2.y),
+                   e2z = _mm_set1_ps(triangle.edge2.z);
+
+            __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            __m128 inverseDet = _mm_div_ps(one, det);
+
+            __m128 sx = _mm_sub_ps(ox, _mm_set1_ps(triangle.v0.x));
+            __m128 sy = _mm_sub_ps(oy, _mm_set1_ps(triangle.v0.y));
+            __m128 sz = _mm_sub_ps(oz, _mm_set1_ps(triangle.v0.z));
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)),
+                                  inverseDet);
+
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)),
+                                  inverseDet);
+            __m128 t = _mm_mul_ps(
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDet);
+
+            // A parallel ray divides by zero, and every comparison with the NaNs fails
+            __m128 hit = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+            hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+            hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, minDistance), _mm_cmplt_ps(t, nearest)));
+            hit = _mm_and_ps(hit, active);
+            if (!_mm_movemask_ps(hit))
+                continue;
+            nearest = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, nearest));
+            __m128i hitMask = _mm_castps_si128(hit);
+            nearestTriangle = _mm_or_si128(_mm_and_si128(hitMask, _mm_set1_epi32((int)i)),
+                                           _mm_andnot_si128(hitMask, nearestTriangle));
+        }
+    }
+    _mm_store_ps(hits.t, nearest);
+    _mm_storeu_si128((__m128i*)hits.triangle, nearestTriangle);
+#else
+    for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+        if (packet.tMax[lane] <= 0.0f)
+            continue;
+        glm::vec3 origin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+        glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+        traceRay(bvh, origin, direction, hits.t[lane], hits.triangle[lane]);
+    }
+#endif
+}
+
+const char* bvhSimdName() {
+#ifdef BVH_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// Rays are traced in packets, one per SSE lane
+const int RAY_PACKET_SIZE = 4;
+
+struct BvhTriangle {
+    glm::vec3 v0;
+    glm::vec3 edge1; // v1 - v0
+    glm::vec3 edge2; // v2 - v0
+    uint32_t id;     // The caller's, to find what was hit
+};
+
+// Interior nodes keep their children side by side, the left one at first
+struct BvhNode {
+    glm::vec3 boundsMin;
+    uint32_t first; // Left child, or the leaf's first triangle
+    glm::vec3 boundsMax;
+    uint16_t count; // Triangles in a leaf, 0 for interior nodes
+    uint16_t axis;  // Split axis of interior nodes, the near child is visited first
+};
+
+// Bounding volume hierarchy over triangles, built once with a binned surface
+// area heuristic
+struct Bvh {
+    std::vector<BvhNode> nodes;
+    std::vector<BvhTriangle> triangles; // In leaf order
+};
+
+Bvh buildBvh(std::vector<BvhTriangle> triangles);
+
+// Rays by component, so each one loads straight into a register. Lanes with a
+// tMax of 0 are not traced.
+struct RayPacket {
+    alignas(16) float originX[RAY_PACKET_SIZE];
+    alignas(16) float originY[RAY_PACKET_SIZE];
+    alignas(16) float originZ[RAY_PACKET_SIZE];
+    alignas(16) float directionX[RAY_PACKET_SIZE];
+    alignas(16) float directionY[RAY_PACKET_SIZE];
+    alignas(16) float directionZ[RAY_PACKET_SIZE];
+    alignas(16) float tMax[RAY_PACKET_SIZE];
+};
+
+struct PacketHits {
+    alignas(16) float t[RAY_PACKET_SIZE];
+    int32_t triangle[RAY_PACKET_SIZE]; // Index into Bvh::triangles, -1 for a miss
+};
+
+// Nearest hit of every lane. The packet goes down the tree together, a node is
+// skipped only once no lane still reaching it can hit its box.
+void tracePacket(const Bvh& bvh, const RayPacket& packet, PacketHits& hits);
+
+// "SSE2" or "scalar", whichever tracePacket was built with
+const char* bvhSimdName();
@@ -0,0 +1,149 @@
+#include "camera_path.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const char RECORDING_MAGIC[4] = { 'A', 'G', 'C', 'P' };
+const uint32_t RECORDING_VERSION = 2;
+
+// Delta time, position, yaw, pitch, fov, mouse delta and scroll, then the
+// held keys. Version 1 frames had two unused floats before the keys.
+const int FRAME_FLOATS = 10;
+const int VERSION_1_UNUSED_FLOATS = 2;
+
+void writeUint32(std::ostream& out, uint32_t value) {
+    unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16),
+                               (unsigned char)(value >> 24) };
+    out.write((const char*)bytes, 4);
+}
+
+uint32_t readUint32(std::istream& in) {
+    unsigned char bytes[4] = {};
+    in.read((char*)bytes, 4);
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+void writeFloat(std::ostream& out, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    writeUint32(out, bits);
+}
+
+float readFloat(std::istream& in) {
+    uint32_t bits = readUint32(in);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+} // namespace
+
+bool saveCameraRecording(const char* path, const CameraRecording& recording) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to write camera recording: " << path << std::endl;
+        return false;
+    }
+
+    file.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    writeUint32(file, RECORDING_VERSION);
+    writeUint32(file, (uint32_t)recording.frames.size());
+
+    for (const CameraFrame& frame : recording.frames) {
+        float values[FRAME_FLOATS] = { frame.deltaTime, frame.position.x, frame.position.y, frame.position.z,
+                                       frame.yaw, frame.pitch, frame.fov, frame.mouseDelta.x,
+                                       frame.mouseDelta.y, frame.scroll };
+        for (float value : values)
+            writeFloat(file, value);
+        writeUint32(file, frame.keys);
+    }
+    return (bool)file;
+}
+
+bool loadCameraRecording(const char* path, CameraRecording& recording) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to open camera recording: " << path << std::endl;
+        return false;
+    }
+
+    char magic[4];
+    file.read(magic, sizeof(magic));
+    uint32_t version = readUint32(file);
+    uint32_t frameCount = readUint32(file);
+    if (!file || std::memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0 ||
+        (version != RECORDING_VERSION && version != 1)) {
+        std::cout << "Not a camera recording: " << path << std::endl;
+        return false;
+    }
+    if (frameCount == 0) {
+        std::cout << "Camera recording has no frames: " << path << std::endl;
+        return false;
+    }
+
+    // Version 1 was written on little-endian hosts only, so it reads the same way
+    size_t frameBytes = (FRAME_FLOATS + (version == 1 ? VERSION_1_UNUSED_FLOATS : 0)) * sizeof(float) + 4;
+
+    // The count comes from the file, so it is checked against the bytes
+    // left before anything is allocated for it
+    std::streamoff framesStart = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::streamoff remaining = file.tellg() - framesStart;
+    file.seekg(framesStart);
+    if (!file || remaining < 0 || frameCount > (uint64_t)remaining / frameBytes) {
+        std::cout << "Camera recording is truncated: " << path << " (expected "
+                  << (uint64_t)frameCount * frameBytes << " bytes of frames, found " << remaining << ")"
+                  << std::endl;
+        return false;
+    }
+    recording.frames.resize(frameCount);
+    for (CameraFrame& frame : recording.frames) {
+        float values[FRAME_FLOATS];
+        for (float& value : values)
+            value = readFloat(file);
+        if (version == 1)
+            file.ignore(VERSION_1_UNUSED_FLOATS * sizeof(float));
+        frame.keys = readUint32(file);
+
+        frame.deltaTime = values[0];
+        frame.position = glm::vec3(values[1], values[2], values[3]);
+        frame.yaw = values[4];
+        frame.pitch = values[5];
+        frame.fov = values[6];
+        frame.mouseDelta = glm::vec2(values[7], values[8]);
+        frame.scroll = values[9];
+    }
+
+    if (!file) {
+        std::cout << "Failed to read camera recording: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+glm::vec3 cameraFrontFromAngles(float yaw, float pitch) {
+    glm::vec3 front;
+    front.x = std::cos(glm::radians(yaw)) * std::cos(glm::radians(pitch));
+    front.y = std::sin(glm::radians(pitch));
+    front.z = std::sin(glm::radians(yaw)) * std::cos(glm::radians(pitch));
+    return glm::normalize(front);
+}
+
+bool cameraFrameTogglesShading(const CameraRecording& recording, int frame) {
+    bool down = (recording.frames[frame].keys & CAMERA_KEY_SHADING) != 0;
+    return down && (frame == 0 || !(recording.frames[frame - 1].keys & CAMERA_KEY_SHADING));
+}
+
+Camera cameraFromFrame(const CameraFrame& frame, float aspect) {
+    Camera camera;
+    camera.position = frame.position;
+    camera.front = cameraFrontFromAngles(frame.yaw, frame.pitch);
+    camera.up = glm::vec3(0.0f, 1.0f, 0.0f);
+    camera.fov = frame.fov;
+    camera.aspect = aspect;
+    return camera;
+}
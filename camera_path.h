@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "renderer.h"
+
+// Replays advance animation time by this much per recorded frame, whatever
+// the frame rate during recording was
+const float REPLAY_DELTA_TIME = 1.0f / 60.0f;
+
+// Input state bits stored with every recorded frame
+enum CameraKeys : uint32_t {
+    CAMERA_KEY_FORWARD = 1 << 0,
+    CAMERA_KEY_BACK = 1 << 1,
+    CAMERA_KEY_LEFT = 1 << 2,
+    CAMERA_KEY_RIGHT = 1 << 3,
+    CAMERA_KEY_SHADING = 1 << 4, // G, switches between forward and deferred shading
+};
+
+// Camera state after input handling for one frame, plus the input events that
+// produced it. Replays use the camera state directly, so they do not depend
+// on input timing or frame rate; of the input they only act on G presses.
+struct CameraFrame {
+    float deltaTime; // Of the recorded frame, replays use REPLAY_DELTA_TIME
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    float fov;
+    uint32_t keys; // CameraKeys held
+    glm::vec2 mouseDelta; // Pixels the cursor moved
+    float scroll;
+};
+
+// A recorded walkthrough. On disk: "AGCP" magic, format version, frame
+// count, then the frames as packed records, every field little-endian
+// whatever the host. Version 1 files, written in host order with two unused
+// floats per frame, still load.
+struct CameraRecording {
+    std::vector<CameraFrame> frames;
+};
+
+bool saveCameraRecording(const char* path, const CameraRecording& recording);
+bool loadCameraRecording(const char* path, CameraRecording& recording);
+
+// Unit view direction for yaw/pitch in degrees, as the mouse look computes it
+glm::vec3 cameraFrontFromAngles(float yaw, float pitch);
+
+Camera cameraFromFrame(const CameraFrame& frame, float aspect);
+
+// Whether G went down on this frame of the recording
+bool cameraFrameTogglesShading(const CameraRecording& recording, int frame);
@@ -0,0 +1,149 @@
+#include "culling.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE2 1
+#endif
+
+namespace {
+
+void setObjectBounds(SceneBounds& bounds, size_t index, const glm::mat4& model, glm::vec3 halfExtents) {
+    // Arvo: the world AABB of a transformed box sums the absolute matrix columns
+    glm::vec3 center(model[3]);
+    glm::vec3 extent = glm::abs(glm::vec3(model[0])) * halfExtents.x +
+                       glm::abs(glm::vec3(model[1])) * halfExtents.y +
+                       glm::abs(glm::vec3(model[2])) * halfExtents.z;
+
+    bounds.centerX[index] = center.x;
+    bounds.centerY[index] = center.y;
+    bounds.centerZ[index] = center.z;
+    bounds.extentX[index] = extent.x;
+    bounds.extentY[index] = extent.y;
+    bounds.extentZ[index] = extent.z;
+    bounds.radius[index] = glm::length(extent);
+}
+
+} // namespace
+
+Frustum extractFrustum(const glm::mat4& viewProjection) {
+    // Rows of the matrix, glm stores columns
+    glm::vec4 row[4];
+    for (int r = 0; r < 4; ++r)
+        row[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+    Frustum frustum;
+    frustum.planes[0] = row[3] + row[0]; // Left
+    frustum.planes[1] = row[3] - row[0]; // Right
+    frustum.planes[2] = row[3] + row[1]; // Bottom
+    frustum.planes[3] = row[3] - row[1]; // Top
+    frustum.planes[4] = row[3] + row[2]; // Near
+    frustum.planes[5] = row[3] - row[2]; // Far
+
+    for (glm::vec4& plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+SceneBounds buildSceneBounds(const Scene& scene) {
+    SceneBounds bounds;
+    size_t count = scene.objects.size();
+    for (std::vector<float>* column : { &bounds.centerX, &bounds.centerY, &bounds.centerZ, &bounds.extentX,
+                                        &bounds.extentY, &bounds.extentZ, &bounds.radius })
+        column->resize(count);
+
+    for (size_t i = 0; i < count; ++i)
+        setObjectBounds(bounds, i, scene.modelMatrices[i], meshHalfExtents(scene.objects[i].mesh));
+    return bounds;
+}
+
+void updateDynamicBounds(SceneBounds& bounds, const Scene& scene) {
+    for (unsigned int index : scene.dynamicObjects)
+        setObjectBounds(bounds, index, scene.modelMatrices[index], meshHalfExtents(scene.objects[index].mesh));
+}
+
+bool boxInFrustum(const Frustum& frustum, const SceneBounds& bounds, size_t i) {
+    for (const glm::vec4& plane : frustum.planes) {
+        float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+        float reach = std::fabs(plane.x) * bounds.extentX[i] + std::fabs(plane.y) * bounds.extentY[i] +
+                      std::fabs(plane.z) * bounds.extentZ[i];
+        if (distance + reach < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+int cullSceneBoundsScalar(const Frustum& frustum, const SceneBounds& bounds, std::vector<uint8_t>& visible) {
+    size_t count = bounds.centerX.size();
+    visible.resize(count);
+
+    int visibleCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        visible[i] = boxInFrustum(frustum, bounds, i) ? 1 : 0;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
+
+int cullSceneBounds(const Frustum& frustum, const SceneBounds& bounds, std::vector<uint8_t>& visible) {
+    visible.resize(bounds.centerX.size());
+    return cullSceneBounds(frustum, bounds, 0, bounds.centerX.size(), visible.data());
+}
+
+int cullSceneBounds(const Frustum& frustum, const SceneBounds& bounds, size_t first, size_t count, uint8_t* visible) {
+#ifdef CULLING_SSE2
+    // Broadcast each plane once, then test four objects per iteration
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+    for (int p = 0; p < 6; ++p) {
+        const glm::vec4& plane = frustum.planes[p];
+        planeX[p] = _mm_set1_ps(plane.x);
+        planeY[p] = _mm_set1_ps(plane.y);
+        planeZ[p] = _mm_set1_ps(plane.z);
+        planeW[p] = _mm_set1_ps(plane.w);
+        absX[p] = _mm_set1_ps(std::fabs(plane.x));
+        absY[p] = _mm_set1_ps(std::fabs(plane.y));
+        absZ[p] = _mm_set1_ps(std::fabs(plane.z));
+    }
+
+    int visibleCount = 0;
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = first, end = first + count;
+    for (; i + 4 <= end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                                         _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)),
+                                      _mm_mul_ps(absZ[p], ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), zero));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (int lane = 0; lane < 4; ++lane) {
+            visible[i + lane] = (mask >> lane) & 1;
+            visibleCount += visible[i + lane];
+        }
+    }
+
+    for (; i < end; ++i) {
+        visible[i] = boxInFrustum(frustum, bounds, i) ? 1 : 0;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+#else
+    int visibleCount = 0;
+    for (size_t i = first; i < first + count; ++i) {
+        visible[i] = boxInFrustum(frustum, bounds, i) ? 1 : 0;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+#endif
+}
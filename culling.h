@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "scene.h"
+
+// Planes as (normal, distance), normalized, pointing into the frustum
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Gribb/Hartmann plane extraction from projection * view
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+// World-space bounds of every scene object in structure-of-arrays layout, so
+// the plane tests run over contiguous floats. Each object has an AABB given
+// by center and half extents, and the enclosing sphere radius.
+struct SceneBounds {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<float> radius;
+};
+
+SceneBounds buildSceneBounds(const Scene& scene);
+
+// Re-derives the bounds of objects whose model matrix changes every frame
+void updateDynamicBounds(SceneBounds& bounds, const Scene& scene);
+
+// Tests the AABB of a single object
+bool boxInFrustum(const Frustum& frustum, const SceneBounds& bounds, size_t index);
+
+// Writes 1 to visible[i] when object i's AABB intersects the frustum, 0
+// otherwise. Returns the number of visible objects.
+int cullSceneBounds(const Frustum& frustum, const SceneBounds& bounds, std::vector<uint8_t>& visible);
+
+// The same over objects first to first + count - 1 only, writing their
+// entries of visible
+int cullSceneBounds(const Frustum& frustum, const SceneBounds& bounds, size_t first, size_t count, uint8_t* visible);
+
+// Reference implementation without SIMD, used to check and benchmark the fast path
+int cullSceneBoundsScalar(const Frustum& frustum, const SceneBounds& bounds, std::vector<uint8_t>& visible);
@@ -0,0 +1,155 @@
+#include "dds.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+
+const uint32_t DDSD_CAPS = 0x1;
+const uint32_t DDSD_HEIGHT = 0x2;
+const uint32_t DDSD_WIDTH = 0x4;
+const uint32_t DDSD_PIXELFORMAT = 0x1000;
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+const uint32_t DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDSCAPS_COMPLEX = 0x8;
+const uint32_t DDSCAPS_TEXTURE = 0x1000;
+const uint32_t DDSCAPS_MIPMAP = 0x400000;
+
+const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+const uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+
+uint32_t fourCC(const char* code) {
+    return (uint32_t)code[0] | ((uint32_t)code[1] << 8) | ((uint32_t)code[2] << 16) | ((uint32_t)code[3] << 24);
+}
+
+struct DDSPixelFormat {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t masks[4];
+};
+
+struct DDSHeader {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DDSPixelFormat pixelFormat;
+    uint32_t caps[4];
+    uint32_t reserved2;
+};
+
+struct DDSHeaderDX10 {
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+static_assert(sizeof(DDSHeader) == 124, "DDS header layout");
+
+} // namespace
+
+void addMipLevel(CompressedTexture& texture, int width, int height, const std::vector<uint8_t>& blocks) {
+    texture.levels.push_back({ width, height, texture.data.size(), blocks.size() });
+    texture.data.insert(texture.data.end(), blocks.begin(), blocks.end());
+}
+
+bool writeDDS(const char* path, const CompressedTexture& texture) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to write DDS file: " << path << std::endl;
+        return false;
+    }
+
+    DDSHeader header = {};
+    header.size = sizeof(DDSHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.width = texture.levels[0].width;
+    header.height = texture.levels[0].height;
+    header.pitchOrLinearSize = (uint32_t)texture.levels[0].size;
+    header.mipMapCount = (uint32_t)texture.levels.size();
+    header.pixelFormat.size = sizeof(DDSPixelFormat);
+    header.pixelFormat.flags = DDPF_FOURCC;
+    header.caps[0] = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+    if (texture.format == BlockFormat::BC1)
+        header.pixelFormat.fourCC = fourCC("DXT1");
+    else if (texture.format == BlockFormat::BC3)
+        header.pixelFormat.fourCC = fourCC("DXT5");
+    else
+        header.pixelFormat.fourCC = fourCC("DX10");
+
+    file.write((const char*)&DDS_MAGIC, sizeof(DDS_MAGIC));
+    file.write((const char*)&header, sizeof(header));
+    if (texture.format == BlockFormat::BC7) {
+        DDSHeaderDX10 extension = { DXGI_FORMAT_BC7_UNORM, D3D10_RESOURCE_DIMENSION_TEXTURE2D, 0, 1, 0 };
+        file.write((const char*)&extension, sizeof(extension));
+    }
+    file.write((const char*)texture.data.data(), texture.data.size());
+    return (bool)file;
+}
+
+bool readDDS(const char* path, CompressedTexture& texture) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    uint32_t magic = 0;
+    DDSHeader header = {};
+    file.read((char*)&magic, sizeof(magic));
+    file.read((char*)&header, sizeof(header));
+    if (!file || magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || !(header.pixelFormat.flags & DDPF_FOURCC)) {
+        std::cout << "Not a compressed DDS file: " << path << std::endl;
+        return false;
+    }
+
+    uint32_t code = header.pixelFormat.fourCC;
+    if (code == fourCC("DXT1"))
+        texture.format = BlockFormat::BC1;
+    else if (code == fourCC("DXT5"))
+        texture.format = BlockFormat::BC3;
+    else if (code == fourCC("DX10")) {
+        DDSHeaderDX10 extension = {};
+        file.read((char*)&extension, sizeof(extension));
+        if (!file || extension.dxgiFormat != DXGI_FORMAT_BC7_UNORM) {
+            std::cout << "Unsupported DX10 format in " << path << std::endl;
+            return false;
+        }
+        texture.format = BlockFormat::BC7;
+    }
+    else {
+        std::cout << "Unsupported DDS format in " << path << std::endl;
+        return false;
+    }
+
+    int width = (int)header.width, height = (int)header.height;
+    int levelCount = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(1, (int)header.mipMapCount) : 1;
+    texture.levels.clear();
+    size_t offset = 0;
+    for (int level = 0; level < levelCount; ++level) {
+        size_t size = compressedImageSize(texture.format, width, height);
+        texture.levels.push_back({ width, height, offset, size });
+        offset += size;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+
+    texture.data.resize(offset);
+    file.read((char*)texture.data.data(), offset);
+    if (!file) {
+        std::cout << "DDS file is truncated: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "block_compression.h"
+
+// One mip level inside CompressedTexture::data
+struct MipLevel {
+    int width;
+    int height;
+    size_t offset;
+    size_t size;
+};
+
+// A block-compressed texture with its whole mip chain, level 0 first
+struct CompressedTexture {
+    BlockFormat format;
+    std::vector<MipLevel> levels;
+    std::vector<uint8_t> data;
+};
+
+// Appends a level and its blocks
+void addMipLevel(CompressedTexture& texture, int width, int height, const std::vector<uint8_t>& blocks);
+
+// DirectDraw Surface files: DXT1/DXT5 FourCC headers for BC1/BC3, the DX10
+// extension header for BC7
+bool writeDDS(const char* path, const CompressedTexture& texture);
+bool readDDS(const char* path, CompressedTexture& texture);
@@ -0,0 +1,200 @@
+#include "deferred.h"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Tile columns and rows covered by a light's bounding sphere, or false if it
+// is entirely behind the camera or off screen. Spheres crossing the near
+// plane cover the whole screen.
+bool lightTileRect(const PointLight& light, const glm::mat4& view, const glm::mat4& projection, float nearPlane,
+                   int width, int height, int tilesX, int tilesY, int* rect) {
+    glm::vec4 bounds = lightBounds(light);
+    glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(bounds), 1.0f));
+    float radius = bounds.w;
+    float depth = -center.z;
+    if (depth + radius <= nearPlane)
+        return false;
+
+    rect[0] = 0;
+    rect[1] = tilesX - 1;
+    rect[2] = 0;
+    rect[3] = tilesY - 1;
+    if (depth - radius <= nearPlane)
+        return true;
+
+    // The sphere's view space box, projected through its nearest and farthest depth
+    float minX = 1e30f, maxX = -1e30f, minY = 1e30f, maxY = -1e30f;
+    for (float z : { depth - radius, depth + radius }) {
+        for (float side : { -radius, radius }) {
+            float x = projection[0][0] * (center.x + side) / z;
+            float y = projection[1][1] * (center.y + side) / z;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+        }
+    }
+    if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+        return false;
+
+    float tileWidth = (float)DEFERRED_TILE_SIZE * 2.0f / width;
+    float tileHeight = (float)DEFERRED_TILE_SIZE * 2.0f / height;
+    rect[0] = std::max(0, (int)std::floor((minX + 1.0f) / tileWidth));
+    rect[1] = std::min(tilesX - 1, (int)std::floor((maxX + 1.0f) / tileWidth));
+    rect[2] = std::max(0, (int)std::floor((minY + 1.0f) / tileHeight));
+    rect[3] = std::min(tilesY - 1, (int)std::floor((maxY + 1.0f) / tileHeight));
+    return true;
+}
+
+// Allocates the G-buffer targets at the viewport's size
+void resizeGBuffer(DeferredRenderer& deferred, int width, int height) {
+    glBindTexture(GL_TEXTURE_2D, deferred.albedoTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, deferred.depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8,
+                 NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, deferred.albedoTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, deferred.depthTexture, 0);
+    deferred.width = width;
+    deferred.height = height;
+}
+
+} // namespace
+
+void binTileLights(TileLightBins& bins, const std::vector<PointLight>& lights, const glm::mat4& view,
+                   const glm::mat4& projection, float nearPlane, int width, int height) {
+    Clock::time_point start = Clock::now();
+    bins.tilesX = (width + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE;
+    bins.tilesY = (height + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE;
+    int tileCount = bins.tilesX * bins.tilesY;
+
+    // Count first, then place every light in its tiles' now known slots
+    int lightCount = (int)std::min(lights.size(), (size_t)MAX_CLUSTERED_LIGHTS);
+    bins.lightTiles.resize(lightCount * 4);
+    std::vector<uint32_t> counts(tileCount, 0);
+    for (int light = 0; light < lightCount; ++light) {
+        int* rect = &bins.lightTiles[light * 4];
+        if (!lightTileRect(lights[light], view, projection, nearPlane, width, height, bins.tilesX, bins.tilesY,
+                           rect)) {
+            rect[0] = 1;
+            rect[1] = 0;
+            continue;
+        }
+        for (int y = rect[2]; y <= rect[3]; ++y) {
+            for (int x = rect[0]; x <= rect[1]; ++x)
+                ++counts[y * bins.tilesX + x];
+        }
+    }
+
+    bins.tileRanges.resize(tileCount * 2);
+    bins.maxTileLights = 0;
+    uint32_t offset = 0;
+    for (int tile = 0; tile < tileCount; ++tile) {
+        bins.tileRanges[tile * 2] = offset;
+        bins.tileRanges[tile * 2 + 1] = counts[tile];
+        bins.maxTileLights = std::max(bins.maxTileLights, (int)counts[tile]);
+        counts[tile] = offset;
+        offset += bins.tileRanges[tile * 2 + 1];
+    }
+    bins.lightIndices.resize(offset);
+    for (int light = 0; light < lightCount; ++light) {
+        const int* rect = &bins.lightTiles[light * 4];
+        for (int y = rect[2]; y <= rect[3]; ++y) {
+            for (int x = rect[0]; x <= rect[1]; ++x)
+                bins.lightIndices[counts[y * bins.tilesX + x]++] = (uint16_t)light;
+        }
+    }
+
+    bins.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+DeferredRenderer* createDeferredRenderer(const std::vector<PointLight>& lights, int firstUnit) {
+    DeferredRenderer* deferred = new DeferredRenderer();
+    deferred->firstUnit = firstUnit;
+
+    glGenTextures(1, &deferred->albedoTexture);
+    glGenTextures(1, &deferred->depthTexture);
+    for (unsigned int texture : { deferred->albedoTexture, deferred->depthTexture }) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &deferred->framebuffer);
+
+    deferred->lightProgram = createShaderProgram("deferred.vert", "deferred.frag");
+    const ShaderProgram& program = deferred->lightProgram;
+    glUseProgram(program.id);
+    glUniform1i(program.location(program.handle("albedo")), firstUnit);
+    glUniform1i(program.location(program.handle("depth")), firstUnit + 1);
+    glUniform1i(program.location(program.handle("tileLights")), firstUnit + 2);
+    glUniform1i(program.location(program.handle("tileRanges")), firstUnit + 3);
+    glUniform1i(program.location(program.handle("tileLightIndices")), firstUnit + 4);
+    glUniform1i(program.location(program.handle("tileSize")), DEFERRED_TILE_SIZE);
+    glUseProgram(0);
+    glGenVertexArrays(1, &deferred->emptyVao);
+
+    deferred->lightBuffers = createLightClusterBuffers();
+    uploadClusterLights(deferred->lightBuffers, lights);
+    return deferred;
+}
+
+void destroyDeferredRenderer(DeferredRenderer* deferred) {
+    destroyLightClusterBuffers(deferred->lightBuffers);
+    glDeleteVertexArrays(1, &deferred->emptyVao);
+    glDeleteProgram(deferred->lightProgram.id);
+    glDeleteFramebuffers(1, &deferred->framebuffer);
+    glDeleteTextures(1, &deferred->albedoTexture);
+    glDeleteTextures(1, &deferred->depthTexture);
+    delete deferred;
+}
+
+void beginGBufferPass(DeferredRenderer& deferred) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &deferred.savedFramebuffer);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, deferred.framebuffer);
+    if (viewport[2] != deferred.width || viewport[3] != deferred.height)
+        resizeGBuffer(deferred, viewport[2], viewport[3]);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void endGBufferPass(DeferredRenderer& deferred) {
+    glBindFramebuffer(GL_FRAMEBUFFER, deferred.savedFramebuffer);
+}
+
+void shadeDeferred(DeferredRenderer& deferred, const std::vector<PointLight>& lights, const glm::mat4& view,
+                   const glm::mat4& projection, float nearPlane) {
+    binTileLights(deferred.bins, lights, view, projection, nearPlane, deferred.width, deferred.height);
+    uploadLightLists(deferred.lightBuffers, deferred.bins.tileRanges, deferred.bins.lightIndices);
+
+    const ShaderProgram& program = deferred.lightProgram;
+    glUseProgram(program.id);
+    glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+    glUniformMatrix4fv(program.location(program.handle("inverseViewProjection")), 1, GL_FALSE,
+                       glm::value_ptr(inverseViewProjection));
+    glUniform2f(program.location(program.handle("viewportSize")), (float)deferred.width, (float)deferred.height);
+    glUniform1i(program.location(program.handle("tilesX")), deferred.bins.tilesX);
+
+    glActiveTexture(GL_TEXTURE0 + deferred.firstUnit);
+    glBindTexture(GL_TEXTURE_2D, deferred.albedoTexture);
+    glActiveTexture(GL_TEXTURE0 + deferred.firstUnit + 1);
+    glBindTexture(GL_TEXTURE_2D, deferred.depthTexture);
+    bindLightClusterBuffers(deferred.lightBuffers, deferred.firstUnit + 2);
+
+    // Every pixel once, over the background the frame was cleared to
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(deferred.emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glEnable(GL_DEPTH_TEST);
+}
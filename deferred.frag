@@ -0,0 +1,78 @@
+#version 330 core
+
+// Deferred light pass: every pixel the G-buffer covers is lit once, by the
+// lights the CPU binned into its screen tile. Matches shader.frag's lighting.
+
+struct PointLight {
+    vec3 position;
+    float range; // 0 when the light is not limited to one
+    vec3 color;
+    float intensity;
+};
+
+uniform sampler2D albedo;
+uniform sampler2D depth;
+
+// Each tile's offset and count in the index lists, and two texels per light,
+// position and range then colour and intensity
+uniform usamplerBuffer tileRanges;
+uniform usamplerBuffer tileLightIndices;
+uniform samplerBuffer tileLights;
+uniform int tileSize;
+uniform int tilesX;
+
+uniform mat4 inverseViewProjection;
+uniform vec2 viewportSize;
+
+out vec4 FragColor;
+
+vec3 diffuseLight(PointLight light, vec3 FragPos)
+{
+    // Calculate light direction
+    vec3 lightDir = normalize(light.position - FragPos);
+
+    // Diffuse lighting
+    float diff = max(dot(normalize(FragPos), lightDir), 0.0);
+    vec3 diffuse = light.color * diff * light.intensity;
+
+    // Smooth falloff reaching zero at the range
+    if (light.range > 0.0) {
+        float x = length(light.position - FragPos) / light.range;
+        float fade = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+        diffuse *= fade * fade;
+    }
+    return diffuse;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float fragmentDepth = texelFetch(depth, pixel, 0).r;
+    if (fragmentDepth == 1.0)
+        discard; // Nothing drawn, the clear colour stays
+
+    // World position back from the depth buffer
+    vec4 clip = vec4(gl_FragCoord.xy / viewportSize * 2.0 - 1.0, fragmentDepth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 FragPos = world.xyz / world.w;
+
+    vec3 objectColor = texelFetch(albedo, pixel, 0).rgb;
+    vec3 result = vec3(0.0);
+
+    ivec2 tile = pixel / tileSize;
+    uvec2 range = texelFetch(tileRanges, tile.x + tilesX * tile.y).xy;
+    for (uint i = 0u; i < range.y; ++i) {
+        int index = int(texelFetch(tileLightIndices, int(range.x + i)).r);
+        vec4 positionRange = texelFetch(tileLights, 2 * index);
+        vec4 colorIntensity = texelFetch(tileLights, 2 * index + 1);
+        result += diffuseLight(PointLight(positionRange.xyz, positionRange.w, colorIntensity.rgb, colorIntensity.a),
+                               FragPos);
+    }
+
+    // Ambient lighting
+    vec3 ambient = 0.1 * objectColor;
+
+    // Combine lighting and object color
+    vec3 finalColor = (ambient + result) * objectColor;
+    FragColor = vec4(finalColor, 1.0);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "light_clusters.h"
+#include "scene.h"
+#include "shader.h"
+
+// Square screen tiles lights are binned into for the light pass, in pixels
+const int DEFERRED_TILE_SIZE = 16;
+
+// Lights overlapping each screen tile. Each light's bounding sphere is
+// projected to a screen rectangle on the CPU, and the light is added to every
+// tile under it.
+struct TileLightBins {
+    int tilesX = 0;
+    int tilesY = 0;
+    std::vector<uint32_t> tileRanges; // Offset and count in lightIndices of each tile, rows from the bottom
+    std::vector<uint16_t> lightIndices;
+    std::vector<int> lightTiles; // First and last tile column and row of each light, scratch
+    int maxTileLights = 0;
+    double milliseconds = 0.0;
+};
+
+// Each tile's list keeps the lights in scene order
+void binTileLights(TileLightBins& bins, const std::vector<PointLight>& lights, const glm::mat4& view,
+                   const glm::mat4& projection, float nearPlane, int width, int height);
+
+// Deferred shading. The geometry pass writes only colour and depth into the
+// G-buffer; a full-screen pass then lights every covered pixel once, with the
+// lights of its tile, so overdrawn fragments cost no lighting.
+struct DeferredRenderer {
+    unsigned int framebuffer;
+    unsigned int albedoTexture; // RGBA8, unlit colour
+    unsigned int depthTexture;  // Positions are rebuilt from it
+    int width = 0;
+    int height = 0;
+    int firstUnit; // G-buffer and light lists on five consecutive texture units
+    ShaderProgram lightProgram;
+    unsigned int emptyVao; // The full-screen triangle needs no vertex buffer
+    LightClusterBuffers lightBuffers; // Tiles in the cluster lists' layout
+    TileLightBins bins;
+    int savedFramebuffer = 0;
+};
+
+// Needs a current GL context. firstUnit and the four units after it are used
+// by the light pass only.
+DeferredRenderer* createDeferredRenderer(const std::vector<PointLight>& lights, int firstUnit);
+void destroyDeferredRenderer(DeferredRenderer* deferred);
+
+// Redirects drawing into the G-buffer, sized for the current viewport and cleared
+void beginGBufferPass(DeferredRenderer& deferred);
+void endGBufferPass(DeferredRenderer& deferred);
+
+// Bins the lights into tiles and lights the G-buffer into the bound framebuffer
+void shadeDeferred(DeferredRenderer& deferred, const std::vector<PointLight>& lights, const glm::mat4& view,
+                   const glm::mat4& projection, float nearPlane);
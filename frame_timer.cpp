@@ -0,0 +1,79 @@
+#include "frame_timer.h"
+
+#include <glad/glad.h>
+#include <fstream>
+#include <iostream>
+
+#include "timing.h"
+
+namespace {
+
+using Clock = std::chrono::high_resolution_clock;
+
+void collectQuery(FrameTimer& timer, int slot) {
+    if (timer.queryFrame[slot] < 0)
+        return;
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(timer.queries[slot], GL_QUERY_RESULT, &nanoseconds);
+    timer.gpuMs[timer.queryFrame[slot]] = nanoseconds / 1.0e6;
+    timer.queryFrame[slot] = -1;
+}
+
+void printSummary(const char* label, const std::vector<double>& samples) {
+    TimingSummary summary = summarizeTimings(samples);
+    std::cout << label << ": min " << summary.min << " ms, avg " << summary.avg << " ms, p99 " << summary.p99
+              << " ms, max " << summary.max << " ms" << std::endl;
+}
+
+} // namespace
+
+FrameTimer createFrameTimer() {
+    FrameTimer timer;
+    glGenQueries(GPU_TIMER_QUERIES, timer.queries);
+    for (int i = 0; i < GPU_TIMER_QUERIES; ++i)
+        timer.queryFrame[i] = -1;
+    return timer;
+}
+
+void destroyFrameTimer(FrameTimer& timer) {
+    glDeleteQueries(GPU_TIMER_QUERIES, timer.queries);
+}
+
+void beginFrameTiming(FrameTimer& timer) {
+    int slot = timer.frame % GPU_TIMER_QUERIES;
+    collectQuery(timer, slot);
+
+    timer.cpuMs.push_back(0.0);
+    timer.gpuMs.push_back(0.0);
+    timer.queryFrame[slot] = timer.frame;
+    timer.frameStart = Clock::now();
+    glBeginQuery(GL_TIME_ELAPSED, timer.queries[slot]);
+}
+
+void endFrameTiming(FrameTimer& timer) {
+    glEndQuery(GL_TIME_ELAPSED);
+    timer.cpuMs[timer.frame] = std::chrono::duration<double, std::milli>(Clock::now() - timer.frameStart).count();
+    ++timer.frame;
+}
+
+void finishFrameTiming(FrameTimer& timer) {
+    for (int i = 0; i < GPU_TIMER_QUERIES; ++i)
+        collectQuery(timer, i);
+}
+
+void printFrameTimings(const FrameTimer& timer) {
+    printSummary("CPU", timer.cpuMs);
+    printSummary("GPU", timer.gpuMs);
+}
+
+bool writeFrameTimingsCsv(const FrameTimer& timer, const char* path) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cout << "Failed to write timings: " << path << std::endl;
+        return false;
+    }
+    file << "frame,cpu_ms,gpu_ms\n";
+    for (size_t i = 0; i < timer.cpuMs.size(); ++i)
+        file << i << "," << timer.cpuMs[i] << "," << timer.gpuMs[i] << "\n";
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+// Queries in flight; results are read back this many frames late so the CPU
+// never waits on the GPU
+const int GPU_TIMER_QUERIES = 4;
+
+// Per-frame CPU and GPU timing. CPU time covers everything between begin and
+// end on the calling thread, GPU time comes from GL_TIME_ELAPSED queries.
+// Every timed frame keeps its samples, so only time runs of bounded length:
+// replays and headless runs.
+struct FrameTimer {
+    unsigned int queries[GPU_TIMER_QUERIES];
+    int queryFrame[GPU_TIMER_QUERIES]; // Frame measured by each query, -1 when idle
+    int frame = 0;
+    std::chrono::high_resolution_clock::time_point frameStart;
+    std::vector<double> cpuMs;
+    std::vector<double> gpuMs;
+};
+
+FrameTimer createFrameTimer();
+void destroyFrameTimer(FrameTimer& timer);
+
+void beginFrameTiming(FrameTimer& timer);
+void endFrameTiming(FrameTimer& timer);
+
+// Waits for the queries still in flight, call before reading gpuMs
+void finishFrameTiming(FrameTimer& timer);
+
+// Prints min/avg/p99/max for both series
+void printFrameTimings(const FrameTimer& timer);
+
+// One row per frame: frame,cpu_ms,gpu_ms
+bool writeFrameTimingsCsv(const FrameTimer& timer, const char* path);
@@ -0,0 +1,87 @@
+#include "frame_uniforms.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+GLsizeiptr alignUp(GLsizeiptr value, GLsizeiptr alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+FrameUniformBuffer createFrameUniformBuffer() {
+    FrameUniformBuffer frameUniforms;
+
+    int alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    // Both blocks live in the same slot, each starting on a legal bind offset
+    frameUniforms.lightOffset = alignUp(sizeof(CameraBlock), alignment);
+    frameUniforms.slotSize = alignUp(frameUniforms.lightOffset + sizeof(LightBlock), alignment);
+    frameUniforms.fences.assign(FRAME_UNIFORM_SLOTS, nullptr);
+
+    glGenBuffers(1, &frameUniforms.buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniforms.buffer);
+    glBufferData(GL_UNIFORM_BUFFER, frameUniforms.slotSize * FRAME_UNIFORM_SLOTS, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    return frameUniforms;
+}
+
+void destroyFrameUniformBuffer(FrameUniformBuffer& frameUniforms) {
+    for (GLsync& fence : frameUniforms.fences) {
+        if (fence)
+            glDeleteSync(fence);
+        fence = nullptr;
+    }
+    glDeleteBuffers(1, &frameUniforms.buffer);
+    frameUniforms.buffer = 0;
+}
+
+LightBlock makeLightBlock(const std::vector<PointLight>& lights) {
+    LightBlock block = {};
+    int count = std::min((int)lights.size(), MAX_FRAME_LIGHTS);
+    for (int i = 0; i < count; ++i) {
+        block.lights[i].position = lights[i].position;
+        block.lights[i].range = lights[i].range;
+        block.lights[i].color = lights[i].color;
+        block.lights[i].intensity = lights[i].intensity;
+    }
+    return block;
+}
+
+void updateFrameUniforms(FrameUniformBuffer& frameUniforms, const CameraBlock& camera, const LightBlock& lights) {
+    frameUniforms.slot = (frameUniforms.slot + 1) % FRAME_UNIFORM_SLOTS;
+    GLintptr offset = frameUniforms.slot * frameUniforms.slotSize;
+
+    // Wait for the frame that last read this slot, normally long finished
+    GLsync& fence = frameUniforms.fences[frameUniforms.slot];
+    if (fence) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniforms.buffer);
+    void* mapped = glMapBufferRange(GL_UNIFORM_BUFFER, offset, frameUniforms.slotSize,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped) {
+        std::memcpy(mapped, &camera, sizeof(CameraBlock));
+        std::memcpy((char*)mapped + frameUniforms.lightOffset, &lights, sizeof(LightBlock));
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, frameUniforms.buffer, offset, sizeof(CameraBlock));
+    glBindBufferRange(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, frameUniforms.buffer,
+                      offset + frameUniforms.lightOffset, sizeof(LightBlock));
+}
+
+void fenceFrameUniforms(FrameUniformBuffer& frameUniforms) {
+    GLsync& fence = frameUniforms.fences[frameUniforms.slot];
+    if (fence)
+        glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
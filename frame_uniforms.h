@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "scene.h"
+
+// Uniform block binding points shared by every program
+const unsigned int CAMERA_BLOCK_BINDING = 0;
+const unsigned int LIGHT_BLOCK_BINDING = 1;
+
+// Size of the light block, passed to every shader variant as MAX_LIGHTS. The
+// shaders index it with 4 bits, eight per instance.
+const int MAX_FRAME_LIGHTS = 5;
+
+// std140 mirror of "uniform Camera" in shader.vert/shader.frag
+struct CameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 viewPos; // xyz used
+};
+
+// std140 mirror of the PointLight struct in shader.frag
+struct LightBlockEntry {
+    glm::vec3 position;
+    float range;
+    glm::vec3 color;
+    float intensity;
+};
+
+// std140 mirror of "uniform Lights" in shader.frag
+struct LightBlock {
+    LightBlockEntry lights[MAX_FRAME_LIGHTS];
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock must follow std140 layout");
+static_assert(sizeof(LightBlockEntry) == 32, "LightBlockEntry must follow std140 layout");
+static_assert(MAX_FRAME_LIGHTS <= 8, "Instances hold eight 4-bit light indices");
+
+// One buffer holding FRAME_UNIFORM_SLOTS copies of the per-frame blocks. Each
+// frame writes the next slot with a single unsynchronized map, the fence of the
+// frame that last used a slot guards against overwriting data still in flight.
+struct FrameUniformBuffer {
+    unsigned int buffer = 0;
+    GLsizeiptr slotSize = 0;
+    GLintptr lightOffset = 0; // Offset of LightBlock inside a slot
+    std::vector<GLsync> fences;
+    int slot = 0;
+};
+
+const int FRAME_UNIFORM_SLOTS = 3;
+
+FrameUniformBuffer createFrameUniformBuffer();
+void destroyFrameUniformBuffer(FrameUniformBuffer& frameUniforms);
+
+LightBlock makeLightBlock(const std::vector<PointLight>& lights);
+
+// Uploads this frame's camera and lights and binds them to their binding points
+void updateFrameUniforms(FrameUniformBuffer& frameUniforms, const CameraBlock& camera, const LightBlock& lights);
+
+// Call after the frame's draws so the slot is not reused while the GPU reads it
+void fenceFrameUniforms(FrameUniformBuffer& frameUniforms);
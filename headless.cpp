@@ -0,0 +1,322 @@
+#include "headless.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "camera_path.h"
+#include "frame_timer.h"
+#include "program_cache.h"
+#include "renderer.h"
+#include "shader.h"
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::high_resolution_clock;
+
+struct Waypoint {
+    glm::vec3 position;
+    float yaw; // Degrees, -90 looks down -Z like the interactive camera
+};
+
+// A walk from the hub into every arm and back, at eye height
+const Waypoint CAMERA_PATH[] = {
+    { glm::vec3(0.0f, 1.5f, 3.0f), -90.0f },
+    { glm::vec3(0.0f, 1.5f, -10.0f), -90.0f },
+    { glm::vec3(0.0f, 1.5f, -10.0f), 90.0f },
+    { glm::vec3(0.0f, 1.5f, 0.0f), 0.0f },
+    { glm::vec3(10.0f, 1.5f, 0.0f), 0.0f },
+    { glm::vec3(10.0f, 1.5f, 0.0f), 180.0f },
+    { glm::vec3(0.0f, 1.5f, 0.0f), 90.0f },
+    { glm::vec3(0.0f, 1.5f, 10.0f), 90.0f },
+    { glm::vec3(0.0f, 1.5f, 10.0f), 270.0f },
+    { glm::vec3(0.0f, 1.5f, 0.0f), 180.0f },
+    { glm::vec3(-10.0f, 1.5f, 0.0f), 180.0f },
+    { glm::vec3(-10.0f, 1.5f, 0.0f), 360.0f },
+    { glm::vec3(0.0f, 1.5f, 3.0f), 270.0f },
+};
+
+// Position along the scripted path, t in [0, 1]
+Camera scriptedCamera(float t, float aspect) {
+    const int segments = sizeof(CAMERA_PATH) / sizeof(CAMERA_PATH[0]) - 1;
+    float scaled = std::fmin(std::fmax(t, 0.0f), 1.0f) * segments;
+    int segment = std::min((int)scaled, segments - 1);
+    float blend = scaled - segment;
+
+    const Waypoint& from = CAMERA_PATH[segment];
+    const Waypoint& to = CAMERA_PATH[segment + 1];
+    float yaw = glm::radians(from.yaw + (to.yaw - from.yaw) * blend);
+
+    Camera camera;
+    camera.position = glm::mix(from.position, to.position, blend);
+    camera.front = glm::vec3(std::cos(yaw), 0.0f, std::sin(yaw));
+    camera.up = glm::vec3(0.0f, 1.0f, 0.0f);
+    camera.fov = 45.0f;
+    camera.aspect = aspect;
+    return camera;
+}
+
+bool writePPM(const char* path, int width, int height) {
+    std::vector<unsigned char> pixels(width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    // GL rows start at the bottom
+    for (int y = height - 1; y >= 0; --y)
+        file.write((const char*)&pixels[y * width * 3], width * 3);
+    return true;
+}
+
+// Renders the path into an offscreen framebuffer with the current context
+int renderOffscreen(const HeadlessOptions& options) {
+    CameraRecording recording;
+    if (options.replayPath && !loadCameraRecording(options.replayPath, recording))
+        return -1;
+    int frameCount = options.replayPath ? (int)recording.frames.size() : options.frames;
+
+    unsigned int framebuffer, colorBuffer, depthBuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &colorBuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, options.width, options.height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, options.width, options.height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Offscreen framebuffer is incomplete" << std::endl;
+        return -1;
+    }
+    glViewport(0, 0, options.width, options.height);
+
+    Clock::time_point loadStart = Clock::now();
+    GalleryRenderer renderer = createGalleryRenderer(options.renderer);
+    glFinish();
+    double loadMs = std::chrono::duration<double, std::milli>(Clock::now() - loadStart).count();
+
+    // Measure a fully loaded gallery
+    finishTextureLoading(renderer);
+    glFinish();
+    double texturesMs = std::chrono::duration<double, std::milli>(Clock::now() - loadStart).count();
+    unsigned int startupLocationQueries = uniformLocationQueryCount();
+
+    // GPU time is read back a few frames late, nothing waits for the GPU
+    // inside the loop
+    FrameTimer timer = createFrameTimer();
+    float aspect = (float)options.width / options.height;
+
+    // One untimed warm-up frame absorbs first-use costs in the driver
+    FrameStats stats = renderFrame(renderer, options.replayPath ? cameraFromFrame(recording.frames[0], aspect)
+                                                                : scriptedCamera(0.0f, aspect), 0.0f);
+    glFinish();
+    for (int frame = 0; frame < frameCount; ++frame) {
+        Camera camera;
+        if (options.replayPath) {
+            camera = cameraFromFrame(recording.frames[frame], aspect);
+            if (cameraFrameTogglesShading(recording, frame))
+                renderer.deferredShading = !renderer.deferredShading;
+        }
+        else
+            camera = scriptedCamera(frameCount > 1 && !options.fixedCamera ? (float)frame / (frameCount - 1) : 0.0f,
+                                    aspect);
+
+        beginFrameTiming(timer);
+        stats = renderFrame(renderer, camera, frame * REPLAY_DELTA_TIME);
+        endFrameTiming(timer);
+    }
+    finishFrameTiming(timer);
+
+    if (options.report) {
+        std::cout << "Rendered " << frameCount << " frames at " << options.width << "x" << options.height
+                  << ", startup " << loadMs << " ms, textures loaded after " << texturesMs << " ms" << std::endl;
+        ProgramCreationStats programs = programCreationStats();
+        std::cout << "Shaders: " << programs.fromCache << " programs from the cache, " << programs.compiled
+                  << " compiled, " << programs.milliseconds << " ms" << std::endl;
+        const TextureLoader& loader = *renderer.textureLoader;
+        std::cout << "Texture memory: " << loader.residentBytes / 1024 << " KB of a " << loader.budgetBytes / 1024
+                  << " KB budget, " << loader.evictedBytes / 1024 << " KB evicted, " << loader.compressedCount << " of "
+                  << loader.loads.size() << " textures from the compressed cache" << std::endl;
+        const char* meshNames[(int)MeshId::Count] = { "Quad", "Box" };
+        for (int mesh = 0; mesh < (int)MeshId::Count; ++mesh) {
+            const MeshBuildStats& built = renderer.meshStats[mesh];
+            std::cout << "Mesh " << meshNames[mesh] << ": " << built.triangles << " triangles, " << built.sourceVertices
+                      << " vertices indexed to " << built.vertices << ", ACMR " << built.soup.acmr << " unindexed, "
+                      << built.indexed.acmr << " indexed, " << built.optimised.acmr << " optimised (ATVR "
+                      << built.optimised.atvr << ")" << std::endl;
+        }
+        if (renderer.paintingArray) {
+            std::cout << "Painting array: " << renderer.paintingArray->layers.size() << " layers, "
+                      << textureArrayBytes(*renderer.paintingArray) / 1024 << " KB" << std::endl;
+        }
+        if (renderer.virtualTexture) {
+            const VirtualTexture& texture = *renderer.virtualTexture;
+            std::cout << "Virtual texture: " << texture.residentPages << " of " << texture.pyramid.pageCount
+                      << " pages resident, " << texture.pagesUploaded << " uploaded, "
+                      << virtualTextureBytes(texture) / 1024 << " KB" << std::endl;
+        }
+        if (renderer.lightClusterBuilder) {
+            const LightClusterBuilder& clusters = *renderer.lightClusterBuilder;
+            std::cout << "Light clusters: " << renderer.scene.lights.size() << " lights, "
+                      << clusters.lightIndices.size() << " list entries, at most " << clusters.maxClusterLights
+                      << " in a cluster, binned in " << clusters.milliseconds << " ms on "
+                      << lightClusterThreads(clusters) << " threads" << std::endl;
+        }
+        if (renderer.deferredShading) {
+            const TileLightBins& bins = renderer.deferred->bins;
+            std::cout << "Deferred tiles: " << bins.tilesX << "x" << bins.tilesY << ", " << bins.lightIndices.size()
+                      << " list entries, at most " << bins.maxTileLights << " in a tile, binned in "
+                      << bins.milliseconds << " ms" << std::endl;
+        }
+        if (renderer.lightmapTexture) {
+            int charted = (int)std::count_if(renderer.objectLightmapCharts.begin(), renderer.objectLightmapCharts.end(),
+                                             [](const glm::vec3& chart) { return chart.z > 0.0f; });
+            std::cout << "Lightmap: " << renderer.lightmapSize.x << "x" << renderer.lightmapSize.y << ", " << charted
+                      << " of " << renderer.scene.objects.size() << " objects baked" << std::endl;
+        }
+        if (renderer.probeTexture) {
+            const ProbeGrid& grid = renderer.probeGrid;
+            size_t probeCount = (size_t)grid.counts.x * grid.counts.y * grid.counts.z;
+            std::cout << "Irradiance probes: " << grid.counts.x << "x" << grid.counts.y << "x" << grid.counts.z << ", "
+                      << probeCount * PROBE_TEXTURE_SLABS * 8 / 1024 << " KB" << std::endl;
+        }
+        if (renderer.shadowAtlas) {
+            const ShadowAtlas& atlas = *renderer.shadowAtlas;
+            std::cout << "Shadow atlas: " << atlas.width << "x" << atlas.height << ", " << atlas.lightCount
+                      << " lights, " << atlas.staticDraws << " static draws at startup, " << atlas.facesUpdated
+                      << " faces and " << atlas.dynamicDraws << " dynamic draws last frame, "
+                      << shadowAtlasBytes(atlas) / (1024 * 1024) << " MB" << std::endl;
+        }
+        printFrameTimings(timer);
+        std::cout << "Last frame: " << formatFrameStats(stats) << std::endl;
+        std::cout << "Uniform location queries: " << startupLocationQueries << " at startup, "
+                  << uniformLocationQueryCount() - startupLocationQueries << " while rendering, reflecting "
+                  << renderer.shaders.programs.size() << " shader variants" << std::endl;
+    }
+    if (options.result) {
+        options.result->cpu = summarizeTimings(timer.cpuMs);
+        options.result->gpu = summarizeTimings(timer.gpuMs);
+        options.result->lightListEntries = 0;
+        if (renderer.deferredShading)
+            options.result->lightListEntries = renderer.deferred->bins.lightIndices.size();
+        else if (renderer.lightClusterBuilder)
+            options.result->lightListEntries = renderer.lightClusterBuilder->lightIndices.size();
+    }
+
+    int result = 0;
+    if (options.csvPath && !writeFrameTimingsCsv(timer, options.csvPath))
+        result = -1;
+    if (options.screenshotPath && !writePPM(options.screenshotPath, options.width, options.height)) {
+        std::cout << "Failed to write screenshot: " << options.screenshotPath << std::endl;
+        result = -1;
+    }
+
+    destroyFrameTimer(timer);
+    destroyGalleryRenderer(renderer);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    return result;
+}
+
+} // namespace
+
+#ifdef __linux__
+
+int runHeadless(const HeadlessOptions& options) {
+    // Prefer Mesa's surfaceless platform, it needs neither X11 nor a GPU
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        std::cout << "Failed to initialize EGL" << std::endl;
+        return -1;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+
+    // No surface is ever created, any OpenGL capable config will do
+    const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+        config = EGL_NO_CONFIG_KHR;
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cout << "Failed to create a surfaceless OpenGL 3.3 context" << std::endl;
+        eglTerminate(display);
+        return -1;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        eglTerminate(display);
+        return -1;
+    }
+    if (options.report)
+        std::cout << "Headless: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+    if (options.programCache)
+        initProgramCache((GLADloadproc)eglGetProcAddress);
+
+    // Shader rebuilds happen on a second context sharing objects with this one
+    HeadlessOptions renderOptions = options;
+    EGLContext reloadContext = EGL_NO_CONTEXT;
+    if (options.hotReload) {
+        reloadContext = eglCreateContext(display, config, context, contextAttributes);
+        if (reloadContext == EGL_NO_CONTEXT) {
+            std::cout << "Shader hot reload unavailable: no shared context" << std::endl;
+        }
+        else {
+            renderOptions.renderer.shaderReloadContext = [display, reloadContext](bool bind) {
+                eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, bind ? reloadContext : EGL_NO_CONTEXT);
+            };
+        }
+    }
+
+    int result = renderOffscreen(renderOptions);
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (reloadContext != EGL_NO_CONTEXT)
+        eglDestroyContext(display, reloadContext);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    return result;
+}
+
+#else
+
+int runHeadless(const HeadlessOptions& options) {
+    std::cout << "Headless mode needs EGL and is only available on Linux" << std::endl;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "renderer.h"
+#include "timing.h"
+
+// What a run measured, for benchmarks comparing renderer options
+struct HeadlessResult {
+    TimingSummary cpu;
+    TimingSummary gpu;
+    size_t lightListEntries; // Cluster or tile list entries of the last frame
+};
+
+// Offscreen rendering without a window or display: a surfaceless EGL context
+// (Mesa llvmpipe on GPU-less machines) renders into an FBO along a scripted
+// camera path, or a recorded one, then prints timing statistics.
+struct HeadlessOptions {
+    int frames = 600;
+    int width = 1280;
+    int height = 720;
+    const char* screenshotPath = nullptr; // Last frame as binary PPM, if set
+    const char* replayPath = nullptr; // Camera recording to follow instead of the scripted path
+    const char* csvPath = nullptr; // Per-frame CPU/GPU timings, if set
+    bool programCache = true; // Load linked shaders saved by earlier runs
+    bool hotReload = false; // Rebuild shaders when their files are saved
+    bool fixedCamera = false; // Every frame from the start of the scripted path, in the hub
+    bool report = true; // Print what was loaded and the frame timings
+    HeadlessResult* result = nullptr; // Filled in after the run, if set
+    RendererOptions renderer;
+};
+
+// Returns the process exit code
+int runHeadless(const HeadlessOptions& options);
@@ -0,0 +1,102 @@
+#include "instancing.h"
+
+#include <glad/glad.h>
+#include <cstddef>
+
+namespace {
+
+// Points the four matrix columns, the layer, the lights and the chart at the batch's first instance
+void setInstanceOffset(int firstInstance) {
+    size_t base = firstInstance * sizeof(InstanceData);
+    for (unsigned int column = 0; column < 4; ++column) {
+        size_t offset = base + offsetof(InstanceData, model) + column * sizeof(glm::vec4);
+        glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offset);
+    }
+    glVertexAttribPointer(INSTANCE_LAYER_LOCATION, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void*)(base + offsetof(InstanceData, layer)));
+    glVertexAttribIPointer(INSTANCE_LIGHTS_LOCATION, 1, GL_UNSIGNED_INT, sizeof(InstanceData),
+                           (void*)(base + offsetof(InstanceData, lightIndices)));
+    glVertexAttribPointer(INSTANCE_LIGHTMAP_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void*)(base + offsetof(InstanceData, lightmapChart)));
+}
+
+} // namespace
+
+InstanceBatcher createInstanceBatcher() {
+    InstanceBatcher batcher;
+    glGenBuffers(1, &batcher.buffer);
+    return batcher;
+}
+
+void destroyInstanceBatcher(InstanceBatcher& batcher) {
+    glDeleteBuffers(1, &batcher.buffer);
+    batcher.buffer = 0;
+    batcher.capacity = 0;
+}
+
+void enableInstanceAttributes(unsigned int vao) {
+    glBindVertexArray(vao);
+    for (unsigned int column = 0; column < 4; ++column) {
+        glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+        glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+    }
+    glEnableVertexAttribArray(INSTANCE_LAYER_LOCATION);
+    glVertexAttribDivisor(INSTANCE_LAYER_LOCATION, 1);
+    glEnableVertexAttribArray(INSTANCE_LIGHTS_LOCATION);
+    glVertexAttribDivisor(INSTANCE_LIGHTS_LOCATION, 1);
+    glEnableVertexAttribArray(INSTANCE_LIGHTMAP_LOCATION);
+    glVertexAttribDivisor(INSTANCE_LIGHTMAP_LOCATION, 1);
+    glBindVertexArray(0);
+}
+
+void buildInstanceBatches(InstanceBatcher& batcher, const RenderQueue& queue, const Scene& scene, const Mesh* meshes,
+                          const int* textureLayers, const uint32_t* objectLights,
+                          const glm::vec3* objectLightmapCharts) {
+    batcher.batches.clear();
+    batcher.instances.resize(queue.items.size());
+
+    for (size_t i = 0; i < queue.items.size(); ++i) {
+        const RenderItem& item = queue.items[i];
+        int layer = textureLayers[(int)scene.objects[item.object].texture];
+        batcher.instances[i] = { scene.modelMatrices[item.object], (float)layer, objectLights[item.object],
+                                 objectLightmapCharts[item.object] };
+
+        // Depth buckets only order instances, a batch breaks on state changes.
+        // Names are compared in full, two may share their low 16 bits in the key.
+        const Mesh& mesh = meshes[(int)scene.objects[item.object].mesh];
+        if (i > 0 && (item.key & STATE_KEY_MASK) == (queue.items[i - 1].key & STATE_KEY_MASK)) {
+            const InstanceBatch& batch = batcher.batches.back();
+            if (batch.program == item.program && batch.vao == mesh.vao && batch.texture == item.texture) {
+                ++batcher.batches.back().instanceCount;
+                continue;
+            }
+        }
+        batcher.batches.push_back({ item.program, mesh.vao, item.texture, layer != -1,
+                                    mesh.indexType, mesh.indexCount, (int)i, 1 });
+    }
+
+    // Orphan the previous contents so the upload never waits on the GPU
+    int total = (int)batcher.instances.size();
+    glBindBuffer(GL_ARRAY_BUFFER, batcher.buffer);
+    if (total > batcher.capacity)
+        batcher.capacity = total * 2;
+    glBufferData(GL_ARRAY_BUFFER, batcher.capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, total * sizeof(InstanceData), batcher.instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawInstanceBatches(const InstanceBatcher& batcher, RenderStateTracker& tracker, unsigned int program) {
+    glBindBuffer(GL_ARRAY_BUFFER, batcher.buffer);
+    for (const InstanceBatch& batch : batcher.batches) {
+        bindProgram(tracker, program ? program : batch.program);
+        bindVertexArray(tracker, batch.vao);
+        if (!batch.fixedUnit)
+            bindTexture2D(tracker, batch.texture);
+        setInstanceOffset(batch.firstInstance);
+        glDrawElementsInstanced(GL_TRIANGLES, batch.indexCount, batch.indexType, (void*)0, batch.instanceCount);
+
+        ++tracker.stats.drawCalls;
+        tracker.stats.instances += batch.instanceCount;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "mesh.h"
+#include "render_queue.h"
+#include "scene.h"
+
+// The per-instance model matrix takes one attribute location per column
+const unsigned int INSTANCE_MODEL_LOCATION = 2;
+
+// Per-instance texture array layer, after the matrix columns
+const unsigned int INSTANCE_LAYER_LOCATION = 6;
+
+// Per-instance light indices, 4 bits each, read as an integer
+const unsigned int INSTANCE_LIGHTS_LOCATION = 7;
+
+// Per-instance lightmap chart, after the light indices
+const unsigned int INSTANCE_LIGHTMAP_LOCATION = 9;
+
+// Layer of instances that sample the virtual texture instead of a 2D texture or the array
+const int VIRTUAL_TEXTURE_LAYER = -2;
+
+struct InstanceData {
+    glm::mat4 model;
+    float layer; // -1 samples the batch's 2D texture, VIRTUAL_TEXTURE_LAYER the virtual texture
+    uint32_t lightIndices; // Lights affecting the instance, 4 bits each, as many as its program loops over
+    glm::vec3 lightmapChart; // Chart corner and cell size in texels, read by lightmapped programs only
+};
+
+// A run of sorted render items sharing program, VAO and texture, drawn with one call
+struct InstanceBatch {
+    unsigned int program;
+    unsigned int vao;
+    unsigned int texture;
+    bool fixedUnit; // texture stays bound to its own unit: the texture array or the virtual texture
+    unsigned int indexType;
+    int indexCount;
+    int firstInstance;
+    int instanceCount;
+};
+
+// Gathers model matrices in queue order into one instance buffer per frame
+struct InstanceBatcher {
+    unsigned int buffer = 0;
+    int capacity = 0;
+    std::vector<InstanceData> instances;
+    std::vector<InstanceBatch> batches;
+};
+
+InstanceBatcher createInstanceBatcher();
+void destroyInstanceBatcher(InstanceBatcher& batcher);
+
+// Enables the instance attributes on a mesh VAO. Their pointers are set per
+// batch at draw time, GL 3.3 has no base instance.
+void enableInstanceAttributes(unsigned int vao);
+
+// Merges consecutive items of a sorted queue with equal state into batches and
+// uploads their matrices. textureLayers[TextureId] is the array layer of
+// textures packed into the texture array, VIRTUAL_TEXTURE_LAYER for the
+// virtual texture, -1 for the others. objectLights[object] are the packed
+// light indices of each scene object, objectLightmapCharts[object] their
+// lightmap charts.
+void buildInstanceBatches(InstanceBatcher& batcher, const RenderQueue& queue, const Scene& scene, const Mesh* meshes,
+                          const int* textureLayers, const uint32_t* objectLights,
+                          const glm::vec3* objectLightmapCharts);
+
+// Issues one glDrawElementsInstanced per batch through the state tracker.
+// Batches on a fixed unit use the texture already bound there. A program
+// other than 0 replaces every batch's own.
+void drawInstanceBatches(const InstanceBatcher& batcher, RenderStateTracker& tracker, unsigned int program = 0);
@@ -0,0 +1,105 @@
+#include "irradiance_probes.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const char PROBE_MAGIC[4] = { 'A', 'G', 'I', 'P' };
+const uint32_t PROBE_VERSION = 1;
+
+} // namespace
+
+ProbeGrid layoutProbeGrid(const Scene& scene, float spacing) {
+    glm::vec3 low(1e30f), high(-1e30f);
+    for (size_t i = 0; i < scene.objects.size(); ++i) {
+        if (scene.objects[i].dynamic)
+            continue;
+        glm::vec3 extent = meshHalfExtents(scene.objects[i].mesh);
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 local((corner & 1) ? extent.x : -extent.x, (corner & 2) ? extent.y : -extent.y,
+                            (corner & 4) ? extent.z : -extent.z);
+            glm::vec3 world(scene.modelMatrices[i] * glm::vec4(local, 1.0f));
+            low = glm::min(low, world);
+            high = glm::max(high, world);
+        }
+    }
+
+    ProbeGrid grid;
+    glm::vec3 size = high - low;
+    grid.counts = glm::max(glm::ivec3(glm::ceil(size / spacing)), glm::ivec3(1));
+    grid.spacing = size / glm::vec3(grid.counts);
+    grid.origin = low + grid.spacing * 0.5f;
+    return grid;
+}
+
+void shBasis(const glm::vec3& d, float basis[PROBE_SH_COEFFICIENTS]) {
+    basis[0] = 0.282095f;
+    basis[1] = 0.488603f * d.y;
+    basis[2] = 0.488603f * d.z;
+    basis[3] = 0.488603f * d.x;
+    basis[4] = 1.092548f * d.x * d.y;
+    basis[5] = 1.092548f * d.y * d.z;
+    basis[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+    basis[7] = 1.092548f * d.x * d.z;
+    basis[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+bool writeProbeVolume(const char* path, const ProbeVolume& volume) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to write probes: " << path << std::endl;
+        return false;
+    }
+    ProbeHeader header = {};
+    std::memcpy(header.magic, PROBE_MAGIC, 4);
+    header.version = PROBE_VERSION;
+    for (int axis = 0; axis < 3; ++axis) {
+        header.counts[axis] = volume.grid.counts[axis];
+        header.origin[axis] = volume.grid.origin[axis];
+        header.spacing[axis] = volume.grid.spacing[axis];
+    }
+    header.sceneHash = volume.sceneHash;
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)volume.coefficients.data(), volume.coefficients.size() * sizeof(uint16_t));
+    return (bool)file;
+}
+
+bool readProbeVolume(const char* path, ProbeVolume& volume) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    ProbeHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, PROBE_MAGIC, 4) != 0 ||
+        header.version != PROBE_VERSION) {
+        std::cout << "Not a probe volume: " << path << std::endl;
+        return false;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        volume.grid.counts[axis] = header.counts[axis];
+        volume.grid.origin[axis] = header.origin[axis];
+        volume.grid.spacing[axis] = header.spacing[axis];
+    }
+    volume.sceneHash = header.sceneHash;
+    size_t probes = (size_t)header.counts[0] * header.counts[1] * header.counts[2];
+    volume.coefficients.resize(probes * PROBE_SH_COEFFICIENTS * 3);
+    file.read((char*)volume.coefficients.data(), volume.coefficients.size() * sizeof(uint16_t));
+    if (!file) {
+        std::cout << "Truncated probe volume: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::vector<uint16_t> probeTextureTexels(const ProbeVolume& volume) {
+    const int FLOATS = PROBE_SH_COEFFICIENTS * 3;
+    size_t probes = (size_t)volume.grid.counts.x * volume.grid.counts.y * volume.grid.counts.z;
+    std::vector<uint16_t> texels(probes * PROBE_TEXTURE_SLABS * 4, 0);
+    for (size_t probe = 0; probe < probes; ++probe) {
+        const uint16_t* source = &volume.coefficients[probe * FLOATS];
+        for (int i = 0; i < FLOATS; ++i)
+            texels[((i / 4) * probes + probe) * 4 + i % 4] = source[i];
+    }
+    return texels;
+}
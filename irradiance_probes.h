@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "scene.h"
+
+// Baked by Lightmap Baker next to the lightmap, loaded by the gallery when it
+// matches the scene
+const char* const PROBE_PATH = "lightmaps/gallery.agip";
+
+// World units between probes when the baker is not told otherwise
+const float PROBE_DEFAULT_SPACING = 1.0f;
+
+// Second order spherical harmonics: 1 + 3 + 5 coefficients per colour channel
+const int PROBE_SH_COEFFICIENTS = 9;
+
+// RGBA texels a probe takes in the 3D texture, one slab of the grid each
+const int PROBE_TEXTURE_SLABS = 7;
+
+// Probes at the centres of the cells of a box around the static geometry.
+// The cells tile the box exactly, so spacing differs a little per axis.
+struct ProbeGrid {
+    glm::vec3 origin;  // Position of probe (0, 0, 0)
+    glm::vec3 spacing;
+    glm::ivec3 counts;
+};
+
+ProbeGrid layoutProbeGrid(const Scene& scene, float spacing);
+
+// The nine real SH basis functions in direction, which must be unit length
+void shBasis(const glm::vec3& direction, float basis[PROBE_SH_COEFFICIENTS]);
+
+// On disk: ProbeHeader, then for each probe, x fastest, its nine coefficients
+// as RGB half floats. They are already convolved with the cosine lobe and
+// divided by pi: summed against shBasis(normal) they give the light a surface
+// facing normal receives, in the units of the shader's light loop.
+struct ProbeHeader {
+    char magic[4]; // "AGIP"
+    uint32_t version;
+    int32_t counts[3];
+    float origin[3];
+    float spacing[3];
+    uint32_t reserved;
+    uint64_t sceneHash; // lightmapSceneHash of the scene baked
+};
+
+struct ProbeVolume {
+    ProbeGrid grid;
+    uint64_t sceneHash = 0;
+    std::vector<uint16_t> coefficients; // 27 per probe
+};
+
+bool writeProbeVolume(const char* path, const ProbeVolume& volume);
+bool readProbeVolume(const char* path, ProbeVolume& volume);
+
+// Coefficients rearranged for a GL_RGBA16F 3D texture counts.x by counts.y by
+// counts.z * PROBE_TEXTURE_SLABS: slab s holds coefficients 4s to 4s + 3 of
+// the flattened RGB list, so filtering never mixes two coefficients
+std::vector<uint16_t> probeTextureTexels(const ProbeVolume& volume);
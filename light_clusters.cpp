@@ -0,0 +1,253 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Squared distance from value to the interval [low, high]
+float squaredGap(float value, float low, float high) {
+    float gap = value < low ? low - value : value > high ? value - high : 0.0f;
+    return gap * gap;
+}
+
+// Cluster AABBs are separable: a slice's depth range times a column's x range
+// and a row's y range over that depth, so each light needs only one distance
+// per slice, column and row
+void binSlice(LightClusterBuilder& builder, int sliceIndex) {
+    float nearDepth = builder.sliceDepths[sliceIndex];
+    float farDepth = builder.sliceDepths[sliceIndex + 1];
+
+    float columnMin[LIGHT_CLUSTERS_X], columnMax[LIGHT_CLUSTERS_X];
+    for (int x = 0; x < LIGHT_CLUSTERS_X; ++x) {
+        float left = builder.tileSlopesX[x], right = builder.tileSlopesX[x + 1];
+        columnMin[x] = std::min(left * nearDepth, left * farDepth);
+        columnMax[x] = std::max(right * nearDepth, right * farDepth);
+    }
+    float rowMin[LIGHT_CLUSTERS_Y], rowMax[LIGHT_CLUSTERS_Y];
+    for (int y = 0; y < LIGHT_CLUSTERS_Y; ++y) {
+        float bottom = builder.tileSlopesY[y], top = builder.tileSlopesY[y + 1];
+        rowMin[y] = std::min(bottom * nearDepth, bottom * farDepth);
+        rowMax[y] = std::max(top * nearDepth, top * farDepth);
+    }
+
+    LightClusterSlice& slice = builder.slices[sliceIndex];
+    slice.pairs.clear();
+    slice.counts.assign(LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y, 0);
+    float rowGaps[LIGHT_CLUSTERS_Y];
+    for (size_t light = 0; light < builder.viewBounds.size(); ++light) {
+        const glm::vec4& bounds = builder.viewBounds[light];
+        float depth = -bounds.z;
+        if (depth + bounds.w < nearDepth || depth - bounds.w > farDepth)
+            continue;
+        float remaining = bounds.w * bounds.w - squaredGap(depth, nearDepth, farDepth);
+        for (int y = 0; y < LIGHT_CLUSTERS_Y; ++y)
+            rowGaps[y] = squaredGap(bounds.y, rowMin[y], rowMax[y]);
+        for (int x = 0; x < LIGHT_CLUSTERS_X; ++x) {
+            float columnGap = squaredGap(bounds.x, columnMin[x], columnMax[x]);
+            if (columnGap > remaining)
+                continue;
+            for (int y = 0; y < LIGHT_CLUSTERS_Y; ++y) {
+                if (columnGap + rowGaps[y] <= remaining) {
+                    uint32_t cluster = (uint32_t)(y * LIGHT_CLUSTERS_X + x);
+                    slice.pairs.push_back(cluster << 16 | (uint32_t)light);
+                    ++slice.counts[cluster];
+                }
+            }
+        }
+    }
+
+    // Counting sort by cluster; pairs were made in light order, which it keeps
+    std::vector<uint32_t> offsets(slice.counts.size());
+    uint32_t offset = 0;
+    for (size_t cluster = 0; cluster < slice.counts.size(); ++cluster) {
+        offsets[cluster] = offset;
+        offset += slice.counts[cluster];
+    }
+    slice.indices.resize(slice.pairs.size());
+    for (uint32_t pair : slice.pairs)
+        slice.indices[offsets[pair >> 16]++] = (uint16_t)(pair & 0xffff);
+}
+
+void binSlices(LightClusterBuilder& builder) {
+    int slice;
+    while ((slice = builder.nextSlice++) < LIGHT_CLUSTERS_Z)
+        binSlice(builder, slice);
+}
+
+void clusterWorker(LightClusterBuilder* builder) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(builder->mutex);
+            builder->workAvailable.wait(lock, [&] { return builder->stopping || builder->generation != seen; });
+            if (builder->stopping)
+                return;
+            seen = builder->generation;
+        }
+        binSlices(*builder);
+        {
+            std::lock_guard<std::mutex> lock(builder->mutex);
+            if (--builder->busyWorkers == 0)
+                builder->sliceFinished.notify_one();
+        }
+    }
+}
+
+GLuint createBufferTexture(GLuint& buffer, GLenum format) {
+    GLuint texture;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return texture;
+}
+
+// Orphans the previous storage, so frames still reading it are not waited on
+void uploadBuffer(GLuint buffer, const void* data, size_t bytes) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, (size_t)16), NULL, GL_STREAM_DRAW);
+    if (bytes)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+} // namespace
+
+LightClusterBuilder* createLightClusterBuilder(int threadCount) {
+    LightClusterBuilder* builder = new LightClusterBuilder();
+    builder->nextSlice = LIGHT_CLUSTERS_Z;
+    if (threadCount <= 0)
+        threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+    for (int i = 1; i < threadCount; ++i)
+        builder->workers.emplace_back(clusterWorker, builder);
+    return builder;
+}
+
+void destroyLightClusterBuilder(LightClusterBuilder* builder) {
+    {
+        std::lock_guard<std::mutex> lock(builder->mutex);
+        builder->stopping = true;
+    }
+    builder->workAvailable.notify_all();
+    for (std::thread& worker : builder->workers)
+        worker.join();
+    delete builder;
+}
+
+int lightClusterThreads(const LightClusterBuilder& builder) {
+    return (int)builder.workers.size() + 1;
+}
+
+void buildLightClusters(LightClusterBuilder& builder, const std::vector<PointLight>& lights,
+                        const ClusterFrustum& frustum) {
+    Clock::time_point start = Clock::now();
+
+    size_t lightCount = std::min(lights.size(), (size_t)MAX_CLUSTERED_LIGHTS);
+    builder.viewBounds.resize(lightCount);
+    for (size_t i = 0; i < lightCount; ++i) {
+        glm::vec4 bounds = lightBounds(lights[i]);
+        builder.viewBounds[i] = glm::vec4(glm::vec3(frustum.view * glm::vec4(glm::vec3(bounds), 1.0f)), bounds.w);
+    }
+
+    float depthRatio = frustum.farPlane / frustum.nearPlane;
+    for (int z = 0; z <= LIGHT_CLUSTERS_Z; ++z)
+        builder.sliceDepths[z] = frustum.nearPlane * std::pow(depthRatio, (float)z / LIGHT_CLUSTERS_Z);
+    float halfHeight = std::tan(frustum.fovY * 0.5f);
+    float halfWidth = halfHeight * frustum.aspect;
+    for (int x = 0; x <= LIGHT_CLUSTERS_X; ++x)
+        builder.tileSlopesX[x] = (2.0f * x / LIGHT_CLUSTERS_X - 1.0f) * halfWidth;
+    for (int y = 0; y <= LIGHT_CLUSTERS_Y; ++y)
+        builder.tileSlopesY[y] = (2.0f * y / LIGHT_CLUSTERS_Y - 1.0f) * halfHeight;
+
+    // Workers and this thread take slices until none are left
+    {
+        std::lock_guard<std::mutex> lock(builder.mutex);
+        builder.nextSlice = 0;
+        builder.busyWorkers = (int)builder.workers.size();
+        ++builder.generation;
+    }
+    builder.workAvailable.notify_all();
+    binSlices(builder);
+    {
+        std::unique_lock<std::mutex> lock(builder.mutex);
+        builder.sliceFinished.wait(lock, [&] { return builder.busyWorkers == 0; });
+    }
+
+    // Cluster x + X * (y + Y * z), the order the shader indexes them in
+    builder.clusterRanges.resize(LIGHT_CLUSTER_COUNT * 2);
+    builder.lightIndices.clear();
+    builder.maxClusterLights = 0;
+    const int SLICE_CLUSTERS = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y;
+    for (int z = 0; z < LIGHT_CLUSTERS_Z; ++z) {
+        const LightClusterSlice& slice = builder.slices[z];
+        uint32_t offset = (uint32_t)builder.lightIndices.size();
+        for (int cluster = 0; cluster < SLICE_CLUSTERS; ++cluster) {
+            uint32_t count = slice.counts[cluster];
+            builder.clusterRanges[(z * SLICE_CLUSTERS + cluster) * 2] = offset;
+            builder.clusterRanges[(z * SLICE_CLUSTERS + cluster) * 2 + 1] = count;
+            builder.maxClusterLights = std::max(builder.maxClusterLights, (int)count);
+            offset += count;
+        }
+        builder.lightIndices.insert(builder.lightIndices.end(), slice.indices.begin(), slice.indices.end());
+    }
+
+    builder.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+glm::vec4 lightClusterScale(const ClusterFrustum& frustum, int width, int height) {
+    float slicesPerLog = LIGHT_CLUSTERS_Z / std::log(frustum.farPlane / frustum.nearPlane);
+    return glm::vec4((float)LIGHT_CLUSTERS_X / width, (float)LIGHT_CLUSTERS_Y / height, slicesPerLog,
+                     -std::log(frustum.nearPlane) * slicesPerLog);
+}
+
+LightClusterBuffers createLightClusterBuffers() {
+    LightClusterBuffers buffers;
+    buffers.lightTexture = createBufferTexture(buffers.lightBuffer, GL_RGBA32F);
+    buffers.rangeTexture = createBufferTexture(buffers.rangeBuffer, GL_RG32UI);
+    buffers.indexTexture = createBufferTexture(buffers.indexBuffer, GL_R16UI);
+    return buffers;
+}
+
+void destroyLightClusterBuffers(LightClusterBuffers& buffers) {
+    GLuint textures[] = { buffers.lightTexture, buffers.rangeTexture, buffers.indexTexture };
+    GLuint bufferNames[] = { buffers.lightBuffer, buffers.rangeBuffer, buffers.indexBuffer };
+    glDeleteTextures(3, textures);
+    glDeleteBuffers(3, bufferNames);
+}
+
+void uploadClusterLights(LightClusterBuffers& buffers, const std::vector<PointLight>& lights) {
+    size_t lightCount = std::min(lights.size(), (size_t)MAX_CLUSTERED_LIGHTS);
+    std::vector<glm::vec4> texels(lightCount * 2);
+    for (size_t i = 0; i < lightCount; ++i) {
+        texels[i * 2] = glm::vec4(lights[i].position, lights[i].range);
+        texels[i * 2 + 1] = glm::vec4(lights[i].color, lights[i].intensity);
+    }
+    uploadBuffer(buffers.lightBuffer, texels.data(), texels.size() * sizeof(glm::vec4));
+}
+
+void uploadLightClusters(LightClusterBuffers& buffers, const LightClusterBuilder& builder) {
+    uploadLightLists(buffers, builder.clusterRanges, builder.lightIndices);
+}
+
+void uploadLightLists(LightClusterBuffers& buffers, const std::vector<uint32_t>& ranges,
+                      const std::vector<uint16_t>& indices) {
+    uploadBuffer(buffers.rangeBuffer, ranges.data(), ranges.size() * sizeof(uint32_t));
+    uploadBuffer(buffers.indexBuffer, indices.data(), indices.size() * sizeof(uint16_t));
+}
+
+void bindLightClusterBuffers(const LightClusterBuffers& buffers, int firstUnit) {
+    GLuint textures[] = { buffers.lightTexture, buffers.rangeTexture, buffers.indexTexture };
+    for (int i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "scene.h"
+
+// The view frustum is split into tiles across the screen and slices in depth.
+// Slices grow exponentially, so clusters stay roughly as deep as they are wide.
+const int LIGHT_CLUSTERS_X = 16;
+const int LIGHT_CLUSTERS_Y = 9;
+const int LIGHT_CLUSTERS_Z = 24;
+const int LIGHT_CLUSTER_COUNT = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+
+// Cluster light lists hold 16-bit indices
+const int MAX_CLUSTERED_LIGHTS = 65535;
+
+// The camera clusters are built for
+struct ClusterFrustum {
+    glm::mat4 view;
+    float fovY; // Radians
+    float aspect;
+    float nearPlane;
+    float farPlane;
+};
+
+// Lights binned into one depth slice, sorted by cluster
+struct LightClusterSlice {
+    std::vector<uint32_t> pairs;   // Cluster within the slice << 16 | light
+    std::vector<uint32_t> counts;  // Lights per cluster within the slice
+    std::vector<uint16_t> indices; // Light indices, cluster by cluster
+};
+
+// Bins lights into clusters on the CPU. Depth slices are shared out among a
+// pool of worker threads and the calling thread. Each slice tests every light's
+// bounding sphere against its clusters, and then the lists are joined.
+struct LightClusterBuilder {
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable sliceFinished;
+    uint64_t generation = 0; // Bumped once per build
+    int busyWorkers = 0;
+    bool stopping = false;
+    std::atomic<int> nextSlice;
+
+    // Inputs of the build in progress
+    std::vector<glm::vec4> viewBounds;           // View space center and radius of each light
+    float sliceDepths[LIGHT_CLUSTERS_Z + 1];     // Slice boundaries, positive view depth
+    float tileSlopesX[LIGHT_CLUSTERS_X + 1];     // x over depth at each tile boundary
+    float tileSlopesY[LIGHT_CLUSTERS_Y + 1];     // y over depth at each tile boundary
+    LightClusterSlice slices[LIGHT_CLUSTERS_Z];
+
+    // Results of the last build
+    std::vector<uint32_t> clusterRanges; // Offset and count in lightIndices of each cluster
+    std::vector<uint16_t> lightIndices;
+    int maxClusterLights = 0;
+    double milliseconds = 0.0;
+};
+
+// threadCount counts the calling thread; 0 uses every core
+LightClusterBuilder* createLightClusterBuilder(int threadCount = 0);
+void destroyLightClusterBuilder(LightClusterBuilder* builder);
+int lightClusterThreads(const LightClusterBuilder& builder);
+
+// Bins lights into the clusters their bounding spheres overlap. Each cluster's
+// list keeps the lights in scene order. Lights past MAX_CLUSTERED_LIGHTS are
+// ignored.
+void buildLightClusters(LightClusterBuilder& builder, const std::vector<PointLight>& lights,
+                        const ClusterFrustum& frustum);
+
+// Scale and bias that map gl_FragCoord and view depth to cluster coordinates.
+// This is the shader's clusterScale.
+glm::vec4 lightClusterScale(const ClusterFrustum& frustum, int width, int height);
+
+// Buffer textures the clustered shader variant reads: two RGBA32F texels per
+// light, an RG32UI offset and count per cluster, and the R16UI index lists
+struct LightClusterBuffers {
+    unsigned int lightBuffer;
+    unsigned int lightTexture;
+    unsigned int rangeBuffer;
+    unsigned int rangeTexture;
+    unsigned int indexBuffer;
+    unsigned int indexTexture;
+};
+
+LightClusterBuffers createLightClusterBuffers();
+void destroyLightClusterBuffers(LightClusterBuffers& buffers);
+
+// Light positions, ranges, colours and intensities, whenever the lights change
+void uploadClusterLights(LightClusterBuffers& buffers, const std::vector<PointLight>& lights);
+
+// This frame's lists, into freshly orphaned storage
+void uploadLightClusters(LightClusterBuffers& buffers, const LightClusterBuilder& builder);
+
+// Any other lists in the same layout, such as screen tiles
+void uploadLightLists(LightClusterBuffers& buffers, const std::vector<uint32_t>& ranges,
+                      const std::vector<uint16_t>& indices);
+
+// Lights, ranges and indices on three consecutive units from firstUnit
+void bindLightClusterBuffers(const LightClusterBuffers& buffers, int firstUnit);
@@ -0,0 +1,183 @@
+#include "lightmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const char LIGHTMAP_MAGIC[4] = { 'A', 'G', 'L', 'M' };
+const uint32_t LIGHTMAP_VERSION = 1;
+
+// Cells across and up a mesh's chart
+glm::ivec2 chartCells(MeshId mesh) {
+    return mesh == MeshId::Box ? glm::ivec2(3, 2) : glm::ivec2(1, 1);
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+} // namespace
+
+int lightmapFaceCount(MeshId mesh) {
+    return mesh == MeshId::Box ? 6 : 1;
+}
+
+// Box faces go -x, +x, -y, +y, -z, +z; the quad faces +z
+LightmapFace lightmapFace(MeshId mesh, int face) {
+    if (mesh != MeshId::Box)
+        return { 2, 1.0f };
+    return { face / 2, face % 2 ? 1.0f : -1.0f };
+}
+
+glm::ivec2 lightmapFaceCell(MeshId mesh, int face) {
+    glm::ivec2 cells = chartCells(mesh);
+    return glm::ivec2(face % cells.x, face / cells.x);
+}
+
+glm::vec3 lightmapFacePoint(MeshId mesh, int face, glm::vec2 uv) {
+    LightmapFace f = lightmapFace(mesh, face);
+    glm::vec3 point(0.0f);
+    point[f.axis] = mesh == MeshId::Box ? f.sign * 0.5f : 0.0f;
+    point[(f.axis + 1) % 3] = uv.x - 0.5f;
+    point[(f.axis + 2) % 3] = uv.y - 0.5f;
+    return point;
+}
+
+std::vector<glm::vec4> lightmapChartCoords(MeshId mesh, const float* vertices, int vertexCount, int stride) {
+    std::vector<glm::vec4> coords(vertexCount);
+    for (int first = 0; first + 2 < vertexCount; first += 3) {
+        glm::vec3 corners[3];
+        for (int i = 0; i < 3; ++i)
+            corners[i] = glm::vec3(vertices[(first + i) * stride], vertices[(first + i) * stride + 1],
+                                   vertices[(first + i) * stride + 2]);
+
+        // The face is the axis the triangle's normal mostly points along, on
+        // the side the triangle lies. The winding is not relied on.
+        glm::vec3 size = glm::abs(glm::cross(corners[1] - corners[0], corners[2] - corners[0]));
+        int axis = size.x > size.y && size.x > size.z ? 0 : size.y > size.z ? 1 : 2;
+        float side = corners[0][axis] + corners[1][axis] + corners[2][axis];
+        int face = mesh == MeshId::Box ? axis * 2 + (side > 0.0f ? 1 : 0) : 0;
+        glm::vec2 cell(lightmapFaceCell(mesh, face));
+        for (int i = 0; i < 3; ++i) {
+            glm::vec3 p = corners[i];
+            coords[first + i] = glm::vec4(cell, p[(axis + 1) % 3] + 0.5f, p[(axis + 2) % 3] + 0.5f);
+        }
+    }
+    return coords;
+}
+
+std::vector<LightmapChart> layoutLightmap(const Scene& scene, float density, int& width, int& height) {
+    std::vector<LightmapChart> charts(scene.objects.size(), LightmapChart{ 0, 0, 0 });
+    std::vector<int> order;
+    int area = 0, widest = 0;
+    for (size_t i = 0; i < scene.objects.size(); ++i) {
+        const SceneObject& object = scene.objects[i];
+        if (object.dynamic)
+            continue;
+
+        // Square cells as wide as the object's largest face, so no face gets fewer texels per unit
+        const glm::mat4& model = scene.modelMatrices[i];
+        glm::vec3 scale(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])),
+                        glm::length(glm::vec3(model[2])));
+        float size = object.mesh == MeshId::Box ? std::max(scale.x, std::max(scale.y, scale.z))
+                                                : std::max(scale.x, scale.y);
+        charts[i].cellSize = std::max(4, (int)std::ceil(size * density)) + 2 * LIGHTMAP_PADDING;
+        glm::ivec2 cells = chartCells(object.mesh);
+        area += cells.x * cells.y * charts[i].cellSize * charts[i].cellSize;
+        widest = std::max(widest, cells.x * charts[i].cellSize);
+        order.push_back((int)i);
+    }
+
+    // Shelves of charts, tallest first, in a power of two wide atlas about as tall as it is wide
+    width = 64;
+    while (width * width < area || width < widest)
+        width *= 2;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return chartCells(scene.objects[a].mesh).y * charts[a].cellSize >
+               chartCells(scene.objects[b].mesh).y * charts[b].cellSize;
+    });
+    int x = 0, y = 0, shelfHeight = 0;
+    for (int i : order) {
+        glm::ivec2 size = chartCells(scene.objects[i].mesh) * charts[i].cellSize;
+        if (x + size.x > width) {
+            x = 0;
+            y += shelfHeight;
+            shelfHeight = 0;
+        }
+        charts[i].x = x;
+        charts[i].y = y;
+        x += size.x;
+        shelfHeight = std::max(shelfHeight, size.y);
+    }
+    height = (y + shelfHeight + 3) & ~3;
+    return charts;
+}
+
+uint64_t lightmapSceneHash(const Scene& scene) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < scene.objects.size(); ++i) {
+        const SceneObject& object = scene.objects[i];
+        uint32_t desc[2] = { (uint32_t)object.mesh, object.dynamic ? 1u : 0u };
+        hash = hashBytes(desc, sizeof(desc), hash);
+        if (!object.dynamic)
+            hash = hashBytes(&scene.modelMatrices[i], sizeof(glm::mat4), hash);
+    }
+    for (const PointLight& light : scene.lights) {
+        float values[8] = { light.position.x, light.position.y, light.position.z, light.color.r,
+                            light.color.g,    light.color.b,    light.intensity,  light.range };
+        hash = hashBytes(values, sizeof(values), hash);
+    }
+    return hash;
+}
+
+bool writeLightmap(const char* path, const Lightmap& lightmap) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to write lightmap: " << path << std::endl;
+        return false;
+    }
+    LightmapHeader header = {};
+    std::memcpy(header.magic, LIGHTMAP_MAGIC, 4);
+    header.version = LIGHTMAP_VERSION;
+    header.width = (uint32_t)lightmap.width;
+    header.height = (uint32_t)lightmap.height;
+    header.chartCount = (uint32_t)lightmap.charts.size();
+    header.sceneHash = lightmap.sceneHash;
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)lightmap.charts.data(), lightmap.charts.size() * sizeof(LightmapChart));
+    file.write((const char*)lightmap.texels.data(), lightmap.texels.size() * sizeof(uint16_t));
+    return (bool)file;
+}
+
+bool readLightmap(const char* path, Lightmap& lightmap) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    LightmapHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, LIGHTMAP_MAGIC, 4) != 0 ||
+        header.version != LIGHTMAP_VERSION) {
+        std::cout << "Not a lightmap: " << path << std::endl;
+        return false;
+    }
+    lightmap.width = (int)header.width;
+    lightmap.height = (int)header.height;
+    lightmap.sceneHash = header.sceneHash;
+    lightmap.charts.resize(header.chartCount);
+    lightmap.texels.resize((size_t)header.width * header.height * 3);
+    file.read((char*)lightmap.charts.data(), lightmap.charts.size() * sizeof(LightmapChart));
+    file.read((char*)lightmap.texels.data(), lightmap.texels.size() * sizeof(uint16_t));
+    if (!file) {
+        std::cout << "Truncated lightmap: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
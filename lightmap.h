@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "scene.h"
+
+// Baked by Lightmap Baker, loaded by the gallery when it matches the scene
+const char* const LIGHTMAP_DIRECTORY = "lightmaps";
+const char* const LIGHTMAP_PATH = "lightmaps/gallery.aglm";
+
+// Texels around every chart cell repeating its edge, so bilinear filtering
+// never reads a neighbouring cell
+const int LIGHTMAP_PADDING = 2;
+
+// Texels per world unit when the baker is not told otherwise
+const float LIGHTMAP_DEFAULT_DENSITY = 8.0f;
+
+// Each static object gets its own chart: one square cell per face, a box's
+// six in a 3x2 grid, a quad's one. A face's texels cover it along the two
+// axes it is not facing, so any point on it maps to its cell without UVs.
+struct LightmapChart {
+    int32_t x; // Bottom-left corner, in texels
+    int32_t y;
+    int32_t cellSize; // Texels per cell side, padding included, 0 for objects without a chart
+};
+
+// A face of a mesh: the local axis it faces along and which way
+struct LightmapFace {
+    int axis;
+    float sign;
+};
+
+int lightmapFaceCount(MeshId mesh);
+LightmapFace lightmapFace(MeshId mesh, int face);
+
+// Cell of a face within its chart, in cells
+glm::ivec2 lightmapFaceCell(MeshId mesh, int face);
+
+// Local position of a point on a face, uv in [0, 1] across it
+glm::vec3 lightmapFacePoint(MeshId mesh, int face, glm::vec2 uv);
+
+// Per vertex of a triangle list with positions first in every stride floats:
+// the cell of the face the triangle lies on and the vertex's place in it
+std::vector<glm::vec4> lightmapChartCoords(MeshId mesh, const float* vertices, int vertexCount, int stride);
+
+// Charts of every static object packed into one atlas, density texels per unit
+std::vector<LightmapChart> layoutLightmap(const Scene& scene, float density, int& width, int& height);
+
+// Changes whenever a static object or a light moves, so a stale lightmap is
+// never shown
+uint64_t lightmapSceneHash(const Scene& scene);
+
+// On disk: LightmapHeader, chartCount LightmapChart records, then width *
+// height RGB half float texels, bottom row first. Texels hold the irradiance
+// the shader's light loop would have summed, direct and indirect.
+struct LightmapHeader {
+    char magic[4]; // "AGLM"
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t chartCount; // One per scene object
+    uint32_t reserved;
+    uint64_t sceneHash;
+};
+
+struct Lightmap {
+    int width = 0;
+    int height = 0;
+    uint64_t sceneHash = 0;
+    std::vector<LightmapChart> charts;
+    std::vector<uint16_t> texels;
+};
+
+bool writeLightmap(const char* path, const Lightmap& lightmap);
+bool readLightmap(const char* path, Lightmap& lightmap);
@@ -0,0 +1,614 @@
+// Lightmap Baker: path traces the gallery's static lighting, direct and
+// bounced, into the lightmap the gallery samples instead of looping over its
+// lights, then the light bounced through the rooms into a grid of irradiance
+// probes for its ambient term. Built as its own project, it needs no GL context.
+//
+//     LightmapBaker [--density <texels per unit>] [--samples N] [--bounces N] [--denoise N]
+//                   [--indirect <scale>] [--lights N] [--threads N] [--output path]
+//                   [--probe-spacing <units>] [--probe-rays N] [--probe-output path]
+//
+// Texels and probes are shared out among all cores; rays are traced four at
+// a time through a BVH of the static geometry.
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bvh.h"
+#include "irradiance_probes.h"
+#include "lightmap.h"
+#include "scene.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::high_resolution_clock;
+
+const float PI = 3.14159265358979f;
+
+// Rays start this far off the surface they leave
+const float SURFACE_OFFSET = 1e-3f;
+const float MAX_RAY_DISTANCE = 1000.0f;
+
+// Paths are cut at random past this many bounces, weighted to stay unbiased
+const int ROULETTE_BOUNCES = 2;
+
+// Texels or probes a worker takes at a time
+const int WORK_CHUNK = 64;
+
+struct BakeSettings {
+    float density = LIGHTMAP_DEFAULT_DENSITY;
+    int samples = 64;
+    int bounces = 3;
+    int denoisePasses = 3;
+    float indirectScale = 0.15f; // The lights have no falloff, bounces at full strength wash the rooms out
+    int lightCount = 0;          // As the gallery's --lights, for a lightmap matching its benchmarks
+    int threads = 0;
+    std::string output = LIGHTMAP_PATH;
+    float probeSpacing = PROBE_DEFAULT_SPACING;
+    int probeRays = 256;
+    std::string probeOutput = PROBE_PATH;
+};
+
+// A point on a face of a static object, world space
+struct BakeTexel {
+    int index; // Into the atlas
+    int cell;  // Object * 8 + face, filtering stays within it
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+struct BakeScene {
+    const Scene* scene;
+    Bvh bvh;                      // Triangle ids are object * 8 + face
+    std::vector<glm::vec3> albedo; // Mean colour of each object's texture
+    std::vector<glm::vec3> faceNormals; // World normal by triangle id
+};
+
+// Small, fast and seeded per texel, so results do not depend on which thread baked what
+struct Random {
+    uint32_t state;
+
+    float next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) / 16777216.0f;
+    }
+};
+
+// What the gallery shader's light loop adds up at a point: the same terms,
+// with nothing in the way of any light
+glm::vec3 directLight(const std::vector<PointLight>& lights, const glm::vec3& position) {
+    glm::vec3 sum(0.0f);
+    glm::vec3 view = glm::normalize(position);
+    for (const PointLight& light : lights) {
+        glm::vec3 toLight = light.position - position;
+        float diff = std::max(glm::dot(view, glm::normalize(toLight)), 0.0f);
+        glm::vec3 diffuse = light.color * diff * light.intensity;
+        if (light.range > 0.0f) {
+            float x = glm::length(toLight) / light.range;
+            float fade = glm::clamp(1.0f - x * x * x * x, 0.0f, 1.0f);
+            diffuse *= fade * fade;
+        }
+        sum += diffuse;
+    }
+    return sum;
+}
+
+// Cosine weighted, so every sample counts the same toward irradiance
+glm::vec3 sampleHemisphere(const glm::vec3& normal, Random& random) {
+    float r = std::sqrt(random.next());
+    float phi = 2.0f * PI * random.next();
+    glm::vec3 tangent = glm::normalize(glm::cross(std::abs(normal.x) > 0.5f ? glm::vec3(0.0f, 1.0f, 0.0f)
+                                                                           : glm::vec3(1.0f, 0.0f, 0.0f),
+                                                  normal));
+    glm::vec3 bitangent = glm::cross(normal, tangent);
+    return glm::normalize(tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) +
+                          normal * std::sqrt(std::max(0.0f, 1.0f - r * r)));
+}
+
+glm::vec3 textureAlbedo(TextureId texture) {
+    int width, height, components;
+    unsigned char* pixels = stbi_load(textureSourcePath(texture), &width, &height, &components, 3);
+    if (!pixels) {
+        std::cout << "Failed to load texture: " << textureSourcePath(texture) << ", using grey" << std::endl;
+        return glm::vec3(0.5f);
+    }
+    glm::dvec3 sum(0.0);
+    for (int i = 0; i < width * height; ++i)
+        sum += glm::dvec3(pixels[i * 3], pixels[i * 3 + 1], pixels[i * 3 + 2]);
+    stbi_image_free(pixels);
+    return glm::vec3(sum / (255.0 * width * height));
+}
+
+glm::vec3 faceNormal(const Scene& scene, int object, int face) {
+    MeshId mesh = scene.objects[object].mesh;
+    LightmapFace f = lightmapFace(mesh, face);
+    glm::vec3 local(0.0f);
+    local[f.axis] = f.sign;
+    return glm::normalize(glm::inverseTranspose(glm::mat3(scene.modelMatrices[object])) * local);
+}
+
+// Two triangles per face of every static object. The spinning cube moves, so
+// it neither receives nor blocks baked light.
+BakeScene buildBakeScene(const Scene& scene) {
+    BakeScene bake;
+    bake.scene = &scene;
+    bake.faceNormals.resize(scene.objects.size() * 8);
+    std::vector<BvhTriangle> triangles;
+    glm::vec3 textureAlbedos[(int)TextureId::Count];
+    bool loaded[(int)TextureId::Count] = {};
+    for (size_t object = 0; object < scene.objects.size(); ++object) {
+        const SceneObject& desc = scene.objects[object];
+        int texture = (int)desc.texture;
+        bake.albedo.push_back(glm::vec3(0.0f));
+        if (desc.dynamic)
+            continue;
+        if (!loaded[texture]) {
+            textureAlbedos[texture] = textureAlbedo(desc.texture);
+            loaded[texture] = true;
+        }
+        bake.albedo[object] = textureAlbedos[texture];
+
+        const glm::mat4& model = scene.modelMatrices[object];
+        for (int face = 0; face < lightmapFaceCount(desc.mesh); ++face) {
+            glm::vec3 corners[4];
+            const glm::vec2 uvs[4] = { glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(1.0f, 1.0f),
+                                       glm::vec2(0.0f, 1.0f) };
+            for (int i = 0; i < 4; ++i)
+                corners[i] = glm::vec3(model * glm::vec4(lightmapFacePoint(desc.mesh, face, uvs[i]), 1.0f));
+            uint32_t id = (uint32_t)object * 8 + face;
+            triangles.push_back({ corners[0], corners[1] - corners[0], corners[2] - corners[0], id });
+            triangles.push_back({ corners[0], corners[2] - corners[0], corners[3] - corners[0], id });
+            bake.faceNormals[id] = faceNormal(scene, (int)object, face);
+        }
+    }
+    bake.bvh = buildBvh(std::move(triangles));
+    return bake;
+}
+
+// The centre of every texel of every chart cell. Padding texels clamp to the
+// face's edge, so they repeat it.
+std::vector<BakeTexel> chartTexels(const Scene& scene, const std::vector<LightmapChart>& charts, int width) {
+    std::vector<BakeTexel> texels;
+    for (size_t object = 0; object < scene.objects.size(); ++object) {
+        const LightmapChart& chart = charts[object];
+        if (chart.cellSize == 0)
+            continue;
+        MeshId mesh = scene.objects[object].mesh;
+        const glm::mat4& model = scene.modelMatrices[object];
+        float inner = (float)(chart.cellSize - 2 * LIGHTMAP_PADDING);
+        for (int face = 0; face < lightmapFaceCount(mesh); ++face) {
+            glm::ivec2 origin = glm::ivec2(chart.x, chart.y) + lightmapFaceCell(mesh, face) * chart.cellSize;
+            glm::vec3 normal = faceNormal(scene, (int)object, face);
+            for (int y = 0; y < chart.cellSize; ++y) {
+                for (int x = 0; x < chart.cellSize; ++x) {
+                    glm::vec2 uv = (glm::vec2(x, y) + 0.5f - (float)LIGHTMAP_PADDING) / inner;
+                    uv = glm::clamp(uv, 0.0f, 1.0f);
+                    glm::vec3 position(model * glm::vec4(lightmapFacePoint(mesh, face, uv), 1.0f));
+                    texels.push_back({ (origin.y + y) * width + origin.x + x, (int)object * 8 + face, position,
+                                       normal });
+                }
+            }
+        }
+    }
+    return texels;
+}
+
+// Paths of a packet of rays, followed together bounce after bounce. Each
+// lane brings back the direct light at every surface it reaches, tinted by
+// every surface along the way. Lanes that start dead are not traced. blocked
+// marks lanes whose first ray left the gallery or met the inside of a box.
+void tracePaths(const BakeScene& bake, const BakeSettings& settings, glm::vec3* origins, glm::vec3* directions,
+                bool* alive, Random& random, uint64_t& rays, glm::vec3* radiance, bool* blocked) {
+    const std::vector<PointLight>& lights = bake.scene->lights;
+    glm::vec3 throughput[RAY_PACKET_SIZE];
+    for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+        throughput[lane] = glm::vec3(1.0f);
+        radiance[lane] = glm::vec3(0.0f);
+        blocked[lane] = false;
+    }
+
+    for (int bounce = 0; bounce < settings.bounces; ++bounce) {
+        RayPacket packet;
+        for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+            packet.originX[lane] = origins[lane].x;
+            packet.originY[lane] = origins[lane].y;
+            packet.originZ[lane] = origins[lane].z;
+            packet.directionX[lane] = directions[lane].x;
+            packet.directionY[lane] = directions[lane].y;
+            packet.directionZ[lane] = directions[lane].z;
+            packet.tMax[lane] = alive[lane] ? MAX_RAY_DISTANCE : 0.0f;
+            rays += alive[lane];
+        }
+        PacketHits hits;
+        tracePacket(bake.bvh, packet, hits);
+
+        bool any = false;
+        for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+            if (!alive[lane])
+                continue;
+            if (hits.triangle[lane] < 0) {
+                blocked[lane] = blocked[lane] || bounce == 0;
+                alive[lane] = false;
+                continue;
+            }
+            uint32_t id = bake.bvh.triangles[hits.triangle[lane]].id;
+            glm::vec3 hit = origins[lane] + directions[lane] * hits.t[lane];
+            glm::vec3 normal = bake.faceNormals[id];
+            if (glm::dot(normal, directions[lane]) > 0.0f) {
+                // Quads are seen from both sides, boxes only from outside
+                if (bounce == 0 && bake.scene->objects[id / 8].mesh == MeshId::Box)
+                    blocked[lane] = true;
+                normal = -normal;
+            }
+
+            glm::vec3 albedo = bake.albedo[id / 8];
+            throughput[lane] *= albedo;
+            radiance[lane] += throughput[lane] * directLight(lights, hit);
+
+            if (bounce + 1 >= ROULETTE_BOUNCES) {
+                float survive = std::min(0.95f, std::max(albedo.r, std::max(albedo.g, albedo.b)));
+                if (random.next() >= survive) {
+                    alive[lane] = false;
+                    continue;
+                }
+                throughput[lane] /= survive;
+            }
+            origins[lane] = hit + normal * SURFACE_OFFSET;
+            directions[lane] = sampleHemisphere(normal, random);
+            any = true;
+        }
+        if (!any)
+            break;
+    }
+}
+
+// Light arriving at a texel off other surfaces, averaged over settings.samples
+// paths
+glm::vec3 bounceLight(const BakeScene& bake, const BakeTexel& texel, const BakeSettings& settings, Random& random,
+                      uint64_t& rays) {
+    glm::vec3 sum(0.0f);
+    for (int first = 0; first < settings.samples; first += RAY_PACKET_SIZE) {
+        // First rays from a texel all start at the same point
+        glm::vec3 origins[RAY_PACKET_SIZE], directions[RAY_PACKET_SIZE], radiance[RAY_PACKET_SIZE];
+        bool alive[RAY_PACKET_SIZE], blocked[RAY_PACKET_SIZE];
+        for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+            alive[lane] = first + lane < settings.samples;
+            origins[lane] = texel.position + texel.normal * SURFACE_OFFSET;
+            directions[lane] = sampleHemisphere(texel.normal, random);
+        }
+        tracePaths(bake, settings, origins, directions, alive, random, rays, radiance, blocked);
+        for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane)
+            sum += radiance[lane];
+    }
+    return sum / (float)settings.samples;
+}
+
+// Light arriving at a probe from every direction, projected on the SH basis
+// and convolved with the cosine lobe. Returns false when too many rays leave
+// the gallery or meet a wall from inside: the probe is outside the rooms or
+// inside a wall.
+bool bakeProbe(const BakeScene& bake, const glm::vec3& position, const BakeSettings& settings, Random& random,
+               uint64_t& rays, glm::vec3 coefficients[PROBE_SH_COEFFICIENTS]) {
+    // Lambert's cosine lobe per band, over pi
+    const float BAND_WEIGHTS[PROBE_SH_COEFFICIENTS] = { 1.0f,        2.0f / 3.0f, 2.0f / 3.0f,
+                                                        2.0f / 3.0f, 0.25f,       0.25f,
+                                                        0.25f,       0.25f,       0.25f };
+    for (int i = 0; i < PROBE_SH_COEFFICIENTS; ++i)
+        coefficients[i] = glm::vec3(0.0f);
+    int blockedRays = 0;
+    for (int first = 0; first < settings.probeRays; first += RAY_PACKET_SIZE) {
+        glm::vec3 origins[RAY_PACKET_SIZE], directions[RAY_PACKET_SIZE], radiance[RAY_PACKET_SIZE];
+        bool alive[RAY_PACKET_SIZE], blocked[RAY_PACKET_SIZE];
+        for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane) {
+            alive[lane] = first + lane < settings.probeRays;
+            origins[lane] = position;
+            float z = 1.0f - 2.0f * random.next();
+            float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            float phi = 2.0f * PI * random.next();
+            directions[lane] = glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+        }
+        glm::vec3 firstDirections[RAY_PACKET_SIZE];
+        std::copy(directions, directions + RAY_PACKET_SIZE, firstDirections);
+        tracePaths(bake, settings, origins, directions, alive, random, rays, radiance, blocked);
+        for (int lane = 0; lane < RAY_PACKET_SIZE && first + lane < settings.probeRays; ++lane) {
+            float basis[PROBE_SH_COEFFICIENTS];
+            shBasis(firstDirections[lane], basis);
+            for (int i = 0; i < PROBE_SH_COEFFICIENTS; ++i)
+                coefficients[i] += radiance[lane] * basis[i];
+            blockedRays += blocked[lane];
+        }
+    }
+    float weight = 4.0f * PI / settings.probeRays * settings.indirectScale;
+    for (int i = 0; i < PROBE_SH_COEFFICIENTS; ++i)
+        coefficients[i] *= weight * BAND_WEIGHTS[i];
+    return blockedRays <= settings.probeRays / 10;
+}
+
+// Probes outside the rooms or inside walls take the mean of their valid
+// neighbours, ring after ring, so sampling near a wall never blends in their
+// wrong light
+int fillInvalidProbes(std::vector<glm::vec3>& coefficients, std::vector<uint8_t>& valid, const glm::ivec3& counts) {
+    int filled = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        std::vector<uint8_t> nextValid = valid;
+        for (int z = 0; z < counts.z; ++z) {
+            for (int y = 0; y < counts.y; ++y) {
+                for (int x = 0; x < counts.x; ++x) {
+                    int probe = (z * counts.y + y) * counts.x + x;
+                    if (valid[probe])
+                        continue;
+                    const glm::ivec3 NEIGHBOURS[6] = { glm::ivec3(-1, 0, 0), glm::ivec3(1, 0, 0),
+                                                       glm::ivec3(0, -1, 0), glm::ivec3(0, 1, 0),
+                                                       glm::ivec3(0, 0, -1), glm::ivec3(0, 0, 1) };
+                    glm::vec3 sum[PROBE_SH_COEFFICIENTS] = {};
+                    int count = 0;
+                    for (const glm::ivec3& offset : NEIGHBOURS) {
+                        glm::ivec3 n = glm::ivec3(x, y, z) + offset;
+                        if (glm::any(glm::lessThan(n, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(n, counts)))
+                            continue;
+                        int neighbour = (n.z * counts.y + n.y) * counts.x + n.x;
+                        if (!valid[neighbour])
+                            continue;
+                        for (int i = 0; i < PROBE_SH_COEFFICIENTS; ++i)
+                            sum[i] += coefficients[neighbour * PROBE_SH_COEFFICIENTS + i];
+                        ++count;
+                    }
+                    if (count == 0)
+                        continue;
+                    for (int i = 0; i < PROBE_SH_COEFFICIENTS; ++i)
+                        coefficients[probe * PROBE_SH_COEFFICIENTS + i] = sum[i] / (float)count;
+                    nextValid[probe] = 1;
+                    changed = true;
+                    ++filled;
+                }
+            }
+        }
+        valid.swap(nextValid);
+    }
+    return filled;
+}
+
+// Edge-avoiding a-trous wavelet filter: 5x5 B3 spline taps spread further
+// apart each pass, skipping texels of other cells, so noise is smoothed over a
+// wide area without bleeding across charts
+void denoise(std::vector<glm::vec3>& image, const std::vector<int>& cells, int width, int height, int passes) {
+    const float KERNEL[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+    std::vector<glm::vec3> filtered(image.size());
+    for (int pass = 0; pass < passes; ++pass) {
+        int step = 1 << pass;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                int center = y * width + x;
+                if (cells[center] < 0) {
+                    filtered[center] = image[center];
+                    continue;
+                }
+                glm::vec3 sum(0.0f);
+                float weights = 0.0f;
+                for (int j = -2; j <= 2; ++j) {
+                    int sy = y + j * step;
+                    if (sy < 0 || sy >= height)
+                        continue;
+                    for (int i = -2; i <= 2; ++i) {
+                        int sx = x + i * step;
+                        if (sx < 0 || sx >= width || cells[sy * width + sx] != cells[center])
+                            continue;
+                        float weight = KERNEL[i + 2] * KERNEL[j + 2];
+                        sum += image[sy * width + sx] * weight;
+                        weights += weight;
+                    }
+                }
+                filtered[center] = sum / weights;
+            }
+        }
+        image.swap(filtered);
+    }
+}
+
+// Calls work(i, rays) for every i below count, workers taking chunks until
+// none are left. Returns the rays all of them traced.
+template <typename Work>
+uint64_t runWorkers(size_t count, int threadCount, const Work& work) {
+    std::atomic<size_t> next(0);
+    std::atomic<uint64_t> totalRays(0);
+    auto worker = [&]() {
+        uint64_t rays = 0;
+        for (;;) {
+            size_t first = next.fetch_add(WORK_CHUNK);
+            if (first >= count)
+                break;
+            size_t last = std::min(count, first + WORK_CHUNK);
+            for (size_t i = first; i < last; ++i)
+                work(i, rays);
+        }
+        totalRays += rays;
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threadCount; ++i)
+        workers.emplace_back(worker);
+    worker();
+    for (std::thread& thread : workers)
+        thread.join();
+    return totalRays;
+}
+
+bool parseInt(const char* text, int& value) {
+    char* end;
+    long parsed = std::strtol(text, &end, 10);
+    if (*end != '\0')
+        return false;
+    value = (int)parsed;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BakeSettings settings;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--density") == 0 && hasValue) {
+            settings.density = (float)std::atof(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--samples") == 0 && hasValue && parseInt(argv[i + 1], settings.samples)) {
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--bounces") == 0 && hasValue && parseInt(argv[i + 1], settings.bounces)) {
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--denoise") == 0 && hasValue &&
+                 parseInt(argv[i + 1], settings.denoisePasses)) {
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--indirect") == 0 && hasValue) {
+            settings.indirectScale = (float)std::atof(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--lights") == 0 && hasValue && parseInt(argv[i + 1], settings.lightCount)) {
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && hasValue && parseInt(argv[i + 1], settings.threads)) {
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 && hasValue) {
+            settings.output = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--probe-spacing") == 0 && hasValue) {
+            settings.probeSpacing = (float)std::atof(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--probe-rays") == 0 && hasValue &&
+                 parseInt(argv[i + 1], settings.probeRays)) {
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--probe-output") == 0 && hasValue) {
+            settings.probeOutput = argv[++i];
+        }
+        else {
+            std::cout << "Unknown option: " << argv[i] << std::endl;
+            return -1;
+        }
+    }
+    if (settings.density <= 0.0f || settings.samples <= 0 || settings.bounces < 0 || settings.probeSpacing <= 0.0f ||
+        settings.probeRays <= 0) {
+        std::cout << "Density, samples, probe spacing and probe rays must be positive" << std::endl;
+        return -1;
+    }
+    int threadCount = settings.threads > 0 ? settings.threads : std::max(1, (int)std::thread::hardware_concurrency());
+
+    Clock::time_point start = Clock::now();
+    Scene scene = buildGalleryScene();
+    if (settings.lightCount > 0)
+        addScatteredLights(scene, settings.lightCount);
+    BakeScene bake = buildBakeScene(scene);
+
+    Lightmap lightmap;
+    lightmap.charts = layoutLightmap(scene, settings.density, lightmap.width, lightmap.height);
+    lightmap.sceneHash = lightmapSceneHash(scene);
+    std::vector<BakeTexel> texels = chartTexels(scene, lightmap.charts, lightmap.width);
+    std::cout << "Baking " << lightmap.width << "x" << lightmap.height << " lightmap, " << texels.size()
+              << " texels, " << bake.bvh.triangles.size() << " triangles in " << bake.bvh.nodes.size()
+              << " BVH nodes, " << settings.samples << " samples, " << settings.bounces << " bounces, "
+              << threadCount << " threads, " << bvhSimdName() << std::endl;
+
+    size_t atlasTexels = (size_t)lightmap.width * lightmap.height;
+    std::vector<glm::vec3> direct(atlasTexels, glm::vec3(0.0f));
+    std::vector<glm::vec3> indirect(atlasTexels, glm::vec3(0.0f));
+    std::vector<int> cells(atlasTexels, -1);
+
+    Clock::time_point traceStart = Clock::now();
+    uint64_t totalRays = runWorkers(texels.size(), threadCount, [&](size_t i, uint64_t& rays) {
+        const BakeTexel& texel = texels[i];
+        Random random = { (uint32_t)texel.index * 2654435761u + 1u };
+        direct[texel.index] = directLight(scene.lights, texel.position);
+        if (settings.bounces > 0)
+            indirect[texel.index] = bounceLight(bake, texel, settings, random, rays);
+        cells[texel.index] = texel.cell;
+    });
+    double traceSeconds = std::chrono::duration<double>(Clock::now() - traceStart).count();
+    std::cout << "Traced " << totalRays / 1000000.0 << " M rays in " << traceSeconds << " s, "
+              << totalRays / 1000000.0 / traceSeconds << " M rays/s" << std::endl;
+
+    // Only the bounced light is noisy, the direct term is exact
+    denoise(indirect, cells, lightmap.width, lightmap.height, settings.denoisePasses);
+
+    lightmap.texels.resize(atlasTexels * 3);
+    glm::dvec3 directSum(0.0), indirectSum(0.0);
+    for (size_t i = 0; i < atlasTexels; ++i) {
+        glm::vec3 irradiance = direct[i] + indirect[i] * settings.indirectScale;
+        directSum += glm::dvec3(direct[i]);
+        indirectSum += glm::dvec3(indirect[i] * settings.indirectScale);
+        for (int c = 0; c < 3; ++c)
+            lightmap.texels[i * 3 + c] = glm::packHalf1x16(irradiance[c]);
+    }
+
+    double directMean = (directSum.x + directSum.y + directSum.z) / 3.0 / texels.size();
+    double indirectMean = (indirectSum.x + indirectSum.y + indirectSum.z) / 3.0 / texels.size();
+    std::cout << "Mean irradiance: direct " << directMean << ", indirect " << indirectMean << std::endl;
+
+    fs::path outputPath(settings.output);
+    std::error_code error;
+    if (outputPath.has_parent_path())
+        fs::create_directories(outputPath.parent_path(), error);
+    if (!writeLightmap(settings.output.c_str(), lightmap))
+        return -1;
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << "Wrote " << settings.output << " (" << lightmap.texels.size() * sizeof(uint16_t) / 1024
+              << " KB) in " << seconds << " s" << std::endl;
+
+    // Probes see the same paths, from every direction at once
+    ProbeVolume volume;
+    volume.grid = layoutProbeGrid(scene, settings.probeSpacing);
+    volume.sceneHash = lightmap.sceneHash;
+    glm::ivec3 counts = volume.grid.counts;
+    size_t probeCount = (size_t)counts.x * counts.y * counts.z;
+    std::cout << "Baking " << counts.x << "x" << counts.y << "x" << counts.z << " probes, " << settings.probeRays
+              << " rays each" << std::endl;
+    std::vector<glm::vec3> coefficients(probeCount * PROBE_SH_COEFFICIENTS);
+    std::vector<uint8_t> valid(probeCount);
+    traceStart = Clock::now();
+    totalRays = runWorkers(probeCount, threadCount, [&](size_t probe, uint64_t& rays) {
+        glm::ivec3 cell((int)(probe % counts.x), (int)(probe / counts.x % counts.y),
+                        (int)(probe / counts.x / counts.y));
+        glm::vec3 position = volume.grid.origin + glm::vec3(cell) * volume.grid.spacing;
+        Random random = { (uint32_t)probe * 2654435761u + 1u };
+        glm::vec3* probeCoefficients = &coefficients[probe * PROBE_SH_COEFFICIENTS];
+        valid[probe] = bakeProbe(bake, position, settings, random, rays, probeCoefficients);
+    });
+    traceSeconds = std::chrono::duration<double>(Clock::now() - traceStart).count();
+    int inside = (int)std::count(valid.begin(), valid.end(), 1);
+    int filled = fillInvalidProbes(coefficients, valid, counts);
+    std::cout << "Traced " << totalRays / 1000000.0 << " M rays in " << traceSeconds << " s, " << inside << " of "
+              << probeCount << " probes inside the rooms, " << filled << " filled from their neighbours"
+              << std::endl;
+
+    volume.coefficients.resize(coefficients.size() * 3);
+    for (size_t i = 0; i < coefficients.size(); ++i) {
+        for (int c = 0; c < 3; ++c)
+            volume.coefficients[i * 3 + c] = glm::packHalf1x16(coefficients[i][c]);
+    }
+    fs::path probePath(settings.probeOutput);
+    if (probePath.has_parent_path())
+        fs::create_directories(probePath.parent_path(), error);
+    if (!writeProbeVolume(settings.probeOutput.c_str(), volume))
+        return -1;
+    std::cout << "Wrote " << settings.probeOutput << " (" << volume.coefficients.size() * sizeof(uint16_t) / 1024
+              << " KB)" << std::endl;
+    return 0;
+}
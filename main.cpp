@@ -1,13 +1,22 @@
 #include <glad/glad.h>
+#ifndef GALLERY_NO_WINDOW
 #include <GLFW/glfw3.h>
+#endif
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-#include <fstream>
-#include <sstream>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "renderer.h"
+#include "bench.h"
+#include "camera_path.h"
+#include "frame_timer.h"
+#include "headless.h"
+#include "program_cache.h"
 
 // Screen dimensions
 const unsigned int SCR_WIDTH = 1280;
@@ -23,102 +32,17 @@ glm::vec3 cameraUp(0.0f, 1.0f, 0.0f);
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// Input seen during the current frame, stored when recording
+uint32_t frameKeys = 0;
+glm::vec2 frameMouseDelta(0.0f);
+float frameScroll = 0.0f;
+
+#ifndef GALLERY_NO_WINDOW
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
-// Function to compile a shader and check for errors
-unsigned int compileShader(const char* source, GLenum type) {
-    unsigned int shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, NULL);
-    glCompileShader(shader);
-
-    // Check for compile errors
-    int success;
-    char infoLog[512];
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(shader, 512, NULL, infoLog);
-        std::cout << "Shader Compilation Error:\n" << infoLog << std::endl;
-    }
-
-    return shader;
-}
-
-// Function to read a shader file and return its source code
-std::string readShaderSource(const char* filePath) {
-    std::ifstream file(filePath);
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
-}
-
-// Function to link shaders into a program
-unsigned int createShaderProgram(const char* vertexPath, const char* fragmentPath) {
-    std::string vertexSource = readShaderSource(vertexPath);
-    std::string fragmentSource = readShaderSource(fragmentPath);
-
-    unsigned int vertexShader = compileShader(vertexSource.c_str(), GL_VERTEX_SHADER);
-    unsigned int fragmentShader = compileShader(fragmentSource.c_str(), GL_FRAGMENT_SHADER);
-
-    unsigned int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    // Check for linking errors
-    int success;
-    char infoLog[512];
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cout << "Shader Program Linking Error:\n" << infoLog << std::endl;
-    }
-
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    return shaderProgram;
-}
-
-unsigned int loadTexture(const char* path) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-
-    stbi_set_flip_vertically_on_load(true);
-
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else {
-        std::cout << "Failed to load texture: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
-
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
 }
@@ -129,14 +53,23 @@ void processInput(GLFWwindow* window) {
     glm::vec3 cameraFrontXZ = glm::normalize(glm::vec3(cameraFront.x, 0.0f, cameraFront.z));
     glm::vec3 rightXZ = glm::normalize(glm::cross(cameraFrontXZ, cameraUp));
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    frameKeys = 0;
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
         cameraPos += cameraSpeed * cameraFrontXZ;
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        frameKeys |= CAMERA_KEY_FORWARD;
+    }
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
         cameraPos -= cameraSpeed * cameraFrontXZ;
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        frameKeys |= CAMERA_KEY_BACK;
+    }
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
         cameraPos -= cameraSpeed * rightXZ;
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        frameKeys |= CAMERA_KEY_LEFT;
+    }
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
         cameraPos += cameraSpeed * rightXZ;
+        frameKeys |= CAMERA_KEY_RIGHT;
+    }
     // user height
     cameraPos.y = 1.5f;
 }
@@ -158,6 +91,7 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     float yOffset = lastY - ypos; // Reversed: y-coordinates go from bottom to top
     lastX = xpos;
     lastY = ypos;
+    frameMouseDelta += glm::vec2(xOffset, yOffset);
 
     xOffset *= sensitivity;
     yOffset *= sensitivity;
@@ -171,26 +105,109 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     if (cameraPitch < -89.0f)
         cameraPitch = -89.0f;
 
-    glm::vec3 front;
-    front.x = cos(glm::radians(cameraYaw)) * cos(glm::radians(cameraPitch));
-    front.y = sin(glm::radians(cameraPitch));
-    front.z = sin(glm::radians(cameraYaw)) * cos(glm::radians(cameraPitch));
-    cameraFront = glm::normalize(front);
+    cameraFront = cameraFrontFromAngles(cameraYaw, cameraPitch);
 }
 
 
 float fov = 45.0f;
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+    frameScroll += (float)yoffset;
     fov -= (float)yoffset;
     if (fov < 1.0f)
         fov = 1.0f;
     if (fov > 45.0f)
         fov = 45.0f;
 }
+#endif // GALLERY_NO_WINDOW
+
+// Bytes for a whole number of megabytes, 0 unless the text is one above 0
+// that still fits in bytes
+size_t parseMegabytes(const char* text) {
+    if (!std::isdigit((unsigned char)text[0]))
+        return 0;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long megabytes = std::strtoul(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || megabytes == 0 || megabytes > (SIZE_MAX >> 20))
+        return 0;
+    return (size_t)megabytes << 20;
+}
+
 
+int main(int argc, char** argv) {
+    // Benchmarks never open a window
+    bool headless = false;
+    HeadlessOptions headlessOptions;
+    const char* recordPath = nullptr;
+    bool hotReload = true; // Windowed runs only, headless ones ask with --hot-reload
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+            return runBenchmark(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            headlessOptions.frames = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc)
+            headlessOptions.screenshotPath = argv[++i];
+        else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            headlessOptions.replayPath = argv[++i];
+        else if (std::strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+            headlessOptions.csvPath = argv[++i];
+        else if (std::strcmp(argv[i], "--no-texture-cache") == 0)
+            headlessOptions.renderer.textureCache = false;
+        else if (std::strcmp(argv[i], "--no-texture-array") == 0)
+            headlessOptions.renderer.paintingArray = false;
+        else if (std::strcmp(argv[i], "--no-virtual-texture") == 0)
+            headlessOptions.renderer.virtualTextures = false;
+        else if (std::strcmp(argv[i], "--no-program-cache") == 0)
+            headlessOptions.programCache = false;
+        else if (std::strcmp(argv[i], "--no-hot-reload") == 0)
+            hotReload = false;
+        else if (std::strcmp(argv[i], "--hot-reload") == 0)
+            headlessOptions.hotReload = true;
+        else if (std::strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+            headlessOptions.renderer.lightCount = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--clustered-lights") == 0)
+            headlessOptions.renderer.clusteredLights = true;
+        else if (std::strcmp(argv[i], "--deferred") == 0)
+            headlessOptions.renderer.deferredShading = true;
+        else if (std::strcmp(argv[i], "--no-lightmap") == 0)
+            headlessOptions.renderer.lightmap = false;
+        else if (std::strcmp(argv[i], "--shadows") == 0)
+            headlessOptions.renderer.shadows = true;
+        else if (std::strcmp(argv[i], "--no-probes") == 0)
+            headlessOptions.renderer.probes = false;
+        else if (std::strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+            headlessOptions.renderer.textureBudgetBytes = parseMegabytes(argv[++i]);
+            if (headlessOptions.renderer.textureBudgetBytes == 0) {
+                std::cout << "Usage: --texture-budget <MB>, a whole number of megabytes above 0, not "
+                          << argv[i] << std::endl;
+                return -1;
+            }
+        }
+    }
+
+    // No window or display, render offscreen along a scripted or recorded path
+    if (headless)
+        return runHeadless(headlessOptions);
+
+#ifdef GALLERY_NO_WINDOW
+    // Built without GLFW, for machines without a display
+    (void)recordPath;
+    (void)hotReload;
+    std::cout << "Built without GLFW: run with --headless or --bench" << std::endl;
+    return -1;
+#else
+
+    // Replays ignore input and run at whatever rate the GPU allows
+    const char* replayPath = headlessOptions.replayPath;
+    CameraRecording recording;
+    if (replayPath && !loadCameraRecording(replayPath, recording))
+        return -1;
 
-int main() {
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -211,161 +228,39 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
-
-    glEnable(GL_DEPTH_TEST);
+    if (headlessOptions.programCache)
+        initProgramCache((GLADloadproc)glfwGetProcAddress);
 
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
 
-    // Load shaders, textures, and other resources here
-    // 
-    // Load shaders
-    unsigned int shaderProgram = createShaderProgram("shader.vert", "shader.frag");
-    glUseProgram(shaderProgram);
-
-    // Load textures
-    unsigned int wallTexture = loadTexture("textures/wall.jpg");
-    unsigned int floorTexture = loadTexture("textures/floor.jpg");
-    unsigned int paintingTexture = loadTexture("textures/painting.png");
-    unsigned int painting2Texture = loadTexture("textures/painting2.jpg");
-    unsigned int painting3Texture = loadTexture("textures/painting3.jpg");
-    unsigned int painting4Texture = loadTexture("textures/painting4.jpg");
-    unsigned int ceilingTexture = loadTexture("textures/ceiling.jpg");
-    unsigned int cubeTexture = loadTexture("textures/cube.jpg");
-
-    struct PointLight {
-        glm::vec3 position;
-        glm::vec3 color;
-        float intensity;
-    };
-
-    // Define lights above each painting
-    PointLight lights[5] = {
-        { glm::vec3(0.0f, 3.5f, -18.0f), glm::vec3(1.0f, 0.8f, 0.8f), 1.2f }, // Slightly higher
-        { glm::vec3(-18.0f, 3.5f, 0.0f), glm::vec3(1.0f, 0.8f, 0.8f), 1.2f },
-        { glm::vec3(0.0f, 3.5f, 18.0f), glm::vec3(1.0f, 0.8f, 0.8f), 1.2f },
-        { glm::vec3(18.0f, 3.5f, 0.0f), glm::vec3(1.0f, 0.8f, 0.8f), 1.2f },
-        { glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(1.0f, 0.8f, 0.8f), 1.0f }
-    };
-
-
-    // Pass light data to shaders
-    for (int i = 0; i < 5; ++i) {
-        std::string lightPosUniform = "lights[" + std::to_string(i) + "].position";
-        std::string lightColorUniform = "lights[" + std::to_string(i) + "].color";
-        std::string lightIntensityUniform = "lights[" + std::to_string(i) + "].intensity";
-
-        glUniform3fv(glGetUniformLocation(shaderProgram, lightPosUniform.c_str()), 1, glm::value_ptr(lights[i].position));
-        glUniform3fv(glGetUniformLocation(shaderProgram, lightColorUniform.c_str()), 1, glm::value_ptr(lights[i].color));
-        glUniform1f(glGetUniformLocation(shaderProgram, lightIntensityUniform.c_str()), lights[i].intensity);
+    // Saved shaders are rebuilt on a hidden window's context, sharing objects with this one
+    GLFWwindow* reloadContext = nullptr;
+    if (hotReload && !replayPath) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        reloadContext = glfwCreateWindow(1, 1, "", NULL, window);
+        if (reloadContext) {
+            headlessOptions.renderer.shaderReloadContext = [reloadContext](bool bind) {
+                glfwMakeContextCurrent(bind ? reloadContext : NULL);
+            };
+        }
     }
 
-    // Pass the camera (view) position to the shader
-    glUniform3fv(glGetUniformLocation(shaderProgram, "viewPos"), 1, glm::value_ptr(cameraPos));
-
-    // Set texture uniforms in the shader
-    glUniform1i(glGetUniformLocation(shaderProgram, "texture1"), 0);
-
-    float vertices[] = {
-        // positions          // texture coords
-        -0.5f, -0.5f, 0.0f,   0.0f, 0.0f, // bottom-left
-         0.5f, -0.5f, 0.0f,   1.0f, 0.0f, // bottom-right
-         0.5f,  0.5f, 0.0f,   1.0f, 1.0f, // top-right
-         0.5f,  0.5f, 0.0f,   1.0f, 1.0f, // top-right
-        -0.5f,  0.5f, 0.0f,   0.0f, 1.0f, // top-left
-        -0.5f, -0.5f, 0.0f,   0.0f, 0.0f  // bottom-left
-    };
-
-    // Create VAO, VBO
-    unsigned int VAO, VBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    // Vertex attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
-    // CUBE
-    float cubeVertices[] = {
-        // positions          // texture coords
-        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-         0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-        -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-         0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-    };
-    unsigned int cubeVAO, cubeVBO;
-
-    // Generate VAO and VBO for the cube
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-
-    // Bind the cube's VAO
-    glBindVertexArray(cubeVAO);
-
-    // Bind and upload vertex data to the cube's VBO
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
-
-    // Configure vertex attributes for the cube
-    // Position attribute (location = 0)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // Texture coordinate attribute (location = 1)
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    // Unbind VBO and VAO
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    // Load shaders, textures, and other resources here
+    GalleryRenderer renderer = createGalleryRenderer(headlessOptions.renderer);
+    float lastStatsReport = 0.0f;
+
+    // Location queries only happen while shader variants are built
+    unsigned int startupLocationQueries = uniformLocationQueryCount();
+
+    bool shadingKeyDown = false;
 
+    FrameTimer timer = createFrameTimer();
+    if (replayPath) {
+        finishTextureLoading(renderer);
+        glfwSwapInterval(0);
+    }
 
     while (!glfwWindowShouldClose(window)) {
         // Calculate deltaTime for smooth movement
@@ -373,286 +268,50 @@ int main() {
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        // Process user input
-        processInput(window);
-
-        // Clear the color and depth buffer
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Use the shader program
-        glUseProgram(shaderProgram);
-
-        // Set camera view and projection matrices
-        glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-        glm::mat4 projection = glm::perspective(glm::radians(fov), (float)SCR_WIDTH / SCR_HEIGHT, 0.1f, 100.0f);
-
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-
-        // Render the floor 
-        // Floor 1
-        glBindTexture(GL_TEXTURE_2D, floorTexture);
-
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f)); // Position the floor
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate to align with XZ-plane
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 1.0f)); // Scale the floor to cover the desired area
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6); // Draw the floor (6 vertices for 2 triangles)
-
-        // Floor 2
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(10.0f, -1.0f, 0.0f)); // Position the floor
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate to align with XZ-plane
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 1.0f)); // Scale the floor to cover the desired area
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6); // Draw the floor (6 vertices for 2 triangles)
-
-        // Floor 3
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -1.0f, 10.0f)); // Position the floor
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate to align with XZ-plane
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 1.0f)); // Scale the floor to cover the desired area
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6); // Draw the floor (6 vertices for 2 triangles)
-
-        // Floor 4
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-10.0f, -1.0f, 0.0f)); // Position the floor
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate to align with XZ-plane
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 1.0f)); // Scale the floor to cover the desired area
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6); // Draw the floor (6 vertices for 2 triangles)
-
-        // Floor 5
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -1.0f, -10.0f)); // Position the floor
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate to align with XZ-plane
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 1.0f)); // Scale the floor to cover the desired area
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6); // Draw the floor (6 vertices for 2 triangles)
-
-        // Render the ceiling
-        // Ceiling 1
-        glBindTexture(GL_TEXTURE_2D, ceilingTexture);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 4.0f, 0.0f)); // Position the ceiling above
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate to align with XZ-plane
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 1.0f)); // Scale the ceiling to cover the desired area
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6); // Draw the ceiling
-
-        // Ceiling 2
-        glBindTexture(GL_TEXTURE_2D, ceilingTexture);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(10.0f, 4.0f, 0.0f)); // Position the ceiling above
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate to align with XZ-plane
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 1.0f)); // Scale the ceiling to cover the desired area
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6); // Draw the ceiling
-
-        // Ceiling 3
-        glBindTexture(GL_TEXTURE_2D, ceilingTexture);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 4.0f, 10.0f)); // Position the ceiling above
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate to align with XZ-plane
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 1.0f)); // Scale the ceiling to cover the desired area
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6); // Draw the ceiling
-
-        // Ceiling 4
-        glBindTexture(GL_TEXTURE_2D, ceilingTexture);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-10.0f, 4.0f, 0.0f)); // Position the ceiling above
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate to align with XZ-plane
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 1.0f)); // Scale the ceiling to cover the desired area
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6); // Draw the ceiling
-
-        // Ceiling 5
-        glBindTexture(GL_TEXTURE_2D, ceilingTexture);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 4.0f, -10.0f)); // Position the ceiling above
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate to align with XZ-plane
-        model = glm::scale(model, glm::vec3(10.0f, 10.0f, 1.0f)); // Scale the ceiling to cover the desired area
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6); // Draw the ceiling
-
-        // Render the walls
-        glBindTexture(GL_TEXTURE_2D, wallTexture);
-
-        // Side wall 1
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(10.0f, 1.5f, -5.0f));
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Side wall 2
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-5.0f, 1.5f, 10.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Side wall 3
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(5.0f, 1.5f, 10.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Side wall 4
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(10.0f, 1.5f, 5.0f));
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Side wall 5
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-10.0f, 1.5f, -5.0f));
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Side wall 6
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-5.0f, 1.5f, -10.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Side wall 7
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(5.0f, 1.5f, -10.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Side wall 8
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-10.0f, 1.5f, 5.0f));
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Render the cross-shaped extensions
-
-        // Back extension
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 1.5f, -15.0f)); // Move further back
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f)); // Same size as original walls
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Left extension
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-15.0f, 1.5f, 0.0f)); // Move further left
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate for side wall
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Right extension
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(15.0f, 1.5f, 0.0f)); // Move further right
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate for side wall
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Front extension
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 1.5f, 15.0f)); // Move further front
-        model = glm::scale(model, glm::vec3(10.0f, 5.0f, 0.1f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Render a painting
-        // Painting 1
-        glBindTexture(GL_TEXTURE_2D, paintingTexture);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 1.5f, -14.9f)); // Position the painting slightly in front of the back wall
-        model = glm::scale(model, glm::vec3(3.0f, 2.0f, 0.1f));       // Scale to match painting dimensions
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Painting 2
-        glBindTexture(GL_TEXTURE_2D, painting2Texture);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-14.9f, 1.5f, 0.0f)); // Position the painting slightly in front of the back wall
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(3.0f, 2.0f, 0.1f));       // Scale to match painting dimensions
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Painting 3
-        glBindTexture(GL_TEXTURE_2D, painting3Texture);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 1.5f, 14.9f)); // Position the painting slightly in front of the back wall
-        model = glm::scale(model, glm::vec3(3.0f, 2.0f, 0.1f));       // Scale to match painting dimensions
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Painting 4
-        glBindTexture(GL_TEXTURE_2D, painting4Texture);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(14.9f, 1.5f, 0.0f)); // Position the painting slightly in front of the back wall
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(3.0f, 2.0f, 0.1f));       // Scale to match painting dimensions
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Use the cube's VAO
-        glBindVertexArray(cubeVAO);
-        glBindTexture(GL_TEXTURE_2D, cubeTexture);
-        // Apply transformations for the rotating cube
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, sqrt(3.0f) / 2.0f, 0.0f)); // Position and lift the cube
-        model = glm::rotate(model, glm::radians(45.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Tilt on X-axis
-        model = glm::rotate(model, glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f)); // Tilt on Z-axis
-        model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(1.0f, 1.0f, -1.0f)); // Rotate over time
-        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f)); // Scale to desired size
-
-        // Pass the transformation matrix to the shader
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-        // Draw the cube
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        // Unbind the VAO
-        glBindVertexArray(0);
+        Camera camera;
+        float animationTime = currentFrame;
+        if (replayPath) {
+            if (timer.frame == (int)recording.frames.size())
+                break;
+            camera = cameraFromFrame(recording.frames[timer.frame], (float)SCR_WIDTH / SCR_HEIGHT);
+            animationTime = timer.frame * REPLAY_DELTA_TIME;
+            if (cameraFrameTogglesShading(recording, timer.frame))
+                renderer.deferredShading = !renderer.deferredShading;
+        }
+        else {
+            // Process user input
+            processInput(window);
+
+            // G switches between forward and deferred shading
+            bool shadingKey = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+            if (shadingKey && !shadingKeyDown)
+                renderer.deferredShading = !renderer.deferredShading;
+            shadingKeyDown = shadingKey;
+            if (shadingKey)
+                frameKeys |= CAMERA_KEY_SHADING;
+            camera = { cameraPos, cameraFront, cameraUp, fov, (float)SCR_WIDTH / SCR_HEIGHT };
+
+            if (recordPath) {
+                recording.frames.push_back({ deltaTime, cameraPos, cameraYaw, cameraPitch, fov, frameKeys,
+                                             frameMouseDelta, frameScroll });
+            }
+            frameMouseDelta = glm::vec2(0.0f);
+            frameScroll = 0.0f;
+        }
+
+        // Only replays report timings, interactive frames are not measured
+        if (replayPath)
+            beginFrameTiming(timer);
+        FrameStats stats = renderFrame(renderer, camera, animationTime);
+        if (replayPath)
+            endFrameTiming(timer);
+
+        // Report this frame's state changes in the title twice a second
+        if (currentFrame - lastStatsReport > 0.5f) {
+            std::string title = "OpenGL Art Gallery | " + formatFrameStats(stats);
+            glfwSetWindowTitle(window, title.c_str());
+            lastStatsReport = currentFrame;
+        }
 
 
         // Swap buffers and poll for I/O events
@@ -661,8 +320,27 @@ int main() {
     }
 
 
+    std::cout << "Uniform location queries: " << startupLocationQueries << " at startup, "
+              << uniformLocationQueryCount() - startupLocationQueries << " while rendering, reflecting "
+              << renderer.shaders.programs.size() << " shader variants" << std::endl;
+
+    finishFrameTiming(timer);
+    if (replayPath) {
+        std::cout << "Replayed " << timer.frame << " frames from " << replayPath << std::endl;
+        printFrameTimings(timer);
+        if (headlessOptions.csvPath)
+            writeFrameTimingsCsv(timer, headlessOptions.csvPath);
+    }
+    if (recordPath && saveCameraRecording(recordPath, recording))
+        std::cout << "Recorded " << recording.frames.size() << " frames to " << recordPath << std::endl;
+
+    destroyFrameTimer(timer);
+    destroyGalleryRenderer(renderer);
+    if (reloadContext)
+        glfwDestroyWindow(reloadContext);
     glfwTerminate();
     return 0;
+#endif // GALLERY_NO_WINDOW
 }
 
 
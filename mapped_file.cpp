@@ -0,0 +1,84 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool openMappedFile(const char* path, MappedFile& mapped) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!view) {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    mapped.data = (const uint8_t*)view;
+    mapped.size = (size_t)size.QuadPart;
+    mapped.file = file;
+    mapped.mapping = mapping;
+    return true;
+}
+
+void closeMappedFile(MappedFile& mapped) {
+    if (mapped.data) {
+        UnmapViewOfFile(mapped.data);
+        CloseHandle(mapped.mapping);
+        CloseHandle(mapped.file);
+    }
+    mapped = MappedFile();
+}
+
+#else
+
+bool openMappedFile(const char* path, MappedFile& mapped) {
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    void* view = MAP_FAILED;
+    if (fstat(file, &info) == 0 && info.st_size > 0)
+        view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file); // The mapping keeps the file open
+    if (view == MAP_FAILED)
+        return false;
+
+    mapped.data = (const uint8_t*)view;
+    mapped.size = (size_t)info.st_size;
+    return true;
+}
+
+void closeMappedFile(MappedFile& mapped) {
+    if (mapped.data)
+        munmap((void*)mapped.data, mapped.size);
+    mapped = MappedFile();
+}
+
+#endif
+
+void prefetchMappedRange(const uint8_t* data, size_t size) {
+    const size_t PAGE_SIZE_GUESS = 4096;
+    volatile uint8_t sink = 0;
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE_GUESS)
+        sink += data[offset];
+    if (size > 0)
+        sink += data[size - 1];
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A whole file mapped read-only into the address space
+struct MappedFile {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
+
+bool openMappedFile(const char* path, MappedFile& mapped);
+void closeMappedFile(MappedFile& mapped);
+
+// Touches every page of a range so later reads do not fault, meant for
+// worker threads
+void prefetchMappedRange(const uint8_t* data, size_t size);
@@ -0,0 +1,369 @@
+#include "mesh.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+
+#include "lightmap.h"
+
+namespace {
+
+// Authored as triangle soups: every triangle lists its own three corners
+const float QUAD_TRIANGLES[] = {
+    // positions          // texture coords
+    -0.5f, -0.5f, 0.0f,   0.0f, 0.0f, // bottom-left
+     0.5f, -0.5f, 0.0f,   1.0f, 0.0f, // bottom-right
+     0.5f,  0.5f, 0.0f,   1.0f, 1.0f, // top-right
+     0.5f,  0.5f, 0.0f,   1.0f, 1.0f, // top-right
+    -0.5f,  0.5f, 0.0f,   0.0f, 1.0f, // top-left
+    -0.5f, -0.5f, 0.0f,   0.0f, 0.0f  // bottom-left
+};
+
+const float BOX_TRIANGLES[] = {
+    // positions          // texture coords
+    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+     0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+
+    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+
+     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+     0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+     0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+     0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+    -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
+    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
+};
+
+const int SOURCE_STRIDE = 5;
+
+// LRU cache Forsyth's scores assume; larger than real FIFO caches on purpose,
+// it only ranks vertices
+const int FORSYTH_CACHE_SIZE = 32;
+
+float forsythVertexScore(int cachePosition, int remainingTriangles) {
+    if (remainingTriangles == 0)
+        return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // The last triangle's vertices get a fixed score, so the next triangle
+        // does not simply reuse its freshest edge
+        if (cachePosition < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.0f - (cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+    }
+    // Vertices with few triangles left are finished off before they fall out
+    return score + 2.0f / std::sqrt((float)remainingTriangles);
+}
+
+// Per triangle: whether each corner missed a FIFO cache of cacheSize
+std::vector<int> simulateCacheMisses(const std::vector<uint32_t>& indices, int vertexCount, int cacheSize) {
+    std::vector<int> misses(indices.size() / 3, 0);
+    std::vector<int> insertedAt(vertexCount, -cacheSize - 1);
+    int inserted = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        int vertex = indices[i];
+        if (inserted - insertedAt[vertex] > cacheSize) {
+            insertedAt[vertex] = inserted++;
+            ++misses[i / 3];
+        }
+    }
+    return misses;
+}
+
+glm::vec3 vertexPosition(const std::vector<float>& vertices, int vertex) {
+    const float* v = &vertices[vertex * MESH_VERTEX_FLOATS];
+    return glm::vec3(v[0], v[1], v[2]);
+}
+
+} // namespace
+
+MeshData indexTriangles(const float* vertices, int vertexCount, int stride) {
+    MeshData mesh;
+    mesh.indices.reserve(vertexCount);
+    std::unordered_map<std::string, uint32_t> seen;
+    for (int i = 0; i < vertexCount; ++i) {
+        const float* vertex = vertices + i * stride;
+        std::string key((const char*)vertex, stride * sizeof(float));
+        auto found = seen.find(key);
+        if (found != seen.end()) {
+            mesh.indices.push_back(found->second);
+            continue;
+        }
+        uint32_t index = (uint32_t)(mesh.vertices.size() / stride);
+        seen.emplace(key, index);
+        mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + stride);
+        mesh.indices.push_back(index);
+    }
+    return mesh;
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, int vertexCount) {
+    int triangleCount = (int)indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles using each vertex; the first remaining[v] of its list are not emitted yet
+    std::vector<int> remaining(vertexCount, 0), firstTriangle(vertexCount + 1, 0);
+    for (uint32_t index : indices)
+        ++remaining[index];
+    for (int v = 0; v < vertexCount; ++v)
+        firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+    std::vector<int> vertexTriangles(indices.size());
+    std::vector<int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        vertexTriangles[filled[indices[i]]++] = (int)(i / 3);
+
+    std::vector<float> vertexScore(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+        vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+    std::vector<float> triangleScore(triangleCount);
+    for (int t = 0; t < triangleCount; ++t)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] +
+                           vertexScore[indices[t * 3 + 2]];
+    std::vector<char> emitted(triangleCount, 0);
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    std::vector<int> cache, nextCache, evicted;
+    int best = (int)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    int scanFrom = 0;
+    while (best >= 0) {
+        emitted[best] = 1;
+        nextCache.clear();
+        for (int corner = 0; corner < 3; ++corner) {
+            int v = indices[best * 3 + corner];
+            output.push_back((uint32_t)v);
+            nextCache.push_back(v);
+            int* list = &vertexTriangles[firstTriangle[v]];
+            int* last = list + --remaining[v];
+            std::swap(*std::find(list, last + 1, best), *last);
+        }
+
+        // The triangle's vertices move to the front, pushing the oldest past the end
+        for (int v : cache)
+            if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2])
+                nextCache.push_back(v);
+        size_t kept = std::min(nextCache.size(), (size_t)FORSYTH_CACHE_SIZE);
+        evicted.assign(nextCache.begin() + kept, nextCache.end());
+        nextCache.resize(kept);
+        cache.swap(nextCache);
+
+        // Only vertices in the cache, or just pushed out of it, changed score
+        for (size_t i = 0; i < cache.size(); ++i)
+            vertexScore[cache[i]] = forsythVertexScore((int)i, remaining[cache[i]]);
+        for (int v : evicted)
+            vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+
+        // The next triangle is the best one touching the cache
+        best = -1;
+        float bestScore = -1.0f;
+        for (int v : cache) {
+            for (int i = 0; i < remaining[v]; ++i) {
+                int t = vertexTriangles[firstTriangle[v] + i];
+                triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] +
+                                   vertexScore[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        // None does: start over from the next triangle left, in input order
+        if (best < 0) {
+            while (scanFrom < triangleCount && emitted[scanFrom])
+                ++scanFrom;
+            best = scanFrom < triangleCount ? scanFrom : -1;
+        }
+    }
+    indices.swap(output);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<float>& vertices, float threshold) {
+    int triangleCount = (int)indices.size() / 3;
+    int vertexCount = (int)vertices.size() / MESH_VERTEX_FLOATS;
+    if (triangleCount < 2)
+        return;
+
+    // A cluster starts wherever all three corners miss: the cache was refilling
+    // there anyway, so reordering whole clusters costs it little
+    std::vector<int> misses = simulateCacheMisses(indices, vertexCount, MESH_STATS_CACHE_SIZE);
+    std::vector<int> clusterStarts;
+    for (int t = 0; t < triangleCount; ++t)
+        if (t == 0 || misses[t] == 3)
+            clusterStarts.push_back(t);
+    clusterStarts.push_back(triangleCount);
+    int clusterCount = (int)clusterStarts.size() - 1;
+    if (clusterCount < 2)
+        return;
+
+    glm::vec3 meshCentroid(0.0f);
+    for (int v = 0; v < vertexCount; ++v)
+        meshCentroid += vertexPosition(vertices, v);
+    meshCentroid /= (float)vertexCount;
+
+    // How far out a cluster faces: its area weighted normal against the
+    // direction from the middle of the mesh to the middle of the cluster
+    std::vector<float> outwardness(clusterCount);
+    for (int c = 0; c < clusterCount; ++c) {
+        glm::vec3 areaNormal(0.0f), centroid(0.0f);
+        float area = 0.0f;
+        for (int t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+            glm::vec3 a = vertexPosition(vertices, indices[t * 3]);
+            glm::vec3 b = vertexPosition(vertices, indices[t * 3 + 1]);
+            glm::vec3 d = vertexPosition(vertices, indices[t * 3 + 2]);
+            glm::vec3 normal = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(normal);
+            areaNormal += normal;
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            area += triangleArea;
+        }
+        centroid = area > 0.0f ? centroid / area : centroid;
+        float length = glm::length(areaNormal);
+        outwardness[c] = length > 0.0f ? glm::dot(centroid - meshCentroid, areaNormal / length) : 0.0f;
+    }
+
+    std::vector<int> order(clusterCount);
+    for (int c = 0; c < clusterCount; ++c)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return outwardness[a] > outwardness[b]; });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    for (int c : order)
+        sorted.insert(sorted.end(), indices.begin() + clusterStarts[c] * 3,
+                      indices.begin() + clusterStarts[c + 1] * 3);
+
+    MeshCacheStats before = analyzeVertexCache(indices, vertexCount, MESH_STATS_CACHE_SIZE);
+    MeshCacheStats after = analyzeVertexCache(sorted, vertexCount, MESH_STATS_CACHE_SIZE);
+    if (after.acmr <= before.acmr * threshold)
+        indices.swap(sorted);
+}
+
+void optimizeVertexFetch(MeshData& mesh) {
+    int vertexCount = (int)mesh.vertices.size() / MESH_VERTEX_FLOATS;
+    std::vector<int> remap(vertexCount, -1);
+    std::vector<float> vertices;
+    vertices.reserve(mesh.vertices.size());
+    int next = 0;
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] < 0) {
+            remap[index] = next++;
+            const float* vertex = &mesh.vertices[index * MESH_VERTEX_FLOATS];
+            vertices.insert(vertices.end(), vertex, vertex + MESH_VERTEX_FLOATS);
+        }
+        index = (uint32_t)remap[index];
+    }
+    // Vertices no triangle uses are dropped
+    mesh.vertices.swap(vertices);
+}
+
+MeshCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, int vertexCount, int cacheSize) {
+    MeshCacheStats stats = { 0.0f, 0.0f };
+    if (indices.empty())
+        return stats;
+    std::vector<int> misses = simulateCacheMisses(indices, vertexCount, cacheSize);
+    int transformed = 0;
+    for (int count : misses)
+        transformed += count;
+    std::vector<char> used(vertexCount, 0);
+    int unique = 0;
+    for (uint32_t index : indices)
+        if (!used[index]) {
+            used[index] = 1;
+            ++unique;
+        }
+    stats.acmr = transformed / (float)misses.size();
+    stats.atvr = transformed / (float)unique;
+    return stats;
+}
+
+float analyzeVertexFetch(const std::vector<uint32_t>& indices, int vertexCount, int vertexBytes) {
+    if (vertexCount == 0)
+        return 0.0f;
+    std::vector<int> insertedAt(vertexCount, -MESH_STATS_CACHE_SIZE - 1);
+    std::vector<long long> cachedLine(MESH_FETCH_CACHE_LINES, -1);
+    int inserted = 0;
+    size_t fetchedBytes = 0;
+    for (uint32_t vertex : indices) {
+        if (inserted - insertedAt[vertex] <= MESH_STATS_CACHE_SIZE)
+            continue;
+        insertedAt[vertex] = inserted++;
+        long long first = (long long)vertex * vertexBytes / MESH_FETCH_LINE_BYTES;
+        long long last = ((long long)vertex * vertexBytes + vertexBytes - 1) / MESH_FETCH_LINE_BYTES;
+        for (long long line = first; line <= last; ++line) {
+            long long& slot = cachedLine[line % MESH_FETCH_CACHE_LINES];
+            if (slot != line) {
+                slot = line;
+                fetchedBytes += MESH_FETCH_LINE_BYTES;
+            }
+        }
+    }
+    return fetchedBytes / (float)((size_t)vertexCount * vertexBytes);
+}
+
+MeshData buildGalleryMesh(MeshId id, MeshBuildStats& stats) {
+    const float* source = id == MeshId::Box ? BOX_TRIANGLES : QUAD_TRIANGLES;
+    int sourceCount = (id == MeshId::Box ? sizeof(BOX_TRIANGLES) : sizeof(QUAD_TRIANGLES)) /
+                      (SOURCE_STRIDE * sizeof(float));
+
+    // Chart coordinates tell apart corners that share a position and texture
+    // coordinates but lie on different faces, so they go in before indexing
+    std::vector<glm::vec4> charts = lightmapChartCoords(id, source, sourceCount, SOURCE_STRIDE);
+    std::vector<float> soup;
+    soup.reserve(sourceCount * MESH_VERTEX_FLOATS);
+    for (int i = 0; i < sourceCount; ++i) {
+        soup.insert(soup.end(), source + i * SOURCE_STRIDE, source + (i + 1) * SOURCE_STRIDE);
+        soup.insert(soup.end(), &charts[i][0], &charts[i][0] + 4);
+    }
+    std::vector<uint32_t> unindexed(sourceCount);
+    for (int i = 0; i < sourceCount; ++i)
+        unindexed[i] = (uint32_t)i;
+
+    MeshData mesh = indexTriangles(soup.data(), sourceCount, MESH_VERTEX_FLOATS);
+    int vertexCount = (int)mesh.vertices.size() / MESH_VERTEX_FLOATS;
+    stats.sourceVertices = sourceCount;
+    stats.triangles = sourceCount / 3;
+    stats.soup = analyzeVertexCache(unindexed, sourceCount, MESH_STATS_CACHE_SIZE);
+    stats.indexed = analyzeVertexCache(mesh.indices, vertexCount, MESH_STATS_CACHE_SIZE);
+
+    optimizeVertexCache(mesh.indices, vertexCount);
+    optimizeOverdraw(mesh.indices, mesh.vertices, MESH_OVERDRAW_THRESHOLD);
+    optimizeVertexFetch(mesh);
+    stats.vertices = (int)mesh.vertices.size() / MESH_VERTEX_FLOATS;
+    stats.optimised = analyzeVertexCache(mesh.indices, stats.vertices, MESH_STATS_CACHE_SIZE);
+    return mesh;
+}
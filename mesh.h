@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "scene.h"
+
+// Per-vertex lightmap chart coordinates, after the texture coordinates
+const unsigned int LIGHTMAP_CHART_LOCATION = 8;
+
+// Floats per vertex: position, texture coordinates, lightmap chart
+const int MESH_VERTEX_FLOATS = 9;
+
+// FIFO post-transform cache the statistics simulate
+const int MESH_STATS_CACHE_SIZE = 16;
+
+// Triangle clusters are reordered for overdraw only while the cache misses
+// stay within this factor of the cache optimised order
+const float MESH_OVERDRAW_THRESHOLD = 1.05f;
+
+// Vertex fetch cache the statistics simulate, 16 KB
+const int MESH_FETCH_LINE_BYTES = 64;
+const int MESH_FETCH_CACHE_LINES = 256;
+
+// Vertices a mesh can have and still be drawn with 16 bit indices
+const int MESH_MAX_SHORT_INDEXED_VERTICES = 65536;
+
+// Indexed triangle list, vertices interleaved
+struct MeshData {
+    std::vector<float> vertices; // MESH_VERTEX_FLOATS per vertex
+    std::vector<uint32_t> indices; // Narrowed on upload when every vertex fits in 16 bits
+};
+
+// Post-transform cache efficiency of an index order: vertices shaded per
+// triangle (ACMR, 0.5 at best, 3 without reuse) and per unique vertex (ATVR,
+// 1 at best)
+struct MeshCacheStats {
+    float acmr;
+    float atvr;
+};
+
+// What building a mesh made of its triangle soup
+struct MeshBuildStats {
+    int sourceVertices;
+    int vertices;
+    int triangles;
+    MeshCacheStats soup;      // Drawn unindexed
+    MeshCacheStats indexed;   // Indexed, in the soup's triangle order
+    MeshCacheStats optimised; // After the cache and overdraw passes
+};
+
+// Merges bit-identical vertices of a triangle soup, stride floats apart
+MeshData indexTriangles(const float* vertices, int vertexCount, int stride);
+
+// Tom Forsyth's linear-speed optimiser: greedily emits the triangle whose
+// vertices score highest, by their place in a simulated LRU cache and by how
+// few triangles still use them
+void optimizeVertexCache(std::vector<uint32_t>& indices, int vertexCount);
+
+// Cuts the order into clusters where the simulated cache starts over, then
+// draws the clusters facing most outward first, as they are the likeliest
+// to hide the rest. Kept only within threshold of the original cache misses.
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<float>& vertices, float threshold);
+
+// Renumbers vertices in the order the indices first use them, so fetches walk
+// the vertex buffer forwards
+void optimizeVertexFetch(MeshData& mesh);
+
+MeshCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, int vertexCount, int cacheSize);
+
+// Bytes read from the vertex buffer per byte it holds, 1 at best. Vertices
+// missing the simulated post-transform cache are fetched through a direct
+// mapped cache of MESH_FETCH_CACHE_LINES lines of MESH_FETCH_LINE_BYTES.
+float analyzeVertexFetch(const std::vector<uint32_t>& indices, int vertexCount, int vertexBytes);
+
+// A gallery mesh from its authored triangle soup, through every pass above
+MeshData buildGalleryMesh(MeshId mesh, MeshBuildStats& stats);
+
+// GL resources for one MeshId
+struct Mesh {
+    unsigned int vao;
+    unsigned int vertexBuffer;
+    unsigned int indexBuffer; // Bound in the VAO
+    unsigned int indexType; // GL_UNSIGNED_SHORT, or GL_UNSIGNED_INT past MESH_MAX_SHORT_INDEXED_VERTICES
+    int indexCount;
+};
@@ -0,0 +1,399 @@
+#include "mipmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_SSE2 1
+#endif
+
+// AVX2 paths are compiled for that target only and picked at runtime
+#if defined(MIPMAP_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MIPMAP_AVX2 1
+#define MIPMAP_AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(MIPMAP_SSE2) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#define MIPMAP_AVX2 1
+#define MIPMAP_AVX2_TARGET
+#endif
+
+namespace {
+
+const int MAX_TAPS = 8;
+
+// Source taps for one output texel: texels first .. first + count - 1
+struct Kernel {
+    int count;
+    int offset; // first = 2 * output + offset
+    float weights[MAX_TAPS];
+};
+
+float sinc(float x) {
+    const float PI = 3.14159265f;
+    return x == 0.0f ? 1.0f : std::sin(PI * x) / (PI * x);
+}
+
+// Zeroth order modified Bessel function of the first kind, by its series
+float besselI0(float x) {
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 16; ++k) {
+        term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        sum += term;
+    }
+    return sum;
+}
+
+Kernel makeKernel(MipFilter filter) {
+    Kernel kernel;
+    if (filter == MipFilter::Box) {
+        kernel.count = 2;
+        kernel.offset = 0;
+        kernel.weights[0] = kernel.weights[1] = 0.5f;
+        return kernel;
+    }
+
+    // Lowpass at half the source rate, windowed to +-4 source texels
+    const float ALPHA = 4.0f;
+    const float RADIUS = 4.0f;
+    kernel.count = MAX_TAPS;
+    kernel.offset = -3;
+    float total = 0.0f;
+    for (int k = 0; k < MAX_TAPS; ++k) {
+        float distance = k - 3.5f; // From the output texel's center, in source texels
+        float ratio = distance / RADIUS;
+        float window = besselI0(ALPHA * std::sqrt(std::max(0.0f, 1.0f - ratio * ratio))) / besselI0(ALPHA);
+        kernel.weights[k] = sinc(distance / 2.0f) * window;
+        total += kernel.weights[k];
+    }
+    for (int k = 0; k < MAX_TAPS; ++k)
+        kernel.weights[k] /= total;
+    return kernel;
+}
+
+// sRGB transfer functions as tables: decode by byte, encode by 12-bit linear value
+struct SrgbTables {
+    float toLinear[256];
+    uint8_t fromLinear[4096];
+
+    SrgbTables() {
+        for (int i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < 4096; ++i) {
+            float l = i / 4095.0f;
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            fromLinear[i] = (uint8_t)std::lround(std::min(std::max(c, 0.0f), 1.0f) * 255.0f);
+        }
+    }
+};
+
+const SrgbTables& srgbTables() {
+    static const SrgbTables tables;
+    return tables;
+}
+
+void decodeRow(const uint8_t* source, int width, float* row) {
+    const SrgbTables& tables = srgbTables();
+    for (int i = 0; i < width; ++i) {
+        row[i * 4 + 0] = tables.toLinear[source[i * 4 + 0]];
+        row[i * 4 + 1] = tables.toLinear[source[i * 4 + 1]];
+        row[i * 4 + 2] = tables.toLinear[source[i * 4 + 2]];
+        row[i * 4 + 3] = source[i * 4 + 3] / 255.0f;
+    }
+}
+
+void encodeRow(const float* row, int width, uint8_t* destination) {
+    const SrgbTables& tables = srgbTables();
+    for (int i = 0; i < width * 4; ++i) {
+        float value = std::min(std::max(row[i], 0.0f), 1.0f);
+        destination[i] = (i & 3) == 3 ? (uint8_t)(value * 255.0f + 0.5f) : tables.fromLinear[(int)(value * 4095.0f + 0.5f)];
+    }
+}
+
+// Weighted sum of source rows into one row of floats (count floats)
+void filterRowsScalar(const float* const* rows, const Kernel& kernel, int count, float* out) {
+    for (int i = 0; i < count; ++i) {
+        float sum = 0.0f;
+        for (int k = 0; k < kernel.count; ++k)
+            sum += kernel.weights[k] * rows[k][i];
+        out[i] = sum;
+    }
+}
+
+// One output texel of the horizontal pass, source clamped at both ends
+void filterTexelScalar(const float* row, int width, const Kernel& kernel, int x, float* out) {
+    float sum[4] = {};
+    for (int k = 0; k < kernel.count; ++k) {
+        int source = std::min(std::max(2 * x + kernel.offset + k, 0), width - 1);
+        for (int c = 0; c < 4; ++c)
+            sum[c] += kernel.weights[k] * row[source * 4 + c];
+    }
+    std::memcpy(out + x * 4, sum, sizeof(sum));
+}
+
+void filterTexelsScalar(const float* row, int width, const Kernel& kernel, int outWidth, float* out) {
+    for (int x = 0; x < outWidth; ++x)
+        filterTexelScalar(row, width, kernel, x, out);
+}
+
+#ifdef MIPMAP_SSE2
+
+void filterRowsSSE2(const float* const* rows, const Kernel& kernel, int count, float* out) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < kernel.count; ++k)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel.weights[k]), _mm_loadu_ps(rows[k] + i)));
+        _mm_storeu_ps(out + i, sum);
+    }
+    for (; i < count; ++i) {
+        float sum = 0.0f;
+        for (int k = 0; k < kernel.count; ++k)
+            sum += kernel.weights[k] * rows[k][i];
+        out[i] = sum;
+    }
+}
+
+// One RGBA texel is one register
+void filterTexelsSSE2(const float* row, int width, const Kernel& kernel, int outWidth, float* out) {
+    __m128 weights[MAX_TAPS];
+    for (int k = 0; k < kernel.count; ++k)
+        weights[k] = _mm_set1_ps(kernel.weights[k]);
+
+    for (int x = 0; x < outWidth; ++x) {
+        __m128 sum = _mm_setzero_ps();
+        int first = 2 * x + kernel.offset;
+        if (first >= 0 && first + kernel.count <= width) {
+            for (int k = 0; k < kernel.count; ++k)
+                sum = _mm_add_ps(sum, _mm_mul_ps(weights[k], _mm_loadu_ps(row + (first + k) * 4)));
+        }
+        else {
+            for (int k = 0; k < kernel.count; ++k) {
+                int source = std::min(std::max(first + k, 0), width - 1);
+                sum = _mm_add_ps(sum, _mm_mul_ps(weights[k], _mm_loadu_ps(row + source * 4)));
+            }
+        }
+        _mm_storeu_ps(out + x * 4, sum);
+    }
+}
+
+#endif
+
+#ifdef MIPMAP_AVX2
+
+MIPMAP_AVX2_TARGET void filterRowsAVX2(const float* const* rows, const Kernel& kernel, int count, float* out) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < kernel.count; ++k)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(kernel.weights[k]), _mm256_loadu_ps(rows[k] + i)));
+        _mm256_storeu_ps(out + i, sum);
+    }
+    for (; i < count; ++i) {
+        float sum = 0.0f;
+        for (int k = 0; k < kernel.count; ++k)
+            sum += kernel.weights[k] * rows[k][i];
+        out[i] = sum;
+    }
+}
+
+// Two output texels per register: taps of x in the low half, of x + 1 in the high half
+MIPMAP_AVX2_TARGET void filterTexelsAVX2(const float* row, int width, const Kernel& kernel, int outWidth, float* out) {
+    __m256 weights[MAX_TAPS];
+    for (int k = 0; k < kernel.count; ++k)
+        weights[k] = _mm256_set1_ps(kernel.weights[k]);
+
+    // Clamped taps at the left border
+    int x = 0;
+    for (; x < outWidth && 2 * x + kernel.offset < 0; ++x)
+        filterTexelScalar(row, width, kernel, x, out);
+
+    for (; x + 2 <= outWidth && 2 * x + kernel.offset + 2 + kernel.count <= width; x += 2) {
+        int first = 2 * x + kernel.offset;
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < kernel.count; ++k) {
+            __m256 texels = _mm256_loadu2_m128(row + (first + 2 + k) * 4, row + (first + k) * 4);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(weights[k], texels));
+        }
+        _mm256_storeu_ps(out + x * 4, sum);
+    }
+
+    // Right border and an odd texel left over
+    for (; x < outWidth; ++x)
+        filterTexelScalar(row, width, kernel, x, out);
+}
+
+bool cpuHasAVX2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+typedef void (*FilterRows)(const float* const*, const Kernel&, int, float*);
+typedef void (*FilterTexels)(const float*, int, const Kernel&, int, float*);
+
+// Vertical pass into one row, then horizontal pass, one output row at a time.
+// Decoded source rows are kept in a small ring so each is converted once.
+void downsampleLevel(const uint8_t* source, int width, int height, uint8_t* destination, int outWidth,
+                     int outHeight, const Kernel& kernel, FilterRows filterRows, FilterTexels filterTexels) {
+    std::vector<float> ring((size_t)MAX_TAPS * width * 4);
+    int ringRow[MAX_TAPS];
+    std::fill(ringRow, ringRow + MAX_TAPS, -1);
+    std::vector<float> column((size_t)width * 4), filtered((size_t)outWidth * 4);
+
+    const float* rows[MAX_TAPS];
+    for (int y = 0; y < outHeight; ++y) {
+        for (int k = 0; k < kernel.count; ++k) {
+            int sourceRow = std::min(std::max(2 * y + kernel.offset + k, 0), height - 1);
+            int slot = sourceRow % MAX_TAPS;
+            float* decoded = &ring[(size_t)slot * width * 4];
+            if (ringRow[slot] != sourceRow) {
+                decodeRow(source + (size_t)sourceRow * width * 4, width, decoded);
+                ringRow[slot] = sourceRow;
+            }
+            rows[k] = decoded;
+        }
+        filterRows(rows, kernel, width * 4, column.data());
+        filterTexels(column.data(), width, kernel, outWidth, filtered.data());
+        encodeRow(filtered.data(), outWidth, destination + (size_t)y * outWidth * 4);
+    }
+}
+
+// Source texels weighing into each output texel along one axis, clamped to
+// the image, count per output texel
+struct ResampleTaps {
+    int count;
+    std::vector<int> sources;
+    std::vector<float> weights;
+};
+
+ResampleTaps makeResampleTaps(int size, int outSize) {
+    float scale = (float)size / outSize;
+    float radius = std::max(scale, 1.0f);
+    ResampleTaps taps;
+    taps.count = (int)std::ceil(2.0f * radius) + 1;
+    taps.sources.resize((size_t)outSize * taps.count);
+    taps.weights.resize((size_t)outSize * taps.count);
+
+    for (int o = 0; o < outSize; ++o) {
+        float center = (o + 0.5f) * scale - 0.5f;
+        int first = (int)std::floor(center - radius) + 1;
+        float total = 0.0f;
+        for (int k = 0; k < taps.count; ++k) {
+            float weight = std::max(0.0f, 1.0f - std::fabs(first + k - center) / radius);
+            taps.sources[o * taps.count + k] = std::min(std::max(first + k, 0), size - 1);
+            taps.weights[o * taps.count + k] = weight;
+            total += weight;
+        }
+        for (int k = 0; k < taps.count; ++k)
+            taps.weights[o * taps.count + k] /= total;
+    }
+    return taps;
+}
+
+} // namespace
+
+MipSimd bestMipSimd() {
+#ifdef MIPMAP_AVX2
+    static const bool hasAVX2 = cpuHasAVX2();
+    if (hasAVX2)
+        return MipSimd::AVX2;
+#endif
+#ifdef MIPMAP_SSE2
+    return MipSimd::SSE2;
+#else
+    return MipSimd::Scalar;
+#endif
+}
+
+const char* mipSimdName(MipSimd simd) {
+    return simd == MipSimd::AVX2 ? "AVX2" : simd == MipSimd::SSE2 ? "SSE2" : "scalar";
+}
+
+void buildMipChain(const uint8_t* rgba, int width, int height, MipFilter filter, std::vector<uint8_t>& data,
+                   std::vector<MipLevel>& levels, MipSimd simd) {
+    levels.clear();
+    size_t total = 0;
+    for (int w = width, h = height;; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+        levels.push_back({ w, h, total, (size_t)w * h * 4 });
+        total += (size_t)w * h * 4;
+        if (w == 1 && h == 1)
+            break;
+    }
+    data.resize(total);
+    std::memcpy(data.data(), rgba, levels[0].size);
+
+    FilterRows filterRows = filterRowsScalar;
+    FilterTexels filterTexels = filterTexelsScalar;
+#ifdef MIPMAP_SSE2
+    if (simd == MipSimd::SSE2) {
+        filterRows = filterRowsSSE2;
+        filterTexels = filterTexelsSSE2;
+    }
+#endif
+#ifdef MIPMAP_AVX2
+    if (simd == MipSimd::AVX2) {
+        filterRows = filterRowsAVX2;
+        filterTexels = filterTexelsAVX2;
+    }
+#endif
+
+    // Each level filters the previous one, a 1-texel axis just repeats
+    Kernel kernel = makeKernel(filter);
+    for (size_t level = 1; level < levels.size(); ++level) {
+        const MipLevel& from = levels[level - 1];
+        const MipLevel& to = levels[level];
+        downsampleLevel(&data[from.offset], from.width, from.height, &data[to.offset], to.width, to.height, kernel,
+                        filterRows, filterTexels);
+    }
+}
+
+void resampleImage(const uint8_t* rgba, int width, int height, int outWidth, int outHeight,
+                   std::vector<uint8_t>& out) {
+    ResampleTaps horizontal = makeResampleTaps(width, outWidth);
+    ResampleTaps vertical = makeResampleTaps(height, outHeight);
+
+    // Rows are resized horizontally as they are decoded, then columns combine them
+    std::vector<float> row((size_t)width * 4);
+    std::vector<float> narrow((size_t)height * outWidth * 4);
+    for (int y = 0; y < height; ++y) {
+        decodeRow(rgba + (size_t)y * width * 4, width, row.data());
+        float* destination = &narrow[(size_t)y * outWidth * 4];
+        for (int x = 0; x < outWidth; ++x) {
+            float sum[4] = {};
+            for (int k = 0; k < horizontal.count; ++k) {
+                const float* texel = &row[horizontal.sources[x * horizontal.count + k] * 4];
+                float weight = horizontal.weights[x * horizontal.count + k];
+                for (int c = 0; c < 4; ++c)
+                    sum[c] += weight * texel[c];
+            }
+            std::memcpy(destination + x * 4, sum, sizeof(sum));
+        }
+    }
+
+    out.resize((size_t)outWidth * outHeight * 4);
+    std::vector<float> filtered((size_t)outWidth * 4);
+    for (int y = 0; y < outHeight; ++y) {
+        std::fill(filtered.begin(), filtered.end(), 0.0f);
+        for (int k = 0; k < vertical.count; ++k) {
+            const float* source = &narrow[(size_t)vertical.sources[y * vertical.count + k] * outWidth * 4];
+            float weight = vertical.weights[y * vertical.count + k];
+            for (int i = 0; i < outWidth * 4; ++i)
+                filtered[i] += weight * source[i];
+        }
+        encodeRow(filtered.data(), outWidth, &out[(size_t)y * outWidth * 4]);
+    }
+}
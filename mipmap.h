@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "dds.h"
+
+enum class MipFilter {
+    Box,    // 2x2 average
+    Kaiser, // 8-tap Kaiser-windowed sinc, sharper and with less aliasing
+};
+
+// Instruction sets the filters are written for
+enum class MipSimd {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// Best instruction set this CPU and build support
+MipSimd bestMipSimd();
+const char* mipSimdName(MipSimd simd);
+
+// Builds the full chain of an sRGB RGBA8 image down to 1x1, level 0 included.
+// Filtering happens in linear light, alpha stays linear. Levels are packed
+// back to back in data, described by levels.
+void buildMipChain(const uint8_t* rgba, int width, int height, MipFilter filter, std::vector<uint8_t>& data,
+                   std::vector<MipLevel>& levels, MipSimd simd = bestMipSimd());
+
+// Resamples an sRGB RGBA8 image to outWidth x outHeight in linear light with a
+// tent filter, widened to the scale factor when shrinking
+void resampleImage(const uint8_t* rgba, int width, int height, int outWidth, int outHeight,
+                   std::vector<uint8_t>& out);
@@ -0,0 +1,174 @@
+#include "page_pyramid.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "mipmap.h"
+#include "texture_cache.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char PYRAMID_MAGIC[4] = { 'A', 'G', 'V', 'T' };
+const uint32_t PYRAMID_VERSION = 1;
+
+// Copies one page with its borders out of a level, clamping at the level's edges
+void cutPage(const std::vector<uint8_t>& level, int width, int height, int pageX, int pageY,
+             std::vector<uint8_t>& page) {
+    page.resize((size_t)VIRTUAL_PAGE_STRIDE * VIRTUAL_PAGE_STRIDE * 4);
+    int left = pageX * VIRTUAL_PAGE_SIZE - VIRTUAL_PAGE_BORDER;
+    int bottom = pageY * VIRTUAL_PAGE_SIZE - VIRTUAL_PAGE_BORDER;
+    for (int y = 0; y < VIRTUAL_PAGE_STRIDE; ++y) {
+        int sourceY = std::min(std::max(bottom + y, 0), height - 1);
+        for (int x = 0; x < VIRTUAL_PAGE_STRIDE; ++x) {
+            int sourceX = std::min(std::max(left + x, 0), width - 1);
+            std::memcpy(&page[((size_t)y * VIRTUAL_PAGE_STRIDE + x) * 4], &level[((size_t)sourceY * width + sourceX) * 4],
+                        4);
+        }
+    }
+}
+
+// Halves a level in linear light. Odd sizes repeat their last row or column
+// first, so every texel covers exactly two of the level above.
+void halveLevel(std::vector<uint8_t>& level, int& width, int& height) {
+    int evenWidth = width + (width & 1), evenHeight = height + (height & 1);
+    std::vector<uint8_t> even((size_t)evenWidth * evenHeight * 4);
+    for (int y = 0; y < evenHeight; ++y) {
+        const uint8_t* row = &level[(size_t)std::min(y, height - 1) * width * 4];
+        std::memcpy(&even[(size_t)y * evenWidth * 4], row, (size_t)width * 4);
+        if (evenWidth != width)
+            std::memcpy(&even[((size_t)y * evenWidth + width) * 4], row + (width - 1) * 4, 4);
+    }
+    width = std::max(1, evenWidth / 2);
+    height = std::max(1, evenHeight / 2);
+    resampleImage(even.data(), evenWidth, evenHeight, width, height, level);
+}
+
+} // namespace
+
+std::string pagePyramidPath(const char* sourceDirectory, const char* sourceName) {
+    return (fs::path(sourceDirectory) / TEXTURE_CACHE_DIRECTORY / (fs::path(sourceName).stem().string() + ".agvt"))
+        .string();
+}
+
+bool writePagePyramid(const char* path, const uint8_t* rgba, int width, int height, BlockFormat format) {
+    // Enough pages per side for the longer edge, rounded up to a power of two
+    int pagesNeeded = (std::max(width, height) + VIRTUAL_PAGE_SIZE - 1) / VIRTUAL_PAGE_SIZE;
+    int levelCount = 1;
+    while ((1 << (levelCount - 1)) < pagesNeeded)
+        ++levelCount;
+
+    PagePyramidHeader header = {};
+    std::memcpy(header.magic, PYRAMID_MAGIC, 4);
+    header.version = PYRAMID_VERSION;
+    header.imageWidth = (uint32_t)width;
+    header.imageHeight = (uint32_t)height;
+    header.pageSize = VIRTUAL_PAGE_SIZE;
+    header.pageBorder = VIRTUAL_PAGE_BORDER;
+    header.levelCount = (uint32_t)levelCount;
+    header.format = (uint32_t)format;
+
+    uint32_t pageCount = 0;
+    for (int level = 0; level < levelCount; ++level) {
+        int side = 1 << (levelCount - 1 - level);
+        pageCount += (uint32_t)(side * side);
+    }
+    std::vector<uint64_t> offsets(pageCount, PAGE_ABSENT);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to write page pyramid: " << path << std::endl;
+        return false;
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+
+    // Pages go out level by level, only the current level stays in memory
+    std::vector<uint8_t> level(rgba, rgba + (size_t)width * height * 4);
+    std::vector<uint8_t> page;
+    uint64_t offset = sizeof(header) + offsets.size() * sizeof(uint64_t);
+    uint32_t index = 0;
+    int levelWidth = width, levelHeight = height;
+    for (int l = 0; l < levelCount; ++l) {
+        if (l > 0)
+            halveLevel(level, levelWidth, levelHeight);
+        int side = 1 << (levelCount - 1 - l);
+        for (int y = 0; y < side; ++y) {
+            for (int x = 0; x < side; ++x, ++index) {
+                if (x * VIRTUAL_PAGE_SIZE >= levelWidth || y * VIRTUAL_PAGE_SIZE >= levelHeight)
+                    continue;
+                cutPage(level, levelWidth, levelHeight, x, y, page);
+                std::vector<uint8_t> blocks = compressImage(format, page.data(), VIRTUAL_PAGE_STRIDE, VIRTUAL_PAGE_STRIDE);
+                file.write((const char*)blocks.data(), blocks.size());
+                offsets[index] = offset;
+                offset += blocks.size();
+            }
+        }
+    }
+
+    // Now that every page is placed
+    file.seekp(sizeof(header));
+    file.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+    return (bool)file;
+}
+
+bool openPagePyramid(const char* path, PagePyramid& pyramid) {
+    if (!openMappedFile(path, pyramid.file))
+        return false;
+
+    const MappedFile& file = pyramid.file;
+    const PagePyramidHeader* header = (const PagePyramidHeader*)file.data;
+    bool valid = file.size >= sizeof(PagePyramidHeader) && std::memcmp(header->magic, PYRAMID_MAGIC, 4) == 0 &&
+                 header->version == PYRAMID_VERSION && header->pageSize == VIRTUAL_PAGE_SIZE &&
+                 header->pageBorder == VIRTUAL_PAGE_BORDER && header->levelCount >= 1 && header->levelCount <= 16 &&
+                 header->format <= (uint32_t)BlockFormat::BC7;
+    if (valid) {
+        pyramid.header = header;
+        pyramid.levelFirstPage.clear();
+        pyramid.pageCount = 0;
+        for (int level = 0; level < (int)header->levelCount; ++level) {
+            pyramid.levelFirstPage.push_back(pyramid.pageCount);
+            int side = pyramidPagesPerSide(pyramid, level);
+            pyramid.pageCount += (uint32_t)(side * side);
+        }
+        pyramid.pageOffsets = (const uint64_t*)(file.data + sizeof(PagePyramidHeader));
+        valid = file.size >= sizeof(PagePyramidHeader) + pyramid.pageCount * sizeof(uint64_t);
+        for (uint32_t page = 0; valid && page < pyramid.pageCount; ++page) {
+            uint64_t pageOffset = pyramid.pageOffsets[page];
+            valid = pageOffset == PAGE_ABSENT || pageOffset + pyramidPageBytes(pyramid) <= file.size;
+        }
+    }
+
+    if (!valid) {
+        std::cout << "Ignoring damaged page pyramid: " << path << std::endl;
+        closePagePyramid(pyramid);
+        return false;
+    }
+    return true;
+}
+
+void closePagePyramid(PagePyramid& pyramid) {
+    closeMappedFile(pyramid.file);
+    pyramid = PagePyramid();
+}
+
+int pyramidPagesPerSide(const PagePyramid& pyramid, int level) {
+    return 1 << (pyramid.header->levelCount - 1 - level);
+}
+
+uint32_t pyramidPageIndex(const PagePyramid& pyramid, int level, int x, int y) {
+    return pyramid.levelFirstPage[level] + (uint32_t)(y * pyramidPagesPerSide(pyramid, level) + x);
+}
+
+const uint8_t* pyramidPageData(const PagePyramid& pyramid, uint32_t page) {
+    uint64_t offset = pyramid.pageOffsets[page];
+    return offset == PAGE_ABSENT ? nullptr : pyramid.file.data + offset;
+}
+
+size_t pyramidPageBytes(const PagePyramid& pyramid) {
+    return compressedImageSize((BlockFormat)pyramid.header->format, VIRTUAL_PAGE_STRIDE, VIRTUAL_PAGE_STRIDE);
+}
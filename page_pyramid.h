@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "block_compression.h"
+#include "mapped_file.h"
+
+// Texels of image per page side
+const int VIRTUAL_PAGE_SIZE = 128;
+
+// Texels each page repeats from its neighbours on every side, so bilinear
+// filtering never reads another page. One BC1 block keeps pages block-aligned.
+const int VIRTUAL_PAGE_BORDER = 4;
+
+// Side of a stored page, borders included
+const int VIRTUAL_PAGE_STRIDE = VIRTUAL_PAGE_SIZE + 2 * VIRTUAL_PAGE_BORDER;
+
+// Marks pages wholly outside the image in the page table
+const uint64_t PAGE_ABSENT = ~0ull;
+
+// A very large image cut into block-compressed pages at every mip level, for
+// virtual texturing. Level 0 is a square grid of power-of-two pages per side
+// with the image in its bottom-left corner; every coarser level halves the
+// grid down to one page.
+// On disk: PagePyramidHeader, then one uint64_t file offset per page, finest
+// level first and bottom row first in each, then the pages.
+struct PagePyramidHeader {
+    char magic[4]; // "AGVT"
+    uint32_t version;
+    uint32_t imageWidth;
+    uint32_t imageHeight;
+    uint32_t pageSize;
+    uint32_t pageBorder;
+    uint32_t levelCount;
+    uint32_t format; // BlockFormat
+};
+
+struct PagePyramid {
+    MappedFile file;
+    const PagePyramidHeader* header = nullptr;
+    const uint64_t* pageOffsets = nullptr;
+    std::vector<uint32_t> levelFirstPage; // Index of each level's first page
+    uint32_t pageCount = 0;
+};
+
+// textures/cache/<source stem>.agvt
+std::string pagePyramidPath(const char* sourceDirectory, const char* sourceName);
+
+// Cuts an RGBA8 image, bottom row first, into a pyramid file. Needs the whole
+// image and the level being cut in memory.
+bool writePagePyramid(const char* path, const uint8_t* rgba, int width, int height, BlockFormat format);
+
+// Maps the file and checks its header and page table
+bool openPagePyramid(const char* path, PagePyramid& pyramid);
+void closePagePyramid(PagePyramid& pyramid);
+
+int pyramidPagesPerSide(const PagePyramid& pyramid, int level);
+uint32_t pyramidPageIndex(const PagePyramid& pyramid, int level, int x, int y);
+
+// Blocks of one page inside the mapping, null when absent
+const uint8_t* pyramidPageData(const PagePyramid& pyramid, uint32_t page);
+size_t pyramidPageBytes(const PagePyramid& pyramid);
@@ -0,0 +1,264 @@
+#include "portals.h"
+
+#include <algorithm>
+
+namespace {
+
+const float ROOM_FLOOR = -1.0f;
+const float ROOM_CEILING = 4.0f;
+
+// Tolerance for objects sitting exactly on a room boundary, like the walls
+const float ROOM_EPSILON = 0.01f;
+
+const ScreenRect FULL_SCREEN(-1.0f, -1.0f, 1.0f, 1.0f);
+
+bool containsPoint(const Room& room, glm::vec3 point, float epsilon) {
+    return glm::all(glm::greaterThanEqual(point, room.min - epsilon)) &&
+           glm::all(glm::lessThanEqual(point, room.max + epsilon));
+}
+
+// Vertical doorway at x = const (axis 0) or z = const (axis 2), spanning the room height
+Portal makeDoorway(int roomA, int roomB, int axis, float plane, float from, float to) {
+    Portal portal;
+    portal.rooms[0] = roomA;
+    portal.rooms[1] = roomB;
+    for (int i = 0; i < 4; ++i) {
+        float along = (i == 0 || i == 3) ? from : to;
+        float y = (i < 2) ? ROOM_FLOOR : ROOM_CEILING;
+        portal.corners[i] = axis == 0 ? glm::vec3(plane, y, along) : glm::vec3(along, y, plane);
+    }
+    return portal;
+}
+
+void addPortal(PortalGraph& graph, const Portal& portal) {
+    int index = (int)graph.portals.size();
+    graph.portals.push_back(portal);
+    graph.rooms[portal.rooms[0]].portals.push_back(index);
+    graph.rooms[portal.rooms[1]].portals.push_back(index);
+}
+
+// Clips the portal against the near plane and returns the NDC bounding rectangle
+// of what is left. Returns false when the portal is entirely behind the camera.
+bool projectPortal(const Portal& portal, const glm::mat4& viewProjection, ScreenRect& rect) {
+    glm::vec4 clip[4];
+    for (int i = 0; i < 4; ++i)
+        clip[i] = viewProjection * glm::vec4(portal.corners[i], 1.0f);
+
+    // Sutherland-Hodgman against z >= -w, a quad gains at most one vertex
+    glm::vec4 clipped[5];
+    int count = 0;
+    for (int i = 0; i < 4; ++i) {
+        const glm::vec4& a = clip[i];
+        const glm::vec4& b = clip[(i + 1) % 4];
+        float da = a.z + a.w;
+        float db = b.z + b.w;
+        if (da >= 0.0f)
+            clipped[count++] = a;
+        if ((da >= 0.0f) != (db >= 0.0f))
+            clipped[count++] = a + (b - a) * (da / (da - db));
+    }
+    if (count == 0)
+        return false;
+
+    rect = ScreenRect(1.0f, 1.0f, -1.0f, -1.0f);
+    for (int i = 0; i < count; ++i) {
+        // On the near plane itself w is tiny but positive
+        glm::vec2 ndc = glm::vec2(clipped[i]) / std::max(clipped[i].w, 1e-6f);
+        rect.x = std::min(rect.x, ndc.x);
+        rect.y = std::min(rect.y, ndc.y);
+        rect.z = std::max(rect.z, ndc.x);
+        rect.w = std::max(rect.w, ndc.y);
+    }
+    return true;
+}
+
+ScreenRect intersectRects(const ScreenRect& a, const ScreenRect& b) {
+    return ScreenRect(std::max(a.x, b.x), std::max(a.y, b.y), std::min(a.z, b.z), std::min(a.w, b.w));
+}
+
+bool isEmpty(const ScreenRect& rect) {
+    return rect.x >= rect.z || rect.y >= rect.w;
+}
+
+void copyBounds(SceneBounds& target, size_t to, const SceneBounds& source, size_t from) {
+    target.centerX[to] = source.centerX[from];
+    target.centerY[to] = source.centerY[from];
+    target.centerZ[to] = source.centerZ[from];
+    target.extentX[to] = source.extentX[from];
+    target.extentY[to] = source.extentY[from];
+    target.extentZ[to] = source.extentZ[from];
+    target.radius[to] = source.radius[from];
+}
+
+bool containsRect(const ScreenRect& outer, const ScreenRect& inner) {
+    return outer.x <= inner.x && outer.y <= inner.y && outer.z >= inner.z && outer.w >= inner.w;
+}
+
+} // namespace
+
+PortalGraph buildGalleryPortalGraph(const SceneBounds& bounds) {
+    PortalGraph graph;
+
+    // Hub in the middle, arms reaching 10 units out in every direction
+    graph.rooms.push_back({ "Hub", glm::vec3(-5.0f, ROOM_FLOOR, -5.0f), glm::vec3(5.0f, ROOM_CEILING, 5.0f), {}, 0, 0 });
+    graph.rooms.push_back({ "Right arm", glm::vec3(5.0f, ROOM_FLOOR, -5.0f), glm::vec3(15.0f, ROOM_CEILING, 5.0f), {}, 0, 0 });
+    graph.rooms.push_back({ "Left arm", glm::vec3(-15.0f, ROOM_FLOOR, -5.0f), glm::vec3(-5.0f, ROOM_CEILING, 5.0f), {}, 0, 0 });
+    graph.rooms.push_back({ "Front arm", glm::vec3(-5.0f, ROOM_FLOOR, 5.0f), glm::vec3(5.0f, ROOM_CEILING, 15.0f), {}, 0, 0 });
+    graph.rooms.push_back({ "Back arm", glm::vec3(-5.0f, ROOM_FLOOR, -15.0f), glm::vec3(5.0f, ROOM_CEILING, -5.0f), {}, 0, 0 });
+
+    // Each arm opens onto the hub along its whole width
+    addPortal(graph, makeDoorway(0, 1, 0, 5.0f, -5.0f, 5.0f));
+    addPortal(graph, makeDoorway(0, 2, 0, -5.0f, -5.0f, 5.0f));
+    addPortal(graph, makeDoorway(0, 3, 2, 5.0f, -5.0f, 5.0f));
+    addPortal(graph, makeDoorway(0, 4, 2, -5.0f, -5.0f, 5.0f));
+
+    // Objects on a shared boundary go to the first room containing them
+    size_t objectCount = bounds.centerX.size();
+    std::vector<int> objectRooms(objectCount);
+    for (size_t i = 0; i < objectCount; ++i)
+        objectRooms[i] = findRoom(graph, glm::vec3(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]));
+
+    // Room by room, then the roomless objects
+    for (size_t r = 0; r <= graph.rooms.size(); ++r) {
+        int room = r < graph.rooms.size() ? (int)r : -1;
+        size_t first = graph.objectIds.size();
+        for (unsigned int i = 0; i < objectCount; ++i) {
+            if (objectRooms[i] == room)
+                graph.objectIds.push_back(i);
+        }
+        if (room >= 0) {
+            graph.rooms[r].firstObject = first;
+            graph.rooms[r].objectCount = graph.objectIds.size() - first;
+        }
+        else {
+            graph.roomlessFirst = first;
+        }
+    }
+
+    SceneBounds& grouped = graph.objectBounds;
+    for (std::vector<float>* column : { &grouped.centerX, &grouped.centerY, &grouped.centerZ, &grouped.extentX,
+                                        &grouped.extentY, &grouped.extentZ, &grouped.radius })
+        column->resize(objectCount);
+    graph.objectSlots.resize(objectCount);
+    for (size_t slot = 0; slot < objectCount; ++slot) {
+        graph.objectSlots[graph.objectIds[slot]] = (unsigned int)slot;
+        copyBounds(grouped, slot, bounds, graph.objectIds[slot]);
+    }
+
+    return graph;
+}
+
+void updatePortalBounds(PortalGraph& graph, const SceneBounds& bounds, const std::vector<unsigned int>& objects) {
+    for (unsigned int object : objects)
+        copyBounds(graph.objectBounds, graph.objectSlots[object], bounds, object);
+}
+
+int findRoom(const PortalGraph& graph, glm::vec3 point) {
+    for (size_t i = 0; i < graph.rooms.size(); ++i) {
+        if (containsPoint(graph.rooms[i], point, ROOM_EPSILON))
+            return (int)i;
+    }
+    return -1;
+}
+
+void findVisibleRooms(const PortalGraph& graph, const glm::mat4& viewProjection, glm::vec3 cameraPos,
+                      PortalVisibility& visibility) {
+    size_t roomCount = graph.rooms.size();
+    visibility.roomVisible.assign(roomCount, 0);
+    visibility.roomRects.assign(roomCount, ScreenRect(0.0f));
+    visibility.cameraRoom = findRoom(graph, cameraPos);
+    visibility.portalsTested = 0;
+
+    if (visibility.cameraRoom < 0) {
+        visibility.roomVisible.assign(roomCount, 1);
+        visibility.roomRects.assign(roomCount, FULL_SCREEN);
+        return;
+    }
+
+    struct Visit {
+        int room;
+        int fromPortal;
+        ScreenRect rect;
+    };
+    std::vector<Visit> stack;
+    stack.push_back({ visibility.cameraRoom, -1, FULL_SCREEN });
+
+    while (!stack.empty()) {
+        Visit visit = stack.back();
+        stack.pop_back();
+
+        ScreenRect& roomRect = visibility.roomRects[visit.room];
+        if (visibility.roomVisible[visit.room]) {
+            if (containsRect(roomRect, visit.rect))
+                continue; // Already seen through at least this much of the screen
+            roomRect = ScreenRect(glm::min(glm::vec2(roomRect), glm::vec2(visit.rect)),
+                                  glm::max(glm::vec2(roomRect.z, roomRect.w), glm::vec2(visit.rect.z, visit.rect.w)));
+        }
+        else {
+            roomRect = visit.rect;
+            visibility.roomVisible[visit.room] = 1;
+        }
+
+        for (int portalIndex : graph.rooms[visit.room].portals) {
+            if (portalIndex == visit.fromPortal)
+                continue;
+            const Portal& portal = graph.portals[portalIndex];
+            ++visibility.portalsTested;
+
+            ScreenRect portalRect;
+            if (!projectPortal(portal, viewProjection, portalRect))
+                continue;
+            ScreenRect through = intersectRects(visit.rect, portalRect);
+            if (isEmpty(through))
+                continue;
+
+            int nextRoom = portal.rooms[0] == visit.room ? portal.rooms[1] : portal.rooms[0];
+            stack.push_back({ nextRoom, portalIndex, through });
+        }
+    }
+}
+
+Frustum extractFrustum(const glm::mat4& viewProjection, const ScreenRect& rect) {
+    glm::vec4 row[4];
+    for (int r = 0; r < 4; ++r)
+        row[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+    // x_clip >= minX * w and so on, the full screen gives the usual frustum
+    Frustum frustum;
+    frustum.planes[0] = row[0] - rect.x * row[3];
+    frustum.planes[1] = rect.z * row[3] - row[0];
+    frustum.planes[2] = row[1] - rect.y * row[3];
+    frustum.planes[3] = rect.w * row[3] - row[1];
+    frustum.planes[4] = row[3] + row[2];
+    frustum.planes[5] = row[3] - row[2];
+
+    for (glm::vec4& plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+int cullWithPortals(const PortalGraph& graph, PortalVisibility& visibility, const glm::mat4& viewProjection,
+                    std::vector<uint8_t>& visible) {
+    size_t objectCount = graph.objectIds.size();
+    visibility.objectVisible.assign(objectCount, 0);
+    uint8_t* slotVisible = visibility.objectVisible.data();
+    int visibleCount = 0;
+
+    for (size_t r = 0; r < graph.rooms.size(); ++r) {
+        if (!visibility.roomVisible[r])
+            continue;
+        const Room& room = graph.rooms[r];
+        Frustum frustum = extractFrustum(viewProjection, visibility.roomRects[r]);
+        visibleCount += cullSceneBounds(frustum, graph.objectBounds, room.firstObject, room.objectCount, slotVisible);
+    }
+
+    Frustum frustum = extractFrustum(viewProjection);
+    visibleCount += cullSceneBounds(frustum, graph.objectBounds, graph.roomlessFirst, objectCount - graph.roomlessFirst,
+                                    slotVisible);
+
+    // Back to scene order
+    visible.resize(objectCount);
+    for (size_t i = 0; i < objectCount; ++i)
+        visible[i] = slotVisible[graph.objectSlots[i]];
+    return visibleCount;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "culling.h"
+
+// A convex cell of the gallery, objects are assigned to the room containing
+// their center
+struct Room {
+    const char* name;
+    glm::vec3 min;
+    glm::vec3 max;
+    std::vector<int> portals;
+    size_t firstObject; // Range of PortalGraph::objectBounds
+    size_t objectCount;
+};
+
+// A doorway between two rooms, a planar convex quad
+struct Portal {
+    int rooms[2];
+    glm::vec3 corners[4];
+};
+
+struct PortalGraph {
+    std::vector<Room> rooms;
+    std::vector<Portal> portals;
+
+    // The scene's bounds regrouped so each room's objects are one contiguous
+    // range, culled four at a time. Objects outside every room come last and
+    // are only frustum culled.
+    SceneBounds objectBounds;
+    std::vector<unsigned int> objectIds;   // Scene object of each objectBounds entry
+    std::vector<unsigned int> objectSlots; // objectBounds entry of each scene object
+    size_t roomlessFirst = 0;
+};
+
+// Screen-space rectangle in NDC, (minX, minY, maxX, maxY)
+typedef glm::vec4 ScreenRect;
+
+struct PortalVisibility {
+    std::vector<uint8_t> roomVisible;
+    std::vector<ScreenRect> roomRects; // Part of the screen each room is seen through
+    int cameraRoom = -1;
+    int portalsTested = 0;
+    std::vector<uint8_t> objectVisible; // Per objectBounds entry
+};
+
+// The cross-shaped gallery: a central hub with an arm through each doorway
+PortalGraph buildGalleryPortalGraph(const SceneBounds& bounds);
+
+// Copies the bounds of objects that moved into objectBounds, after
+// updateDynamicBounds. Objects stay in the room they started in.
+void updatePortalBounds(PortalGraph& graph, const SceneBounds& bounds, const std::vector<unsigned int>& objects);
+
+int findRoom(const PortalGraph& graph, glm::vec3 point);
+
+// Flood-fills visibility from the camera's room, shrinking the screen rectangle
+// through every portal. A room is revisited only if it is reached through a
+// larger part of the screen, which keeps the traversal linear in practice.
+// When the camera is outside every room all rooms are visible.
+void findVisibleRooms(const PortalGraph& graph, const glm::mat4& viewProjection, glm::vec3 cameraPos,
+                      PortalVisibility& visibility);
+
+// Frustum planes restricted to a screen rectangle
+Frustum extractFrustum(const glm::mat4& viewProjection, const ScreenRect& rect);
+
+// Marks objects visible when their room is visible and their bounds intersect
+// the frustum narrowed to that room's rectangle, one SIMD cullSceneBounds per
+// visible room. visible is indexed by scene object. Returns the visible count.
+int cullWithPortals(const PortalGraph& graph, PortalVisibility& visibility, const glm::mat4& viewProjection,
+                    std::vector<uint8_t>& visible);
@@ -0,0 +1,189 @@
+#include "program_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// From GL 4.1 and ARB_get_program_binary, which the GL 3.3 core loader does not include
+const GLenum PROGRAM_BINARY_RETRIEVABLE_HINT = 0x8257;
+const GLenum PROGRAM_BINARY_LENGTH = 0x8741;
+const GLenum NUM_PROGRAM_BINARY_FORMATS = 0x87FE;
+
+typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length,
+                                              GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary,
+                                           GLsizei length);
+typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+const char CACHE_MAGIC[4] = { 'A', 'G', 'P', 'B' };
+const uint32_t CACHE_VERSION = 1;
+
+// On disk: this header, then the binary
+struct CachedProgramHeader {
+    char magic[4]; // "AGPB"
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t driverHash;
+    uint32_t binaryFormat;
+    uint32_t binaryLength;
+};
+
+struct ProgramCache {
+    GetProgramBinaryProc getProgramBinary = nullptr;
+    ProgramBinaryProc programBinary = nullptr;
+    ProgramParameteriProc programParameteri = nullptr;
+    fs::path directory;
+    uint64_t driverHash = 0;
+};
+
+ProgramCache cache;
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t hashString(const char* text, uint64_t hash) {
+    // The terminator too, so "ab" + "c" and "a" + "bc" differ
+    return hashBytes(text ? text : "", text ? std::strlen(text) + 1 : 1, hash);
+}
+
+uint64_t hashSources(const std::string& vertexSource, const std::string& fragmentSource) {
+    return hashString(fragmentSource.c_str(), hashString(vertexSource.c_str(), 0xcbf29ce484222325ull));
+}
+
+bool supportsProgramBinary() {
+    if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1))
+        return true;
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; ++i) {
+        if (std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_get_program_binary") == 0)
+            return true;
+    }
+    return false;
+}
+
+fs::path entryPath(uint64_t sourceHash) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)sourceHash);
+    return cache.directory / name;
+}
+
+} // namespace
+
+void initProgramCache(GLADloadproc load, const char* directory) {
+    cache = ProgramCache();
+    int formatCount = 0;
+    if (supportsProgramBinary())
+        glGetIntegerv(NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount == 0) {
+        std::cout << "Program binaries not supported by the driver, shaders are compiled every run" << std::endl;
+        return;
+    }
+
+    cache.getProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+    cache.programBinary = (ProgramBinaryProc)load("glProgramBinary");
+    cache.programParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+    if (!cache.getProgramBinary || !cache.programBinary || !cache.programParameteri) {
+        cache = ProgramCache();
+        return;
+    }
+
+    // A driver update changes the binary format without telling
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = hashString((const char*)glGetString(GL_VENDOR), hash);
+    hash = hashString((const char*)glGetString(GL_RENDERER), hash);
+    hash = hashString((const char*)glGetString(GL_VERSION), hash);
+    cache.driverHash = hash;
+    cache.directory = directory;
+}
+
+bool isProgramCacheEnabled() {
+    return cache.programBinary != nullptr;
+}
+
+unsigned int loadCachedProgram(const std::string& vertexSource, const std::string& fragmentSource) {
+    if (!isProgramCacheEnabled())
+        return 0;
+
+    uint64_t sourceHash = hashSources(vertexSource, fragmentSource);
+    std::ifstream file(entryPath(sourceHash), std::ios::binary);
+    if (!file)
+        return 0;
+    CachedProgramHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, CACHE_MAGIC, 4) != 0 ||
+        header.version != CACHE_VERSION || header.sourceHash != sourceHash || header.driverHash != cache.driverHash)
+        return 0;
+    std::vector<char> binary(header.binaryLength);
+    if (!file.read(binary.data(), binary.size()))
+        return 0;
+
+    unsigned int program = glCreateProgram();
+    cache.programBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void prepareCachedProgram(unsigned int program) {
+    if (isProgramCacheEnabled())
+        cache.programParameteri(program, PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void storeCachedProgram(unsigned int program, const std::string& vertexSource, const std::string& fragmentSource) {
+    if (!isProgramCacheEnabled())
+        return;
+
+    int length = 0;
+    glGetProgramiv(program, PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum binaryFormat = 0;
+    cache.getProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+    CachedProgramHeader header = {};
+    std::memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.sourceHash = hashSources(vertexSource, fragmentSource);
+    header.driverHash = cache.driverHash;
+    header.binaryFormat = binaryFormat;
+    header.binaryLength = (uint32_t)length;
+
+    // Written aside and renamed, so a crash never leaves half an entry
+    std::error_code error;
+    fs::create_directories(cache.directory, error);
+    fs::path path = entryPath(header.sourceHash);
+    fs::path temporaryPath = path;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), length);
+        if (!file) {
+            std::cout << "Failed to write program binary: " << temporaryPath.string() << std::endl;
+            return;
+        }
+    }
+    fs::rename(temporaryPath, path, error);
+    if (error)
+        std::cout << "Failed to write program binary: " << path.string() << std::endl;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+
+// Where linked program binaries are kept, relative to the working directory
+const char* const PROGRAM_CACHE_DIRECTORY = "shader_cache";
+
+// Linked programs saved with glGetProgramBinary, one file per pair of
+// sources, and loaded back with glProgramBinary on later runs. An entry is
+// used only when the hash of its sources and of the driver's vendor,
+// renderer and version strings both match; otherwise, or when the driver
+// rejects the binary, the program is compiled and the entry replaced.
+//
+// Needs GL 4.1 or ARB_get_program_binary. The loader only covers 3.3, so the
+// entry points come from the same proc address function glad was loaded with.
+// Call once after gladLoadGLLoader; without it every program is compiled.
+void initProgramCache(GLADloadproc load, const char* directory = PROGRAM_CACHE_DIRECTORY);
+bool isProgramCacheEnabled();
+
+// A linked program for these sources from the cache, 0 when there is none
+// that this driver accepts
+unsigned int loadCachedProgram(const std::string& vertexSource, const std::string& fragmentSource);
+
+// Call on a new program before linking, so the driver keeps its binary
+void prepareCachedProgram(unsigned int program);
+
+// Saves a successfully linked program for the next run
+void storeCachedProgram(unsigned int program, const std::string& vertexSource, const std::string& fragmentSource);
@@ -0,0 +1,93 @@
+#include "render_queue.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+
+uint64_t makeSortKey(unsigned int program, unsigned int vao, unsigned int texture, unsigned int depthBucket) {
+    return ((uint64_t)(program & 0xFFFF) << 48) | ((uint64_t)(vao & 0xFFFF) << 32) |
+           ((uint64_t)(texture & 0xFFFF) << 16) | (uint64_t)(depthBucket & 0xFFFF);
+}
+
+unsigned int depthBucket(float distance, float maxDistance) {
+    float normalized = std::min(std::max(distance / maxDistance, 0.0f), 1.0f);
+    return (unsigned int)(normalized * 0xFFFF);
+}
+
+void clearRenderQueue(RenderQueue& queue) {
+    queue.items.clear();
+}
+
+void submitRenderItem(RenderQueue& queue, uint64_t key, uint32_t object, unsigned int program, unsigned int texture) {
+    queue.items.push_back({ key, object, program, texture });
+}
+
+void sortRenderQueue(RenderQueue& queue) {
+    size_t count = queue.items.size();
+    if (count < 2)
+        return;
+
+    queue.scratch.resize(count);
+    RenderItem* source = queue.items.data();
+    RenderItem* target = queue.scratch.data();
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = {};
+        for (size_t i = 0; i < count; ++i)
+            ++histogram[(source[i].key >> shift) & 0xFF];
+
+        // Every key has the same byte here, the pass would not move anything
+        if (histogram[(source[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        size_t offset = 0;
+        for (size_t& bucket : histogram) {
+            size_t bucketCount = bucket;
+            bucket = offset;
+            offset += bucketCount;
+        }
+        for (size_t i = 0; i < count; ++i)
+            target[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+
+        std::swap(source, target);
+    }
+
+    if (source != queue.items.data())
+        queue.items.swap(queue.scratch);
+}
+
+void resetRenderState(RenderStateTracker& tracker) {
+    tracker.program = 0;
+    tracker.vao = 0;
+    tracker.texture = 0;
+    tracker.stats = RenderStats();
+}
+
+void bindProgram(RenderStateTracker& tracker, unsigned int program) {
+    if (tracker.program == program) {
+        ++tracker.stats.redundantBindsSkipped;
+        return;
+    }
+    glUseProgram(program);
+    tracker.program = program;
+    ++tracker.stats.programBinds;
+}
+
+void bindVertexArray(RenderStateTracker& tracker, unsigned int vao) {
+    if (tracker.vao == vao) {
+        ++tracker.stats.redundantBindsSkipped;
+        return;
+    }
+    glBindVertexArray(vao);
+    tracker.vao = vao;
+    ++tracker.stats.vaoBinds;
+}
+
+void bindTexture2D(RenderStateTracker& tracker, unsigned int texture) {
+    if (tracker.texture == texture) {
+        ++tracker.stats.redundantBindsSkipped;
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    tracker.texture = texture;
+    ++tracker.stats.textureBinds;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Draw submission with a 64-bit sort key and the scene object as payload.
+// Key layout, most significant first, 16 bits each:
+//   program | VAO | texture | depth bucket
+// so sorting groups draws by the most expensive state first and orders each
+// group front to back. The key keeps only the low 16 bits of each GL name, so
+// it is used for ordering alone: the full names travel with the item.
+struct RenderItem {
+    uint64_t key;
+    uint32_t object;
+    unsigned int program;
+    unsigned int texture;
+};
+
+struct RenderQueue {
+    std::vector<RenderItem> items;
+    std::vector<RenderItem> scratch; // Radix sort ping-pong buffer
+};
+
+const int DEPTH_BUCKET_BITS = 16;
+const uint64_t STATE_KEY_MASK = ~((1ull << DEPTH_BUCKET_BITS) - 1);
+
+uint64_t makeSortKey(unsigned int program, unsigned int vao, unsigned int texture, unsigned int depthBucket);
+
+// Maps a view distance in [0, maxDistance] onto a depth bucket
+unsigned int depthBucket(float distance, float maxDistance);
+
+void clearRenderQueue(RenderQueue& queue);
+void submitRenderItem(RenderQueue& queue, uint64_t key, uint32_t object, unsigned int program, unsigned int texture);
+
+// LSD radix sort on the key, skipping byte passes where all keys agree
+void sortRenderQueue(RenderQueue& queue);
+
+// Bind calls and draws issued during one frame
+struct RenderStats {
+    int drawCalls = 0;
+    int instances = 0;
+    int programBinds = 0;
+    int vaoBinds = 0;
+    int textureBinds = 0;
+    int redundantBindsSkipped = 0;
+};
+
+// Remembers the bound program, VAO and texture so repeated binds are elided
+struct RenderStateTracker {
+    unsigned int program = 0;
+    unsigned int vao = 0;
+    unsigned int texture = 0;
+    RenderStats stats;
+};
+
+// Forgets the bound state and clears the stats, call at the start of a frame
+void resetRenderState(RenderStateTracker& tracker);
+void bindProgram(RenderStateTracker& tracker, unsigned int program);
+void bindVertexArray(RenderStateTracker& tracker, unsigned int vao);
+void bindTexture2D(RenderStateTracker& tracker, unsigned int texture);
@@ -0,0 +1,666 @@
+#include "renderer.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// Largest diameter in pixels each texture covers among the visible objects,
+// from their bounding spheres at the distance of their nearest point
+void measureTextureScreenSizes(GalleryRenderer& renderer, const Camera& camera, const glm::mat4& projection) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    // Pixels per world unit at distance 1
+    float pixelsPerUnit = projection[1][1] * 0.5f * viewport[3];
+
+    std::fill(renderer.textureScreenSizes, renderer.textureScreenSizes + (int)TextureId::Count, 0.0f);
+    const SceneBounds& bounds = renderer.sceneBounds;
+    for (size_t i = 0; i < renderer.scene.objects.size(); ++i) {
+        if (!renderer.visibleObjects[i])
+            continue;
+        glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+        float distance = std::max(glm::length(center - camera.position) - bounds.radius[i], 0.1f);
+        float size = 2.0f * bounds.radius[i] * pixelsPerUnit / distance;
+        float& textureSize = renderer.textureScreenSizes[(int)renderer.scene.objects[i].texture];
+        textureSize = std::max(textureSize, size);
+    }
+}
+
+// The painting array and virtual texture stay bound to their own units,
+// batches only switch unit 0
+const int PAINTING_ARRAY_UNIT = 1;
+const int VIRTUAL_CACHE_UNIT = 2;
+const int VIRTUAL_INDIRECTION_UNIT = 3;
+const int LIGHT_CLUSTER_UNIT = 4; // Lights, ranges and indices on units 4-6
+const int DEFERRED_UNIT = 7;      // G-buffer and tile lists on units 7-11
+const int LIGHTMAP_UNIT = 12;
+const int SHADOW_UNIT = 13;
+const int PROBE_UNIT = 14;
+
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+
+void requestPainting(GalleryRenderer& renderer, TextureId id) {
+    TextureLoader& loader = *renderer.textureLoader;
+    const char* path = textureSourcePath(id);
+    if (renderer.virtualTexture && id == TextureId::Painting1) {
+        renderer.textures[(int)id] = loader.placeholder;
+    }
+    else if (renderer.paintingArray) {
+        renderer.textures[(int)id] = loader.placeholder;
+        renderer.paintingLayers[(int)id] = requestTextureLayer(loader, path, *renderer.paintingArray);
+    }
+    else {
+        renderer.textures[(int)id] = requestTexture(loader, path, (int)id);
+    }
+}
+
+// Indices, four bits each, of the lights whose bounding sphere overlaps a box
+uint32_t lightsReachingBox(const std::vector<PointLight>& lights, glm::vec3 center, glm::vec3 extent, int& count) {
+    int lightCount = std::min((int)lights.size(), MAX_FRAME_LIGHTS);
+    uint32_t indices = 0;
+    count = 0;
+    for (int light = 0; light < lightCount; ++light) {
+        glm::vec4 sphere = lightBounds(lights[light]);
+        glm::vec3 sphereCenter(sphere);
+        glm::vec3 offset = sphereCenter - glm::clamp(sphereCenter, center - extent, center + extent);
+        if (glm::dot(offset, offset) <= sphere.w * sphere.w)
+            indices |= (uint32_t)light << (4 * count++);
+    }
+    return indices;
+}
+
+// Lights that can reach each visible object: those whose bounding sphere
+// overlaps its AABB. Draws are compiled for that many lights and read their
+// indices from the instance.
+void assignObjectLights(GalleryRenderer& renderer) {
+    const SceneBounds& bounds = renderer.sceneBounds;
+    renderer.objectLights.assign(renderer.scene.objects.size(), 0);
+    renderer.objectLightCounts.assign(renderer.scene.objects.size(), 0);
+    for (size_t i = 0; i < renderer.scene.objects.size(); ++i) {
+        if (!renderer.visibleObjects[i])
+            continue;
+        glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+        glm::vec3 extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+        int count;
+        uint32_t indices = lightsReachingBox(renderer.scene.lights, center, extent, count);
+        renderer.objectLights[i] = indices;
+        renderer.objectLightCounts[i] = (uint8_t)count;
+    }
+}
+
+// Maps the painting's UVs onto the image in the pyramid's square page grid
+void setVirtualTextureUniforms(const ShaderProgram& shader, const VirtualTexture& texture) {
+    const PagePyramidHeader& header = *texture.pyramid.header;
+    float pages = (float)(1 << (header.levelCount - 1));
+    float levelZeroSide = pages * VIRTUAL_PAGE_SIZE;
+    glUniform1i(shader.location(shader.handle("virtualCache")), VIRTUAL_CACHE_UNIT);
+    glUniform1i(shader.location(shader.handle("virtualIndirection")), VIRTUAL_INDIRECTION_UNIT);
+    glUniform2f(shader.location(shader.handle("virtualUvScale")), header.imageWidth / levelZeroSide,
+                header.imageHeight / levelZeroSide);
+    glUniform1f(shader.location(shader.handle("virtualPages")), pages);
+    glUniform1f(shader.location(shader.handle("virtualMaxLevel")), (float)(header.levelCount - 1));
+    glUniform1f(shader.location(shader.handle("virtualCacheSize")), (float)(VIRTUAL_CACHE_PAGES * VIRTUAL_PAGE_STRIDE));
+}
+
+// Texture units and virtual texture constants of a newly built variant
+void setupShaderVariant(GalleryRenderer& renderer, const ShaderPermutation& permutation, const ShaderProgram& program) {
+    glUseProgram(program.id);
+    glUniform1i(program.location(program.handle("texture1")), 0);
+    glUniform1i(program.location(program.handle("paintings")), PAINTING_ARRAY_UNIT);
+    if (renderer.virtualTexture && (permutation.features & (SHADER_VIRTUAL_TEXTURE | SHADER_VIRTUAL_FEEDBACK)))
+        setVirtualTextureUniforms(program, *renderer.virtualTexture);
+    if (permutation.features & SHADER_CLUSTERED_LIGHTS) {
+        glUniform1i(program.location(program.handle("clusterLights")), LIGHT_CLUSTER_UNIT);
+        glUniform1i(program.location(program.handle("clusterRanges")), LIGHT_CLUSTER_UNIT + 1);
+        glUniform1i(program.location(program.handle("clusterLightIndices")), LIGHT_CLUSTER_UNIT + 2);
+        glm::vec4 scale = renderer.clusterScale;
+        glUniform4f(program.location(program.handle("clusterScale")), scale.x, scale.y, scale.z, scale.w);
+    }
+    if (permutation.features & SHADER_LIGHTMAP) {
+        glUniform1i(program.location(program.handle("lightmap")), LIGHTMAP_UNIT);
+        glUniform2f(program.location(program.handle("lightmapSize")), renderer.lightmapSize.x,
+                    renderer.lightmapSize.y);
+    }
+    if (permutation.features & SHADER_SHADOWS) {
+        const ShadowAtlas& atlas = *renderer.shadowAtlas;
+        glUniform1i(program.location(program.handle("shadowAtlas")), SHADOW_UNIT);
+        glUniformMatrix4fv(program.location(program.handle("shadowMatrices")),
+                           (GLsizei)atlas.faceAtlasMatrices.size(), GL_FALSE, &atlas.faceAtlasMatrices[0][0][0]);
+        glUniform1i(program.location(program.handle("shadowLightCount")), atlas.lightCount);
+        glUniform2f(program.location(program.handle("shadowTileSize")), 1.0f / SHADOW_CUBE_FACES,
+                    1.0f / atlas.lightCount);
+        glUniform2f(program.location(program.handle("shadowTexel")), 1.0f / atlas.width, 1.0f / atlas.height);
+    }
+    if (permutation.features & SHADER_PROBES) {
+        const ProbeGrid& grid = renderer.probeGrid;
+        glUniform1i(program.location(program.handle("probes")), PROBE_UNIT);
+        glUniform3f(program.location(program.handle("probeOrigin")), grid.origin.x, grid.origin.y, grid.origin.z);
+        glUniform3f(program.location(program.handle("probeSpacing")), grid.spacing.x, grid.spacing.y,
+                    grid.spacing.z);
+        glUniform3f(program.location(program.handle("probeCounts")), (float)grid.counts.x, (float)grid.counts.y,
+                    (float)grid.counts.z);
+    }
+}
+
+// Builds a variant unless it already exists
+void buildShaderVariant(GalleryRenderer& renderer, const ShaderPermutation& permutation) {
+    if (findShaderPermutation(renderer.shaders, permutation))
+        return;
+    ShaderProgram& built = buildShaderPermutation(renderer.shaders, permutation);
+    setupShaderVariant(renderer, permutation, built);
+}
+
+// Every variant a draw can ask for, so none is compiled, linked or has its
+// uniforms looked up mid-frame. Both shading paths are covered, as deferred
+// shading can be switched on and off at any frame.
+void buildShaderVariants(GalleryRenderer& renderer) {
+    const Scene& scene = renderer.scene;
+    const SceneBounds& bounds = renderer.sceneBounds;
+    if (renderer.virtualTexture)
+        buildShaderVariant(renderer, { 0, SHADER_VIRTUAL_FEEDBACK });
+    for (size_t i = 0; i < scene.objects.size(); ++i) {
+        const SceneObject& object = scene.objects[i];
+        // Paintings sample the placeholder until their array layer is uploaded
+        uint32_t sources[2] = { 0u, 0u };
+        int sourceCount = 1;
+        if (renderer.virtualTexture && object.texture == TextureId::Painting1)
+            sources[0] = SHADER_VIRTUAL_TEXTURE;
+        else if (renderer.paintingArray && renderer.paintingLayers[(int)object.texture] >= 0)
+            sources[sourceCount++] = SHADER_PAINTING_ARRAY;
+
+        bool lightmapped = renderer.lightmapTexture && renderer.objectLightmapCharts[i].z > 0.0f;
+        uint32_t forward = lightmapped                  ? (uint32_t)SHADER_LIGHTMAP
+                           : renderer.clusteredLights ? (uint32_t)SHADER_CLUSTERED_LIGHTS
+                                                      : 0u;
+        if (renderer.shadowAtlas && !object.castsShadows)
+            forward |= SHADER_SHADOWS;
+        if (renderer.probeTexture && !lightmapped)
+            forward |= SHADER_PROBES;
+
+        // A static object always reaches the same lights. A moving one reaches
+        // any number of those around its bounding sphere, whose cube holds
+        // its AABB however it turns.
+        int minLights = 0;
+        int maxLights = 0;
+        if (!lightmapped && !renderer.clusteredLights) {
+            glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+            glm::vec3 extent = object.dynamic ? glm::vec3(bounds.radius[i])
+                                              : glm::vec3(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+            lightsReachingBox(scene.lights, center, extent, maxLights);
+            minLights = object.dynamic ? 0 : maxLights;
+        }
+        for (int source = 0; source < sourceCount; ++source) {
+            buildShaderVariant(renderer, { 0, sources[source] | SHADER_GBUFFER });
+            for (int lights = minLights; lights <= maxLights; ++lights)
+                buildShaderVariant(renderer, { lights, sources[source] | forward });
+        }
+    }
+}
+
+// A variant of the gallery shader, all of them built with the renderer
+const ShaderProgram& shaderVariant(GalleryRenderer& renderer, const ShaderPermutation& permutation) {
+    ShaderProgram* program = findShaderPermutation(renderer.shaders, permutation);
+    if (program)
+        return *program;
+
+    // Still drawn correctly, but the build stalls this frame
+    std::cout << "ERROR::RENDERER::SHADER_VARIANT_NOT_PREBUILT lights " << permutation.lightCount << " features "
+              << permutation.features << std::endl;
+    ShaderProgram& built = buildShaderPermutation(renderer.shaders, permutation);
+    setupShaderVariant(renderer, permutation, built);
+    return built;
+}
+
+// Bins the lights into this view's clusters and uploads the lists. Objects
+// carry no light indices, every one of them is drawn with a clustered variant.
+void updateLightClusters(GalleryRenderer& renderer, const glm::mat4& view, const Camera& camera) {
+    ClusterFrustum frustum = { view, glm::radians(camera.fov), camera.aspect, NEAR_PLANE, FAR_PLANE };
+    buildLightClusters(*renderer.lightClusterBuilder, renderer.scene.lights, frustum);
+    uploadLightClusters(renderer.lightClusterBuffers, *renderer.lightClusterBuilder);
+    renderer.objectLights.assign(renderer.scene.objects.size(), 0);
+    renderer.objectLightCounts.assign(renderer.scene.objects.size(), 0);
+
+    // Tiles follow the viewport, variants built so far learn of a new size
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glm::vec4 scale = lightClusterScale(frustum, viewport[2], viewport[3]);
+    if (scale != renderer.clusterScale) {
+        renderer.clusterScale = scale;
+        for (const auto& entry : renderer.shaders.programs) {
+            if (permutationFromKey(entry.first).features & SHADER_CLUSTERED_LIGHTS) {
+                glUseProgram(entry.second.id);
+                glUniform4f(entry.second.location(entry.second.handle("clusterScale")), scale.x, scale.y, scale.z,
+                            scale.w);
+            }
+        }
+    }
+}
+
+// An indexed mesh in a VAO of its own: position, texture coordinates and
+// lightmap chart interleaved, with the index buffer bound in the VAO
+Mesh createMesh(const MeshData& data) {
+    Mesh mesh;
+    glGenVertexArrays(1, &mesh.vao);
+    glGenBuffers(1, &mesh.vertexBuffer);
+    glGenBuffers(1, &mesh.indexBuffer);
+    glBindVertexArray(mesh.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, data.vertices.size() * sizeof(float), data.vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    int vertexCount = (int)data.vertices.size() / MESH_VERTEX_FLOATS;
+    if (vertexCount <= MESH_MAX_SHORT_INDEXED_VERTICES) {
+        std::vector<uint16_t> indices(data.indices.begin(), data.indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+        mesh.indexType = GL_UNSIGNED_SHORT;
+    }
+    else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(uint32_t), data.indices.data(),
+                     GL_STATIC_DRAW);
+        mesh.indexType = GL_UNSIGNED_INT;
+    }
+
+    const int stride = MESH_VERTEX_FLOATS * sizeof(float);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(LIGHTMAP_CHART_LOCATION, 4, GL_FLOAT, GL_FALSE, stride, (void*)(5 * sizeof(float)));
+    glEnableVertexAttribArray(LIGHTMAP_CHART_LOCATION);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    mesh.indexCount = (int)data.indices.size();
+    return mesh;
+}
+
+// Uploads the baked lightmap if it was baked for this very scene. Without
+// one, static objects are lit by the lights like the rest.
+void loadLightmap(GalleryRenderer& renderer) {
+    Lightmap lightmap;
+    if (!readLightmap(LIGHTMAP_PATH, lightmap))
+        return;
+    if (lightmap.sceneHash != lightmapSceneHash(renderer.scene) ||
+        lightmap.charts.size() != renderer.scene.objects.size()) {
+        std::cout << "Lightmap " << LIGHTMAP_PATH << " was baked for another scene or lights, rebake it with the "
+                  << "Lightmap Baker" << std::endl;
+        return;
+    }
+
+    // No mip levels, they would blend neighbouring cells
+    glGenTextures(1, &renderer.lightmapTexture);
+    glActiveTexture(GL_TEXTURE0 + LIGHTMAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D, renderer.lightmapTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, lightmap.width, lightmap.height, 0, GL_RGB, GL_HALF_FLOAT,
+                 lightmap.texels.data());
+    glActiveTexture(GL_TEXTURE0);
+
+    renderer.lightmapSize = glm::vec2(lightmap.width, lightmap.height);
+    for (size_t i = 0; i < lightmap.charts.size(); ++i) {
+        const LightmapChart& chart = lightmap.charts[i];
+        renderer.objectLightmapCharts[i] = glm::vec3(chart.x, chart.y, chart.cellSize);
+    }
+}
+
+// Uploads the baked probes if they were baked for this very scene. Without
+// them, ambient light stays a constant share of each surface's colour.
+void loadProbes(GalleryRenderer& renderer) {
+    ProbeVolume volume;
+    if (!readProbeVolume(PROBE_PATH, volume))
+        return;
+    if (volume.sceneHash != lightmapSceneHash(renderer.scene)) {
+        std::cout << "Probes " << PROBE_PATH << " were baked for another scene or lights, rebake them with the "
+                  << "Lightmap Baker" << std::endl;
+        return;
+    }
+
+    glm::ivec3 counts = volume.grid.counts;
+    std::vector<uint16_t> texels = probeTextureTexels(volume);
+    glGenTextures(1, &renderer.probeTexture);
+    glActiveTexture(GL_TEXTURE0 + PROBE_UNIT);
+    glBindTexture(GL_TEXTURE_3D, renderer.probeTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, counts.x, counts.y, counts.z * PROBE_TEXTURE_SLABS, 0, GL_RGBA,
+                 GL_HALF_FLOAT, texels.data());
+    glActiveTexture(GL_TEXTURE0);
+    renderer.probeGrid = volume.grid;
+}
+
+} // namespace
+
+GalleryRenderer createGalleryRenderer(const RendererOptions& options) {
+    GalleryRenderer renderer;
+
+    glEnable(GL_DEPTH_TEST);
+
+    // Shader variants are compiled, or loaded from the program cache, once the scene is known
+    renderer.shaders = createShaderPermutations("shader.vert", "shader.frag");
+    renderer.shaderReloader = nullptr;
+    if (options.shaderReloadContext)
+        renderer.shaderReloader = createShaderReloader(renderer.shaders, options.shaderReloadContext);
+
+    // Load textures, indexed by TextureId, in the background
+    std::string archivePath = textureArchivePath("textures");
+    renderer.textureLoader = createTextureLoader(options.textureCache ? archivePath.c_str() : nullptr,
+                                                 options.textureBudgetBytes);
+    TextureLoader& loader = *renderer.textureLoader;
+    for (TextureId id : { TextureId::Wall, TextureId::Floor, TextureId::Ceiling, TextureId::Cube })
+        renderer.textures[(int)id] = requestTexture(loader, textureSourcePath(id), (int)id);
+
+    // Paintings go into layers of one texture array, so all of them in view are one draw
+    renderer.paintingArray = nullptr;
+    if (options.paintingArray)
+        renderer.paintingArray = createTextureArray(PAINTING_LAYER_WIDTH, PAINTING_LAYER_HEIGHT, PAINTING_ARRAY_CAPACITY);
+    std::fill(renderer.paintingLayers, renderer.paintingLayers + (int)TextureId::Count, -1);
+
+    // A painting cooked into a page pyramid only keeps the pages in view resident
+    renderer.virtualTexture = nullptr;
+    if (options.virtualTextures) {
+        std::string pyramidPath = pagePyramidPath("textures", "painting.png");
+        renderer.virtualTexture = openVirtualTexture(pyramidPath.c_str(), loader.supportsBC1BC3, loader.supportsBC7);
+    }
+    requestPainting(renderer, TextureId::Painting1);
+    requestPainting(renderer, TextureId::Painting2);
+    requestPainting(renderer, TextureId::Painting3);
+    requestPainting(renderer, TextureId::Painting4);
+
+    if (renderer.virtualTexture)
+        bindVirtualTexture(*renderer.virtualTexture, VIRTUAL_CACHE_UNIT, VIRTUAL_INDIRECTION_UNIT);
+
+    // Walls and paintings are thin boxes and share the cube's geometry. Both
+    // meshes are indexed and reordered for the post-transform cache here.
+    for (int mesh = 0; mesh < (int)MeshId::Count; ++mesh) {
+        MeshData data = buildGalleryMesh((MeshId)mesh, renderer.meshStats[mesh]);
+        renderer.meshes[mesh] = createMesh(data);
+    }
+
+    // Draws are sorted by state, then consecutive equal-state items become instanced batches
+    renderer.batcher = createInstanceBatcher();
+    for (const Mesh& mesh : renderer.meshes)
+        enableInstanceAttributes(mesh.vao);
+
+    // Static model matrices are computed once here
+    renderer.scene = buildGalleryScene();
+
+    // World bounds for frustum culling, static entries never change
+    renderer.sceneBounds = buildSceneBounds(renderer.scene);
+
+    // Rooms and doorways, so geometry behind walls is never submitted
+    renderer.portalGraph = buildGalleryPortalGraph(renderer.sceneBounds);
+
+    // Benchmarks light the gallery with many more lights than it has
+    if (options.lightCount > 0)
+        addScatteredLights(renderer.scene, options.lightCount);
+
+    // Camera and lights reach every program through one ring-buffered UBO
+    renderer.frameUniforms = createFrameUniformBuffer();
+    renderer.lightBlock = makeLightBlock(renderer.scene.lights);
+
+    // More lights than instances can index are binned into view space
+    // clusters every frame, and each fragment applies its cluster's lights
+    renderer.clusteredLights = options.clusteredLights || (int)renderer.scene.lights.size() > MAX_FRAME_LIGHTS;
+    renderer.lightClusterBuilder = nullptr;
+    renderer.clusterScale = glm::vec4(0.0f);
+    if (renderer.clusteredLights) {
+        renderer.lightClusterBuilder = createLightClusterBuilder();
+        renderer.lightClusterBuffers = createLightClusterBuffers();
+        uploadClusterLights(renderer.lightClusterBuffers, renderer.scene.lights);
+        bindLightClusterBuffers(renderer.lightClusterBuffers, LIGHT_CLUSTER_UNIT);
+    }
+    // Its G-buffer is only allocated once a frame is shaded deferred
+    renderer.deferredShading = options.deferredShading;
+    renderer.deferred = createDeferredRenderer(renderer.scene.lights, DEFERRED_UNIT);
+
+    // Static objects read their light, bounces included, from one texture
+    // baked offline for exactly these objects and lights
+    renderer.lightmapTexture = 0;
+    renderer.lightmapSize = glm::vec2(0.0f);
+    renderer.objectLightmapCharts.assign(renderer.scene.objects.size(), glm::vec3(0.0f));
+    if (options.lightmap && !options.shadows)
+        loadLightmap(renderer);
+
+    // Ambient light of everything lit in real time comes from probes baked
+    // with the lightmap
+    renderer.probeTexture = 0;
+    if (options.probes)
+        loadProbes(renderer);
+
+    // Depth of the static casters is drawn once here for every shadowed
+    // light. The lightmap was baked without shadows, so it is left out.
+    renderer.shadowAtlas = nullptr;
+    if (options.shadows) {
+        int shadowLights = std::min((int)renderer.scene.lights.size(), MAX_FRAME_LIGHTS);
+        renderer.shadowAtlas =
+            createShadowAtlas(renderer.scene, renderer.sceneBounds, renderer.meshes, shadowLights, SHADOW_UNIT);
+    }
+
+    buildShaderVariants(renderer);
+
+    return renderer;
+}
+
+void destroyGalleryRenderer(GalleryRenderer& renderer) {
+    destroyInstanceBatcher(renderer.batcher);
+    destroyFrameUniformBuffer(renderer.frameUniforms);
+    if (renderer.lightClusterBuilder) {
+        destroyLightClusterBuilder(renderer.lightClusterBuilder);
+        destroyLightClusterBuffers(renderer.lightClusterBuffers);
+    }
+    destroyDeferredRenderer(renderer.deferred);
+    if (renderer.shadowAtlas)
+        destroyShadowAtlas(renderer.shadowAtlas);
+
+    for (int mesh = 0; mesh < (int)MeshId::Count; ++mesh) {
+        glDeleteVertexArrays(1, &renderer.meshes[mesh].vao);
+        glDeleteBuffers(1, &renderer.meshes[mesh].vertexBuffer);
+        glDeleteBuffers(1, &renderer.meshes[mesh].indexBuffer);
+    }
+    if (renderer.lightmapTexture)
+        glDeleteTextures(1, &renderer.lightmapTexture);
+    if (renderer.probeTexture)
+        glDeleteTextures(1, &renderer.probeTexture);
+    for (unsigned int texture : renderer.textures) {
+        if (texture != renderer.textureLoader->placeholder)
+            glDeleteTextures(1, &texture);
+    }
+    destroyTextureLoader(renderer.textureLoader);
+    if (renderer.paintingArray)
+        destroyTextureArray(renderer.paintingArray);
+    if (renderer.virtualTexture)
+        closeVirtualTexture(renderer.virtualTexture);
+    if (renderer.shaderReloader)
+        destroyShaderReloader(renderer.shaderReloader);
+    destroyShaderPermutations(renderer.shaders);
+}
+
+void finishTextureLoading(GalleryRenderer& renderer) {
+    finishTextureLoads(*renderer.textureLoader, renderer.textures);
+}
+
+FrameStats renderFrame(GalleryRenderer& renderer, const Camera& camera, float time) {
+    Scene& scene = renderer.scene;
+
+    // Shaders rebuilt since the last frame replace the old ones all at once
+    if (renderer.shaderReloader && applyShaderReload(*renderer.shaderReloader, renderer.shaders)) {
+        for (const auto& entry : renderer.shaders.programs)
+            setupShaderVariant(renderer, permutationFromKey(entry.first), entry.second);
+    }
+
+    // Clear the color and depth buffer
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Set camera view and projection matrices
+    glm::mat4 view = glm::lookAt(camera.position, camera.position + camera.front, camera.up);
+    glm::mat4 projection = glm::perspective(glm::radians(camera.fov), camera.aspect, NEAR_PLANE, FAR_PLANE);
+
+    updateFrameUniforms(renderer.frameUniforms, { view, projection, glm::vec4(camera.position, 1.0f) }, renderer.lightBlock);
+
+    // Only the dynamic objects need new model matrices, the rest were baked at load
+    updateDynamicObjects(scene, time);
+    updateDynamicBounds(renderer.sceneBounds, scene);
+    updatePortalBounds(renderer.portalGraph, renderer.sceneBounds, scene.dynamicObjects);
+
+    // Shadow faces the dynamic casters are in get them drawn over the cached static depth
+    if (renderer.shadowAtlas)
+        updateShadowAtlas(*renderer.shadowAtlas, scene, renderer.sceneBounds, renderer.meshes);
+
+    // Only objects in rooms seen through the doorways, and inside the part of
+    // the frustum their room is seen through, are submitted
+    glm::mat4 viewProjection = projection * view;
+    findVisibleRooms(renderer.portalGraph, viewProjection, camera.position, renderer.portalVisibility);
+    int visibleCount = cullWithPortals(renderer.portalGraph, renderer.portalVisibility, viewProjection,
+                                       renderer.visibleObjects);
+
+    // Mip levels follow the size of each texture on screen, then textures
+    // decoded since the last frame replace their placeholders
+    measureTextureScreenSizes(renderer, camera, projection);
+    updateTextureStreaming(*renderer.textureLoader, renderer.textureScreenSizes);
+    updateTextureLoader(*renderer.textureLoader, renderer.textures, TEXTURE_UPLOAD_FRAME_BYTES);
+
+    // Paintings whose layer is uploaded sample the array, the rest of them
+    // show the placeholder until then
+    for (int texture = 0; texture < (int)TextureId::Count; ++texture) {
+        int layer = renderer.paintingLayers[texture];
+        renderer.textureLayers[texture] =
+            renderer.paintingArray && isTextureLayerReady(*renderer.paintingArray, layer) ? layer : -1;
+    }
+    if (renderer.paintingArray) {
+        glActiveTexture(GL_TEXTURE0 + PAINTING_ARRAY_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, renderer.paintingArray->texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Pages asked for by the feedback of a few frames ago come in, then the
+    // indirection points at them
+    if (renderer.virtualTexture) {
+        renderer.textureLayers[(int)TextureId::Painting1] = VIRTUAL_TEXTURE_LAYER;
+        updateVirtualTexture(*renderer.virtualTexture, VIRTUAL_PAGE_UPLOADS_PER_FRAME);
+    }
+
+    // Deferred shading lights the pixels afterwards. Otherwise lights go into
+    // this view's clusters, or into the instances of the objects they reach.
+    bool deferred = renderer.deferredShading;
+    if (deferred) {
+        renderer.objectLights.assign(scene.objects.size(), 0);
+        renderer.objectLightCounts.assign(scene.objects.size(), 0);
+    }
+    else if (renderer.clusteredLights) {
+        updateLightClusters(renderer, view, camera);
+    }
+    else {
+        assignObjectLights(renderer);
+    }
+
+    // Each draw gets the variant for the lights reaching it and its texture
+    // source, static objects with a chart in the lightmap need no lights
+    clearRenderQueue(renderer.renderQueue);
+    bool virtualTextureVisible = false;
+    for (size_t i = 0; i < scene.objects.size(); ++i) {
+        if (!renderer.visibleObjects[i])
+            continue;
+        const SceneObject& object = scene.objects[i];
+        float distance = glm::length(glm::vec3(scene.modelMatrices[i][3]) - camera.position);
+        // Every layered texture shares the array's key, so they batch together
+        int layer = renderer.textureLayers[(int)object.texture];
+        unsigned int texture = layer >= 0                      ? renderer.paintingArray->texture
+                               : layer == VIRTUAL_TEXTURE_LAYER ? renderer.virtualTexture->cacheTexture
+                                                                : renderer.textures[(int)object.texture];
+        virtualTextureVisible = virtualTextureVisible || layer == VIRTUAL_TEXTURE_LAYER;
+        uint32_t features = layer >= 0                      ? (uint32_t)SHADER_PAINTING_ARRAY
+                            : layer == VIRTUAL_TEXTURE_LAYER ? (uint32_t)SHADER_VIRTUAL_TEXTURE
+                                                             : 0u;
+        bool lightmapped = renderer.lightmapTexture && renderer.objectLightmapCharts[i].z > 0.0f;
+        if (deferred)
+            features |= SHADER_GBUFFER;
+        else if (lightmapped)
+            features |= SHADER_LIGHTMAP;
+        else if (renderer.clusteredLights)
+            features |= SHADER_CLUSTERED_LIGHTS;
+        // Casters are not shadowed, not even by themselves
+        if (renderer.shadowAtlas && !deferred && !object.castsShadows)
+            features |= SHADER_SHADOWS;
+        // The lightmap already holds the bounced light
+        if (renderer.probeTexture && !deferred && !lightmapped)
+            features |= SHADER_PROBES;
+        int lightCount = lightmapped ? 0 : renderer.objectLightCounts[i];
+        const ShaderProgram& program = shaderVariant(renderer, { lightCount, features });
+        uint64_t key = makeSortKey(program.id, renderer.meshes[(int)object.mesh].vao, texture,
+                                   depthBucket(distance, 100.0f));
+        submitRenderItem(renderer.renderQueue, key, (uint32_t)i, program.id, texture);
+    }
+    sortRenderQueue(renderer.renderQueue);
+
+    resetRenderState(renderer.stateTracker);
+    buildInstanceBatches(renderer.batcher, renderer.renderQueue, scene, renderer.meshes, renderer.textureLayers,
+                         renderer.objectLights.data(), renderer.objectLightmapCharts.data());
+    if (deferred)
+        beginGBufferPass(*renderer.deferred);
+    drawInstanceBatches(renderer.batcher, renderer.stateTracker);
+    if (deferred)
+        endGBufferPass(*renderer.deferred);
+
+    // The same batches again at low resolution with the feedback variant,
+    // writing the pages they need
+    if (virtualTextureVisible) {
+        const ShaderProgram& feedback = shaderVariant(renderer, { 0, SHADER_VIRTUAL_FEEDBACK });
+        beginVirtualTextureFeedback(*renderer.virtualTexture);
+        drawInstanceBatches(renderer.batcher, renderer.stateTracker, feedback.id);
+        endVirtualTextureFeedback(*renderer.virtualTexture);
+    }
+
+    // Each covered pixel is lit once, by the lights binned into its screen tile
+    if (deferred)
+        shadeDeferred(*renderer.deferred, scene.lights, view, projection, NEAR_PLANE);
+
+    // Unbind the VAO
+    glBindVertexArray(0);
+
+    fenceFrameUniforms(renderer.frameUniforms);
+
+    FrameStats stats;
+    stats.visibleRooms = 0;
+    for (uint8_t roomVisible : renderer.portalVisibility.roomVisible)
+        stats.visibleRooms += roomVisible;
+    stats.roomCount = (int)renderer.portalGraph.rooms.size();
+    stats.visibleObjects = visibleCount;
+    stats.objectCount = (int)scene.objects.size();
+    stats.texturesLoading = renderer.textureLoader->pending;
+    stats.textureBytes = renderer.textureLoader->residentBytes;
+    stats.textureBudgetBytes = renderer.textureLoader->budgetBytes;
+    stats.virtualPagesResident = renderer.virtualTexture ? renderer.virtualTexture->residentPages : 0;
+    stats.clusterLightIndices =
+        renderer.lightClusterBuilder && !deferred ? (int)renderer.lightClusterBuilder->lightIndices.size() : 0;
+    stats.tileLightIndices = deferred ? (int)renderer.deferred->bins.lightIndices.size() : 0;
+    stats.shadowFacesUpdated = renderer.shadowAtlas ? renderer.shadowAtlas->facesUpdated : 0;
+    stats.render = renderer.stateTracker.stats;
+    return stats;
+}
+
+std::string formatFrameStats(const FrameStats& stats) {
+    return "rooms " + std::to_string(stats.visibleRooms) + "/" + std::to_string(stats.roomCount) +
+           " | visible " + std::to_string(stats.visibleObjects) + "/" + std::to_string(stats.objectCount) +
+           " | draws " + std::to_string(stats.render.drawCalls) +
+           " | instances " + std::to_string(stats.render.instances) +
+           " | program binds " + std::to_string(stats.render.programBinds) +
+           " | VAO binds " + std::to_string(stats.render.vaoBinds) +
+           " | texture binds " + std::to_string(stats.render.textureBinds) +
+           " | skipped " + std::to_string(stats.render.redundantBindsSkipped) +
+           " | textures " + std::to_string(stats.textureBytes >> 20) + "/" +
+           std::to_string(stats.textureBudgetBytes >> 20) + " MB" +
+           (stats.virtualPagesResident ? " | pages " + std::to_string(stats.virtualPagesResident) : "") +
+           (stats.clusterLightIndices ? " | cluster lights " + std::to_string(stats.clusterLightIndices) : "") +
+           (stats.tileLightIndices ? " | tile lights " + std::to_string(stats.tileLightIndices) : "") +
+           (stats.shadowFacesUpdated ? " | shadow faces " + std::to_string(stats.shadowFacesUpdated) : "") +
+           (stats.texturesLoading ? " | loading " + std::to_string(stats.texturesLoading) + " textures" : "");
+}
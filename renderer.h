@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "culling.h"
+#include "deferred.h"
+#include "frame_uniforms.h"
+#include "instancing.h"
+#include "irradiance_probes.h"
+#include "light_clusters.h"
+#include "lightmap.h"
+#include "mesh.h"
+#include "portals.h"
+#include "render_queue.h"
+#include "scene.h"
+#include "shader.h"
+#include "shader_permutations.h"
+#include "shader_reload.h"
+#include "shadow_atlas.h"
+#include "texture_array.h"
+#include "texture_loader.h"
+#include "virtual_texture.h"
+
+// Where the gallery is seen from
+struct Camera {
+    glm::vec3 position;
+    glm::vec3 front;
+    glm::vec3 up;
+    float fov;    // Vertical, in degrees
+    float aspect; // Width / height
+};
+
+// GL resources and per-frame state for drawing the gallery. Independent of
+// the window system, so the windowed and headless modes share it.
+struct GalleryRenderer {
+    ShaderPermutations shaders; // Variants by light count and texture source, built as draws need them
+    ShaderReloader* shaderReloader; // Null unless hot reload is on
+    unsigned int textures[(int)TextureId::Count]; // Placeholder until loaded
+    TextureLoader* textureLoader;
+    float textureScreenSizes[(int)TextureId::Count]; // Largest on-screen size this frame, in pixels
+    TextureArray* paintingArray; // Null when paintings use their own textures
+    int paintingLayers[(int)TextureId::Count]; // Layer in paintingArray, -1 if not in it
+    int textureLayers[(int)TextureId::Count];  // paintingLayers that are uploaded, this frame
+    VirtualTexture* virtualTexture; // Null without a page pyramid for the first painting
+    Mesh meshes[(int)MeshId::Count];
+    MeshBuildStats meshStats[(int)MeshId::Count];
+    unsigned int lightmapTexture; // 0 without a lightmap baked for this scene
+    glm::vec2 lightmapSize;
+    std::vector<glm::vec3> objectLightmapCharts; // Chart corner and cell size of each object, cell size 0 for none
+    ShadowAtlas* shadowAtlas; // Null without shadows
+    unsigned int probeTexture; // 0 without irradiance probes baked for this scene
+    ProbeGrid probeGrid;
+
+    Scene scene;
+    SceneBounds sceneBounds;
+    std::vector<uint8_t> visibleObjects;
+    std::vector<uint32_t> objectLights;     // Indices of the lights reaching each visible object, 4 bits each
+    std::vector<uint8_t> objectLightCounts; // How many of them
+    bool clusteredLights; // Lights come from per-cluster lists instead of per-object indices
+    LightClusterBuilder* lightClusterBuilder; // Null without clustered lights
+    LightClusterBuffers lightClusterBuffers;
+    glm::vec4 clusterScale; // For the viewport clustered variants were last set up for
+    bool deferredShading; // G-buffer and tiled light pass instead of lighting while drawing, switchable any frame
+    DeferredRenderer* deferred; // Its G-buffer is allocated the first frame deferred shading is used
+    PortalGraph portalGraph;
+    PortalVisibility portalVisibility;
+
+    FrameUniformBuffer frameUniforms;
+    LightBlock lightBlock;
+    RenderQueue renderQueue;
+    RenderStateTracker stateTracker;
+    InstanceBatcher batcher;
+};
+
+// Startup choices for createGalleryRenderer
+struct RendererOptions {
+    bool textureCache = true; // Use cooked textures from the texture archive when current
+    size_t textureBudgetBytes = TEXTURE_DEFAULT_BUDGET_BYTES; // Video memory for streamed mip levels
+    bool paintingArray = true; // Paintings in one texture array, drawn in a single batch
+    bool virtualTextures = true; // The first painting from its page pyramid, when cooked
+    SharedContextBinder shaderReloadContext; // Rebuild shaders when their files are saved, if set
+    int lightCount = 0; // Scatter extra lights until the gallery has this many, for benchmarks
+    bool clusteredLights = false; // Always on past MAX_FRAME_LIGHTS lights
+    bool deferredShading = false; // Start with the deferred path, GalleryRenderer::deferredShading switches later
+    bool lightmap = true; // Static objects take their light from the baked lightmap, when it matches the scene
+    bool shadows = false; // Shadow cube maps for the first lights, static objects are then lit in real time
+    bool probes = true; // Ambient light from the baked irradiance probes, when they match the scene
+};
+
+// What one frame drew
+struct FrameStats {
+    int visibleRooms;
+    int roomCount;
+    int visibleObjects;
+    int objectCount;
+    int texturesLoading;
+    size_t textureBytes;
+    size_t textureBudgetBytes;
+    int virtualPagesResident; // Of the virtual texture, 0 without one
+    int clusterLightIndices; // Entries in the cluster light lists, 0 without clustered lights
+    int tileLightIndices;    // Entries in the deferred tile light lists, 0 when shading forward
+    int shadowFacesUpdated;  // Shadow atlas faces the dynamic casters were redrawn into
+    RenderStats render;
+};
+
+// Needs a current GL 3.3 core context with loaded function pointers. Returns
+// before the textures are loaded, they stream in over the following frames,
+// in as much detail as their size on screen needs.
+GalleryRenderer createGalleryRenderer(const RendererOptions& options = RendererOptions());
+void destroyGalleryRenderer(GalleryRenderer& renderer);
+
+// Blocks until every texture has its low mip levels, for benchmarks and screenshots
+void finishTextureLoading(GalleryRenderer& renderer);
+
+// Draws the gallery into the bound framebuffer, time drives the animation
+FrameStats renderFrame(GalleryRenderer& renderer, const Camera& camera, float time);
+
+std::string formatFrameStats(const FrameStats& stats);
@@ -0,0 +1,159 @@
+#include "scene.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+
+namespace {
+
+const glm::vec3 X_AXIS(1.0f, 0.0f, 0.0f);
+const glm::vec3 Y_AXIS(0.0f, 1.0f, 0.0f);
+
+struct ObjectDesc {
+    const char* name;
+    MeshId mesh;
+    TextureId texture;
+    Transform transform;
+};
+
+// Floors and ceilings are 10x10 quads laid out as a cross, walls and paintings
+// are thin boxes. Values are the ones the gallery was originally built with.
+const ObjectDesc GALLERY_OBJECTS[] = {
+    // Floors, rotated to align with the XZ-plane
+    { "Floor 1", MeshId::Quad, TextureId::Floor, { glm::vec3(0.0f, -1.0f, 0.0f), X_AXIS, -90.0f, glm::vec3(10.0f, 10.0f, 1.0f) } },
+    { "Floor 2", MeshId::Quad, TextureId::Floor, { glm::vec3(10.0f, -1.0f, 0.0f), X_AXIS, -90.0f, glm::vec3(10.0f, 10.0f, 1.0f) } },
+    { "Floor 3", MeshId::Quad, TextureId::Floor, { glm::vec3(0.0f, -1.0f, 10.0f), X_AXIS, -90.0f, glm::vec3(10.0f, 10.0f, 1.0f) } },
+    { "Floor 4", MeshId::Quad, TextureId::Floor, { glm::vec3(-10.0f, -1.0f, 0.0f), X_AXIS, -90.0f, glm::vec3(10.0f, 10.0f, 1.0f) } },
+    { "Floor 5", MeshId::Quad, TextureId::Floor, { glm::vec3(0.0f, -1.0f, -10.0f), X_AXIS, -90.0f, glm::vec3(10.0f, 10.0f, 1.0f) } },
+
+    // Ceilings, facing down
+    { "Ceiling 1", MeshId::Quad, TextureId::Ceiling, { glm::vec3(0.0f, 4.0f, 0.0f), X_AXIS, 90.0f, glm::vec3(10.0f, 10.0f, 1.0f) } },
+    { "Ceiling 2", MeshId::Quad, TextureId::Ceiling, { glm::vec3(10.0f, 4.0f, 0.0f), X_AXIS, 90.0f, glm::vec3(10.0f, 10.0f, 1.0f) } },
+    { "Ceiling 3", MeshId::Quad, TextureId::Ceiling, { glm::vec3(0.0f, 4.0f, 10.0f), X_AXIS, 90.0f, glm::vec3(10.0f, 10.0f, 1.0f) } },
+    { "Ceiling 4", MeshId::Quad, TextureId::Ceiling, { glm::vec3(-10.0f, 4.0f, 0.0f), X_AXIS, 90.0f, glm::vec3(10.0f, 10.0f, 1.0f) } },
+    { "Ceiling 5", MeshId::Quad, TextureId::Ceiling, { glm::vec3(0.0f, 4.0f, -10.0f), X_AXIS, 90.0f, glm::vec3(10.0f, 10.0f, 1.0f) } },
+
+    // Side walls along the arms of the cross
+    { "Side wall 1", MeshId::Box, TextureId::Wall, { glm::vec3(10.0f, 1.5f, -5.0f), Y_AXIS, 0.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+    { "Side wall 2", MeshId::Box, TextureId::Wall, { glm::vec3(-5.0f, 1.5f, 10.0f), Y_AXIS, 90.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+    { "Side wall 3", MeshId::Box, TextureId::Wall, { glm::vec3(5.0f, 1.5f, 10.0f), Y_AXIS, -90.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+    { "Side wall 4", MeshId::Box, TextureId::Wall, { glm::vec3(10.0f, 1.5f, 5.0f), Y_AXIS, 0.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+    { "Side wall 5", MeshId::Box, TextureId::Wall, { glm::vec3(-10.0f, 1.5f, -5.0f), Y_AXIS, 0.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+    { "Side wall 6", MeshId::Box, TextureId::Wall, { glm::vec3(-5.0f, 1.5f, -10.0f), Y_AXIS, 90.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+    { "Side wall 7", MeshId::Box, TextureId::Wall, { glm::vec3(5.0f, 1.5f, -10.0f), Y_AXIS, -90.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+    { "Side wall 8", MeshId::Box, TextureId::Wall, { glm::vec3(-10.0f, 1.5f, 5.0f), Y_AXIS, 0.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+
+    // End walls of the cross-shaped extensions
+    { "Back extension", MeshId::Box, TextureId::Wall, { glm::vec3(0.0f, 1.5f, -15.0f), Y_AXIS, 0.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+    { "Left extension", MeshId::Box, TextureId::Wall, { glm::vec3(-15.0f, 1.5f, 0.0f), Y_AXIS, 90.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+    { "Right extension", MeshId::Box, TextureId::Wall, { glm::vec3(15.0f, 1.5f, 0.0f), Y_AXIS, -90.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+    { "Front extension", MeshId::Box, TextureId::Wall, { glm::vec3(0.0f, 1.5f, 15.0f), Y_AXIS, 0.0f, glm::vec3(10.0f, 5.0f, 0.1f) } },
+
+    // Paintings, slightly in front of the extension walls
+    { "Painting 1", MeshId::Box, TextureId::Painting1, { glm::vec3(0.0f, 1.5f, -14.9f), Y_AXIS, 0.0f, glm::vec3(3.0f, 2.0f, 0.1f) } },
+    { "Painting 2", MeshId::Box, TextureId::Painting2, { glm::vec3(-14.9f, 1.5f, 0.0f), Y_AXIS, 90.0f, glm::vec3(3.0f, 2.0f, 0.1f) } },
+    { "Painting 3", MeshId::Box, TextureId::Painting3, { glm::vec3(0.0f, 1.5f, 14.9f), Y_AXIS, 0.0f, glm::vec3(3.0f, 2.0f, 0.1f) } },
+    { "Painting 4", MeshId::Box, TextureId::Painting4, { glm::vec3(14.9f, 1.5f, 0.0f), Y_AXIS, -90.0f, glm::vec3(3.0f, 2.0f, 0.1f) } },
+};
+
+// Lights above each painting, plus one over the hub
+const PointLight GALLERY_LIGHTS[] = {
+    { glm::vec3(0.0f, 3.5f, -18.0f), glm::vec3(1.0f, 0.8f, 0.8f), 1.2f, 0.0f }, // Slightly higher
+    { glm::vec3(-18.0f, 3.5f, 0.0f), glm::vec3(1.0f, 0.8f, 0.8f), 1.2f, 0.0f },
+    { glm::vec3(0.0f, 3.5f, 18.0f), glm::vec3(1.0f, 0.8f, 0.8f), 1.2f, 0.0f },
+    { glm::vec3(18.0f, 3.5f, 0.0f), glm::vec3(1.0f, 0.8f, 0.8f), 1.2f, 0.0f },
+    { glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(1.0f, 0.8f, 0.8f), 1.0f, 0.0f }
+};
+
+const char* const TEXTURE_PATHS[] = {
+    "textures/wall.jpg",      "textures/floor.jpg",     "textures/ceiling.jpg",   "textures/painting.png",
+    "textures/painting2.jpg", "textures/painting3.jpg", "textures/painting4.jpg", "textures/cube.jpg",
+};
+
+} // namespace
+
+const char* textureSourcePath(TextureId texture) {
+    return TEXTURE_PATHS[(int)texture];
+}
+
+glm::vec3 meshHalfExtents(MeshId mesh) {
+    return mesh == MeshId::Quad ? glm::vec3(0.5f, 0.5f, 0.0f) : glm::vec3(0.5f);
+}
+
+glm::mat4 composeTransform(const Transform& transform) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), transform.position);
+    if (transform.rotationDegrees != 0.0f)
+        model = glm::rotate(model, glm::radians(transform.rotationDegrees), transform.rotationAxis);
+    return glm::scale(model, transform.scale);
+}
+
+// The rotating cube in the middle of the hub
+glm::mat4 spinningCubeMatrix(float time) {
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(0.0f, std::sqrt(3.0f) / 2.0f, 0.0f)); // Position and lift the cube
+    model = glm::rotate(model, glm::radians(45.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // Tilt on X-axis
+    model = glm::rotate(model, glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f)); // Tilt on Z-axis
+    model = glm::rotate(model, time, glm::vec3(1.0f, 1.0f, -1.0f));               // Rotate over time
+    return model;
+}
+
+// The shader's diffuse term, dot(normalize(FragPos), lightDir), is positive
+// only inside the sphere whose diameter runs from the origin to the light.
+// Lights with a range are also bounded by it, whichever sphere is smaller.
+glm::vec4 lightBounds(const PointLight& light) {
+    glm::vec3 center = light.position * 0.5f;
+    float radius = glm::length(center) * 1.001f; // Keep lights grazing the boundary
+    if (light.range > 0.0f && light.range < radius)
+        return glm::vec4(light.position, light.range);
+    return glm::vec4(center, radius);
+}
+
+Scene buildGalleryScene() {
+    Scene scene;
+
+    for (const ObjectDesc& desc : GALLERY_OBJECTS) {
+        bool shell = desc.texture == TextureId::Wall || desc.texture == TextureId::Floor ||
+                     desc.texture == TextureId::Ceiling;
+        scene.objects.push_back({ desc.name, desc.mesh, desc.texture, false, !shell });
+        scene.transforms.push_back(desc.transform);
+        scene.modelMatrices.push_back(composeTransform(desc.transform));
+    }
+
+    // The cube has no static transform, it is evaluated every frame
+    scene.dynamicObjects.push_back((unsigned int)scene.objects.size());
+    scene.objects.push_back({ "Cube", MeshId::Box, TextureId::Cube, true, true });
+    scene.transforms.push_back({ glm::vec3(0.0f), Y_AXIS, 0.0f, glm::vec3(1.0f) });
+    scene.modelMatrices.push_back(spinningCubeMatrix(0.0f));
+
+    scene.lights.assign(std::begin(GALLERY_LIGHTS), std::end(GALLERY_LIGHTS));
+
+    return scene;
+}
+
+void updateDynamicObjects(Scene& scene, float time) {
+    for (unsigned int index : scene.dynamicObjects)
+        scene.modelMatrices[index] = spinningCubeMatrix(time);
+}
+
+void addScatteredLights(Scene& scene, int lightCount) {
+    // Hub and arms of the cross, each 10x10
+    const glm::vec2 ROOM_CENTERS[] = { glm::vec2(0.0f, 0.0f), glm::vec2(10.0f, 0.0f), glm::vec2(-10.0f, 0.0f),
+                                       glm::vec2(0.0f, 10.0f), glm::vec2(0.0f, -10.0f) };
+    uint32_t state = 12345;
+    auto random = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0f;
+    };
+
+    // Dimmer as they get more numerous, so overlapping lights do not saturate
+    int added = lightCount - (int)scene.lights.size();
+    float intensity = added > 0 ? std::min(1.0f, 40.0f / added) : 0.0f;
+    for (int i = 0; i < added; ++i) {
+        glm::vec2 room = ROOM_CENTERS[i % 5];
+        glm::vec3 position(room.x + (random() - 0.5f) * 9.0f, 2.5f + random() * 1.3f, room.y + (random() - 0.5f) * 9.0f);
+        glm::vec3 color(1.0f, 0.7f + 0.3f * random(), 0.5f + 0.5f * random());
+        scene.lights.push_back({ position, color, intensity, 3.0f });
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Geometry shared by scene objects
+enum class MeshId {
+    Quad, // Unit quad in the XY-plane
+    Box,  // Unit cube
+    Count
+};
+
+// Texture slots, resolved to GL texture names by the renderer
+enum class TextureId {
+    Wall,
+    Floor,
+    Ceiling,
+    Painting1,
+    Painting2,
+    Painting3,
+    Painting4,
+    Cube,
+    Count
+};
+
+// Translate * rotate * scale, matching the order the gallery was authored in
+struct Transform {
+    glm::vec3 position;
+    glm::vec3 rotationAxis;
+    float rotationDegrees;
+    glm::vec3 scale;
+};
+
+struct PointLight {
+    glm::vec3 position;
+    glm::vec3 color;
+    float intensity;
+    float range; // Fades out to nothing at this distance, 0 to light everything its diffuse term reaches
+};
+
+struct SceneObject {
+    const char* name;
+    MeshId mesh;
+    TextureId texture;
+    bool dynamic;
+    bool castsShadows; // The gallery's lights sit outside its walls, so walls, floors and ceilings cast none
+};
+
+// Scene table: objects[i] is drawn with modelMatrices[i]. Static matrices are
+// baked once when the scene is built, only dynamicObjects are re-evaluated.
+struct Scene {
+    std::vector<SceneObject> objects;
+    std::vector<Transform> transforms;
+    std::vector<glm::mat4> modelMatrices;
+    std::vector<unsigned int> dynamicObjects;
+    std::vector<PointLight> lights;
+};
+
+// Image a texture slot is loaded from
+const char* textureSourcePath(TextureId texture);
+
+// Half extents of a mesh's local AABB, centered on the origin
+glm::vec3 meshHalfExtents(MeshId mesh);
+
+glm::mat4 composeTransform(const Transform& transform);
+glm::mat4 spinningCubeMatrix(float time);
+
+// Sphere, center and radius, outside which a light adds nothing
+glm::vec4 lightBounds(const PointLight& light);
+
+Scene buildGalleryScene();
+
+// Fills the gallery up to lightCount lights for benchmarks: short range
+// lights scattered under the ceilings, the same ones every run
+void addScatteredLights(Scene& scene, int lightCount);
+void updateDynamicObjects(Scene& scene, float time);
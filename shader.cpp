@@ -0,0 +1,199 @@
+#include "shader.h"
+#include "frame_uniforms.h"
+#include "program_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+// Programs may be built on the shader reload thread too
+std::atomic<unsigned int> locationQueries(0);
+ProgramCreationStats creationStats;
+std::mutex creationStatsMutex;
+
+// The whole log, however long the driver's message is
+std::string shaderInfoLog(unsigned int shader) {
+    int length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::string log(std::max(length, 1), '\0');
+    glGetShaderInfoLog(shader, (GLsizei)log.size(), NULL, &log[0]);
+    log.resize(std::strlen(log.c_str()));
+    return log;
+}
+
+std::string programInfoLog(unsigned int program) {
+    int length = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    std::string log(std::max(length, 1), '\0');
+    glGetProgramInfoLog(program, (GLsizei)log.size(), NULL, &log[0]);
+    log.resize(std::strlen(log.c_str()));
+    return log;
+}
+
+int queryUniformLocation(unsigned int program, const std::string& name) {
+    ++locationQueries;
+    return glGetUniformLocation(program, name.c_str());
+}
+
+// Enumerates the active uniforms of a linked program, expanding arrays into
+// one entry per element
+void reflectUniforms(ShaderProgram& program) {
+    int count = 0, maxNameLength = 0;
+    glGetProgramiv(program.id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program.id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::vector<char> nameBuffer(maxNameLength + 1);
+    for (int i = 0; i < count; ++i) {
+        int size = 0, length = 0;
+        GLenum type;
+        glGetActiveUniform(program.id, i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+
+        // Arrays are reported as "name[0]" with size > 1
+        std::string baseName = name;
+        if (size > 1 && name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            baseName = name.substr(0, name.size() - 3);
+
+        for (int element = 0; element < size; ++element) {
+            std::string elementName = size > 1 ? baseName + "[" + std::to_string(element) + "]" : name;
+            int location = queryUniformLocation(program.id, elementName);
+            if (location < 0)
+                continue; // Uniforms inside blocks have no location
+
+            program.handles[elementName] = (int)program.uniforms.size();
+            if (element == 0 && size > 1)
+                program.handles[baseName] = (int)program.uniforms.size();
+            program.uniforms.push_back({ elementName, type, location });
+        }
+    }
+}
+
+// Per-frame blocks are shared by all programs through fixed binding points
+void bindUniformBlocks(const ShaderProgram& program) {
+    const struct {
+        const char* name;
+        unsigned int binding;
+    } blocks[] = {
+        { "Camera", CAMERA_BLOCK_BINDING },
+        { "Lights", LIGHT_BLOCK_BINDING },
+    };
+
+    for (const auto& block : blocks) {
+        unsigned int index = glGetUniformBlockIndex(program.id, block.name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program.id, index, block.binding);
+    }
+}
+
+} // namespace
+
+int ShaderProgram::handle(const std::string& name) const {
+    auto it = handles.find(name);
+    return it == handles.end() ? -1 : it->second;
+}
+
+// Function to compile a shader and check for errors
+unsigned int compileShader(const char* source, GLenum type) {
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    // Check for compile errors
+    int success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+        std::cout << "Shader Compilation Error:\n" << shaderInfoLog(shader) << std::endl;
+
+    return shader;
+}
+
+// Function to read a shader file and return its source code
+std::string readShaderSource(const char* filePath) {
+    std::ifstream file(filePath);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+// GLSL wants #version first, so the defines go on the lines after it
+std::string injectShaderDefines(const std::string& source, const std::vector<ShaderDefine>& defines) {
+    if (defines.empty())
+        return source;
+    std::string block;
+    for (const ShaderDefine& define : defines)
+        block += "#define " + define.name + " " + define.value + "\n";
+
+    // Error messages keep the line numbers of the file
+    block += "#line 2\n";
+
+    size_t version = source.find("#version");
+    size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+    if (lineEnd == std::string::npos)
+        return block + source;
+    return source.substr(0, lineEnd + 1) + block + source.substr(lineEnd + 1);
+}
+
+ShaderProgram createShaderProgram(const char* vertexPath, const char* fragmentPath) {
+    return createShaderProgramFromSources(readShaderSource(vertexPath), readShaderSource(fragmentPath));
+}
+
+// Function to link shaders into a program and reflect its uniforms. A binary
+// of the same sources from the program cache skips compiling and linking.
+ShaderProgram createShaderProgramFromSources(const std::string& vertexSource, const std::string& fragmentSource) {
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    ShaderProgram program;
+    program.id = loadCachedProgram(vertexSource, fragmentSource);
+    int success = program.id != 0;
+    bool fromCache = success;
+    if (!fromCache) {
+        unsigned int vertexShader = compileShader(vertexSource.c_str(), GL_VERTEX_SHADER);
+        unsigned int fragmentShader = compileShader(fragmentSource.c_str(), GL_FRAGMENT_SHADER);
+
+        program.id = glCreateProgram();
+        prepareCachedProgram(program.id);
+        glAttachShader(program.id, vertexShader);
+        glAttachShader(program.id, fragmentShader);
+        glLinkProgram(program.id);
+
+        // Check for linking errors
+        glGetProgramiv(program.id, GL_LINK_STATUS, &success);
+        if (!success)
+            std::cout << "Shader Program Linking Error:\n" << programInfoLog(program.id) << std::endl;
+        else {
+            storeCachedProgram(program.id, vertexSource, fragmentSource);
+        }
+
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+    }
+
+    if (success) {
+        reflectUniforms(program);
+        bindUniformBlocks(program);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(creationStatsMutex);
+    if (fromCache)
+        ++creationStats.fromCache;
+    else
+        ++creationStats.compiled;
+    creationStats.milliseconds += ms;
+    return program;
+}
+
+unsigned int uniformLocationQueryCount() {
+    return locationQueries;
+}
+
+ProgramCreationStats programCreationStats() {
+    std::lock_guard<std::mutex> lock(creationStatsMutex);
+    return creationStats;
+}
@@ -1,43 +1,265 @@
 #version 330 core
 
+// Variants are specialised by defines the renderer puts after #version:
+//   MAX_LIGHTS        size of the light block
+//   NUM_LIGHTS        lights affecting this draw, picked by the instance's LightIndices
+//   PAINTING_ARRAY    sample the painting array at the instance's layer
+//   VIRTUAL_TEXTURE   sample the virtual texture
+//   VIRTUAL_FEEDBACK  write virtual texture page requests instead of colours,
+//   VIRTUAL_MIP_BIAS  with pages this many levels finer than the pass's own
+//   CLUSTERED_LIGHTS  apply the lights binned into the fragment's cluster of a
+//   CLUSTERS_X/Y/Z    grid of tiles on screen and slices in depth
+//   GBUFFER           write the unlit colour for the deferred light pass
+//   LIGHTMAP          take the baked light from the lightmap, the cell
+//   LIGHTMAP_PADDING  borders of which are this many texels
+//   SHADOWS           leave out the light the shadow atlas says is blocked
+//   PROBES            ambient light from the irradiance probes, whose
+//   PROBE_SLABS       coefficients are spread over this many texture slabs
+// Without them, every light is applied to a 2D texture.
+#ifndef MAX_LIGHTS
+#define MAX_LIGHTS 5
+#endif
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS MAX_LIGHTS
+#endif
+
 struct PointLight {
     vec3 position;
+    float range; // 0 when the light is not limited to one
     vec3 color;
     float intensity;
 };
 
-#define NUM_LIGHTS 5
-uniform PointLight lights[NUM_LIGHTS];
-uniform vec3 viewPos; // Camera position
+// Updated once per frame, shared by all programs
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos; // Camera position
+};
+
+#if defined(LIGHTMAP)
+// Direct and bounced light of the static objects, baked offline
+uniform sampler2D lightmap;
+in vec2 LightmapCoord;
+#elif defined(CLUSTERED_LIGHTS)
+// Rebuilt every frame: each cluster's offset and count in the index lists, and
+// two texels per light, position and range then colour and intensity
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterLightIndices;
+uniform samplerBuffer clusterLights;
+uniform vec4 clusterScale; // Clusters per pixel in x and y, slices per unit of log depth, slice bias
+#else
+layout (std140) uniform Lights {
+    PointLight lights[MAX_LIGHTS];
+};
+#endif
 
 in vec3 FragPos;
 in vec2 TexCoord;
+flat in float Layer;
+flat in uint LightIndices; // 4 bits per light, the first NUM_LIGHTS are used
 
 out vec4 FragColor;
 
+#if defined(VIRTUAL_TEXTURE) || defined(VIRTUAL_FEEDBACK)
+// Virtual texture. The cache holds pages with their borders; the indirection
+// has a texel per page and a level per pyramid level, holding slot x, slot y
+// and the level of the page actually resident.
+uniform sampler2D virtualCache;
+uniform sampler2D virtualIndirection;
+uniform vec2 virtualUvScale;    // Image size over the level 0 page grid size
+uniform float virtualPages;     // Pages per side at level 0
+uniform float virtualMaxLevel;
+uniform float virtualCacheSize; // In texels
+
+const float PAGE_SIZE = 128.0;
+const float PAGE_STRIDE = 136.0; // With a 4 texel border on each side
+
+// The feedback pass renders at a fraction of the resolution and defines a
+// negative bias, so its pages are chosen for the full one
+#ifndef VIRTUAL_MIP_BIAS
+#define VIRTUAL_MIP_BIAS 0.0
+#endif
+
+float virtualLevel(vec2 uv)
+{
+    vec2 texels = uv * virtualPages * PAGE_SIZE;
+    vec2 dx = dFdx(texels), dy = dFdy(texels);
+    float level = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + VIRTUAL_MIP_BIAS;
+    return clamp(level, 0.0, virtualMaxLevel);
+}
+
+// Page x and y low bytes, their high nibbles, and level + 1
+vec4 virtualPageRequest(vec2 uv)
+{
+    float level = floor(virtualLevel(uv));
+    vec2 page = min(floor(uv * virtualPages / exp2(level)), virtualPages / exp2(level) - 1.0);
+    vec2 high = floor(page / 256.0);
+    return vec4(mod(page, 256.0), high.x + high.y * 16.0, level + 1.0) / 255.0;
+}
+
+vec3 virtualColor(vec2 uv)
+{
+    vec4 entry = floor(textureLod(virtualIndirection, uv, floor(virtualLevel(uv))) * 255.0 + 0.5);
+    vec2 inPage = fract(uv * virtualPages / exp2(entry.z));
+    vec2 texel = entry.xy * PAGE_STRIDE + (PAGE_STRIDE - PAGE_SIZE) * 0.5 + inPage * PAGE_SIZE;
+    return textureLod(virtualCache, texel / virtualCacheSize, 0.0).rgb;
+}
+#endif
+
+#ifdef PROBES
+// Light bounced through the rooms, baked into a grid of probes as second
+// order spherical harmonics. The 3D texture's depth holds PROBE_SLABS copies
+// of the grid, each with four of a probe's 27 coefficients.
+uniform sampler3D probes;
+uniform vec3 probeOrigin;
+uniform vec3 probeSpacing;
+uniform vec3 probeCounts;
+
+vec3 probeIrradiance(vec3 position, vec3 normal)
+{
+    // Trilinear between the eight probes around, never across slabs
+    vec3 cell = clamp((position - probeOrigin) / probeSpacing + 0.5, vec3(0.5), probeCounts - 0.5);
+    float coefficients[PROBE_SLABS * 4];
+    for (int slab = 0; slab < PROBE_SLABS; ++slab) {
+        float depth = (cell.z + float(slab) * probeCounts.z) / (probeCounts.z * float(PROBE_SLABS));
+        vec4 texel = texture(probes, vec3(cell.xy / probeCounts.xy, depth));
+        for (int i = 0; i < 4; ++i)
+            coefficients[slab * 4 + i] = texel[i];
+    }
+
+    float basis[9] = float[9](0.282095, 0.488603 * normal.y, 0.488603 * normal.z, 0.488603 * normal.x,
+                              1.092548 * normal.x * normal.y, 1.092548 * normal.y * normal.z,
+                              0.315392 * (3.0 * normal.z * normal.z - 1.0), 1.092548 * normal.x * normal.z,
+                              0.546274 * (normal.x * normal.x - normal.y * normal.y));
+    vec3 irradiance = vec3(0.0);
+    for (int i = 0; i < 9; ++i)
+        irradiance += vec3(coefficients[i * 3], coefficients[i * 3 + 1], coefficients[i * 3 + 2]) * basis[i];
+    return max(irradiance, vec3(0.0));
+}
+#endif
+
+#if defined(PAINTING_ARRAY)
+uniform sampler2DArray paintings; // Layers picked per instance
+#elif !defined(VIRTUAL_TEXTURE)
 uniform sampler2D texture1;
+#endif
+
+vec3 diffuseLight(PointLight light)
+{
+    // Calculate light direction
+    vec3 lightDir = normalize(light.position - FragPos);
+
+    // Diffuse lighting
+    float diff = max(dot(normalize(FragPos), lightDir), 0.0);
+    vec3 diffuse = light.color * diff * light.intensity;
+
+    // Smooth falloff reaching zero at the range
+    if (light.range > 0.0) {
+        float x = length(light.position - FragPos) / light.range;
+        float fade = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+        diffuse *= fade * fade;
+    }
+    return diffuse;
+}
+
+#ifdef SHADOWS
+// Depth cube maps of the first shadowLightCount lights, a row of six face
+// tiles per light in one atlas. Objects that cast shadows are drawn without
+// this variant, so receivers never compare against their own depth.
+uniform sampler2DShadow shadowAtlas;
+uniform mat4 shadowMatrices[MAX_LIGHTS * 6]; // World to atlas and depth, light * 6 + face
+uniform int shadowLightCount;
+uniform vec2 shadowTileSize; // One face, in atlas coordinates
+uniform vec2 shadowTexel;
+
+// A light's diffuse term where its shadow map sees the fragment. Fragments
+// the light does not reach skip the lookup.
+vec3 shadowedLight(PointLight light, int index)
+{
+    vec3 diffuse = diffuseLight(light);
+    if (index >= shadowLightCount || diffuse == vec3(0.0))
+        return diffuse;
+
+    // The face is the axis the fragment mostly lies along from the light
+    vec3 offset = FragPos - light.position;
+    vec3 size = abs(offset);
+    int face = size.x >= size.y && size.x >= size.z ? (offset.x > 0.0 ? 0 : 1)
+             : size.y >= size.z                     ? (offset.y > 0.0 ? 2 : 3)
+                                                    : (offset.z > 0.0 ? 4 : 5);
+    vec4 coord = shadowMatrices[index * 6 + face] * vec4(FragPos, 1.0);
+    coord.xyz /= coord.w;
+
+    // Bilinear comparisons stay inside the face's tile
+    vec2 tile = vec2(face, index) * shadowTileSize;
+    coord.xy = clamp(coord.xy, tile + shadowTexel * 0.5, tile + shadowTileSize - shadowTexel * 0.5);
+    return diffuse * texture(shadowAtlas, vec3(coord.xy, min(coord.z, 1.0)));
+}
+#else
+vec3 shadowedLight(PointLight light, int index)
+{
+    return diffuseLight(light);
+}
+#endif
 
 void main()
 {
+#ifdef VIRTUAL_FEEDBACK
+    // Every batch is drawn with this variant, only virtual instances ask for pages
+    FragColor = Layer < -1.5 ? virtualPageRequest(TexCoord * virtualUvScale) : vec4(0.0);
+#else
+
+#if defined(VIRTUAL_TEXTURE)
+    vec3 objectColor = virtualColor(TexCoord * virtualUvScale);
+#elif defined(PAINTING_ARRAY)
+    vec3 objectColor = texture(paintings, vec3(TexCoord, Layer)).rgb;
+#else
     vec3 objectColor = texture(texture1, TexCoord).rgb;
+#endif
+
+#ifdef GBUFFER
+    // Lit later, once per pixel, from the depth buffer's positions
+    FragColor = vec4(objectColor, 1.0);
+#else
     vec3 result = vec3(0.0);
 
+#if defined(LIGHTMAP)
+    result = texture(lightmap, LightmapCoord).rgb;
+#elif defined(CLUSTERED_LIGHTS)
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    vec3 position = vec3(gl_FragCoord.xy * clusterScale.xy, log(max(depth, 1e-4)) * clusterScale.z + clusterScale.w);
+    ivec3 cluster = clamp(ivec3(position), ivec3(0), ivec3(CLUSTERS_X - 1, CLUSTERS_Y - 1, CLUSTERS_Z - 1));
+    uvec2 range = texelFetch(clusterRanges, cluster.x + CLUSTERS_X * (cluster.y + CLUSTERS_Y * cluster.z)).xy;
+    for (uint i = 0u; i < range.y; ++i) {
+        int index = int(texelFetch(clusterLightIndices, int(range.x + i)).r);
+        vec4 positionRange = texelFetch(clusterLights, 2 * index);
+        vec4 colorIntensity = texelFetch(clusterLights, 2 * index + 1);
+        result += shadowedLight(PointLight(positionRange.xyz, positionRange.w, colorIntensity.rgb, colorIntensity.a),
+                                index);
+    }
+#else
     for (int i = 0; i < NUM_LIGHTS; ++i) {
-        // Calculate light direction
-        vec3 lightDir = normalize(lights[i].position - FragPos);
-
-        // Diffuse lighting
-        float diff = max(dot(normalize(FragPos), lightDir), 0.0);
-        vec3 diffuse = lights[i].color * diff * lights[i].intensity;
-
-        // Add contribution
-        result += diffuse;
+        int index = int((LightIndices >> uint(4 * i)) & 15u);
+        result += shadowedLight(lights[index], index);
     }
+#endif
 
+#ifdef PROBES
+    // Faces are flat: the normal comes from the position's screen derivatives,
+    // turned to the camera. Sampling half a cell off the surface leaves the
+    // probes behind it little weight.
+    vec3 normal = normalize(cross(dFdx(FragPos), dFdy(FragPos)));
+    if (dot(normal, viewPos.xyz - FragPos) < 0.0)
+        normal = -normal;
+    vec3 ambient = probeIrradiance(FragPos + normal * 0.5 * probeSpacing, normal);
+#else
     // Ambient lighting
     vec3 ambient = 0.1 * objectColor;
+#endif
 
     // Combine lighting and object color
     vec3 finalColor = (ambient + result) * objectColor;
     FragColor = vec4(finalColor, 1.0);
+#endif
+#endif
 }
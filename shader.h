@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// An active uniform as reported by glGetActiveUniform. Array elements are
+// listed individually ("lights[0].position", "bones[3]") so every entry maps
+// to exactly one location.
+struct UniformInfo {
+    std::string name;
+    GLenum type;
+    int location;
+};
+
+// A linked program together with its reflected uniforms. Look up a handle
+// once with handle(), then location() is a plain array index.
+struct ShaderProgram {
+    unsigned int id = 0;
+    std::vector<UniformInfo> uniforms;
+    std::unordered_map<std::string, int> handles;
+
+    // Returns -1 if the program has no active uniform with that name
+    int handle(const std::string& name) const;
+    int location(int handle) const { return handle < 0 ? -1 : uniforms[handle].location; }
+};
+
+// A #define placed in front of a source, right after its #version line
+struct ShaderDefine {
+    std::string name;
+    std::string value;
+};
+
+unsigned int compileShader(const char* source, GLenum type);
+std::string readShaderSource(const char* filePath);
+std::string injectShaderDefines(const std::string& source, const std::vector<ShaderDefine>& defines);
+ShaderProgram createShaderProgram(const char* vertexPath, const char* fragmentPath);
+ShaderProgram createShaderProgramFromSources(const std::string& vertexSource, const std::string& fragmentSource);
+
+// Programs created so far, loaded from the program cache or compiled, and
+// the time spent on all of them
+struct ProgramCreationStats {
+    int fromCache = 0;
+    int compiled = 0;
+    double milliseconds = 0.0;
+};
+ProgramCreationStats programCreationStats();
+
+// Number of glGetUniformLocation calls made so far. Reflection is the only
+// caller, so this must stop growing once all programs are created, shader
+// variants included.
+unsigned int uniformLocationQueryCount();
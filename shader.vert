@@ -2,17 +2,40 @@
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in mat4 aModel; // Per instance, locations 2-5
+layout (location = 6) in float aLayer; // Per instance, texture array layer, -1, or -2 for the virtual texture
+layout (location = 7) in uint aLightIndices; // Per instance, the lights affecting it, 4 bits each
 
 out vec3 FragPos;
 out vec2 TexCoord;
+flat out float Layer;
+flat out uint LightIndices;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#ifdef LIGHTMAP
+layout (location = 8) in vec4 aLightmapChart; // Cell of the vertex's face in its chart, and its place in the cell
+layout (location = 9) in vec3 aLightmapRect;  // Per instance, chart corner and cell size in texels
+uniform vec2 lightmapSize;
+out vec2 LightmapCoord;
+#endif
+
+// Updated once per frame, shared by all programs
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0)); // Calculate fragment position in world space
+    FragPos = vec3(aModel * vec4(aPos, 1.0)); // Calculate fragment position in world space
     TexCoord = aTexCoord;
+    Layer = aLayer;
+    LightIndices = aLightIndices;
+#ifdef LIGHTMAP
+    // Cells repeat their edge texels in a border, the face covers the inside
+    vec2 texel = aLightmapRect.xy + aLightmapChart.xy * aLightmapRect.z + LIGHTMAP_PADDING +
+                 aLightmapChart.zw * (aLightmapRect.z - 2.0 * LIGHTMAP_PADDING);
+    LightmapCoord = texel / lightmapSize;
+#endif
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "shader_permutations.h"
+
+#include <cmath>
+
+#include "frame_uniforms.h"
+#include "irradiance_probes.h"
+#include "light_clusters.h"
+#include "lightmap.h"
+#include "virtual_texture.h"
+
+uint32_t permutationKey(const ShaderPermutation& permutation) {
+    return (uint32_t)permutation.lightCount | permutation.features << 8;
+}
+
+ShaderPermutation permutationFromKey(uint32_t key) {
+    return { (int)(key & 0xff), key >> 8 };
+}
+
+std::vector<ShaderDefine> permutationDefines(const ShaderPermutation& permutation) {
+    std::vector<ShaderDefine> defines = {
+        { "MAX_LIGHTS", std::to_string(MAX_FRAME_LIGHTS) },
+        { "NUM_LIGHTS", std::to_string(permutation.lightCount) },
+    };
+    if (permutation.features & SHADER_PAINTING_ARRAY)
+        defines.push_back({ "PAINTING_ARRAY", "1" });
+    if (permutation.features & SHADER_VIRTUAL_TEXTURE)
+        defines.push_back({ "VIRTUAL_TEXTURE", "1" });
+    if (permutation.features & SHADER_VIRTUAL_FEEDBACK) {
+        // The pass lacks log2(divisor) levels of resolution
+        defines.push_back({ "VIRTUAL_FEEDBACK", "1" });
+        defines.push_back({ "VIRTUAL_MIP_BIAS", std::to_string(-std::log2((float)VIRTUAL_FEEDBACK_DIVISOR)) });
+    }
+    if (permutation.features & SHADER_CLUSTERED_LIGHTS) {
+        defines.push_back({ "CLUSTERED_LIGHTS", "1" });
+        defines.push_back({ "CLUSTERS_X", std::to_string(LIGHT_CLUSTERS_X) });
+        defines.push_back({ "CLUSTERS_Y", std::to_string(LIGHT_CLUSTERS_Y) });
+        defines.push_back({ "CLUSTERS_Z", std::to_string(LIGHT_CLUSTERS_Z) });
+    }
+    if (permutation.features & SHADER_GBUFFER)
+        defines.push_back({ "GBUFFER", "1" });
+    if (permutation.features & SHADER_LIGHTMAP) {
+        defines.push_back({ "LIGHTMAP", "1" });
+        defines.push_back({ "LIGHTMAP_PADDING", std::to_string(LIGHTMAP_PADDING) + ".0" });
+    }
+    if (permutation.features & SHADER_SHADOWS)
+        defines.push_back({ "SHADOWS", "1" });
+    if (permutation.features & SHADER_PROBES) {
+        defines.push_back({ "PROBES", "1" });
+        defines.push_back({ "PROBE_SLABS", std::to_string(PROBE_TEXTURE_SLABS) });
+    }
+    return defines;
+}
+
+ShaderPermutations createShaderPermutations(const char* vertexPath, const char* fragmentPath) {
+    ShaderPermutations permutations;
+    permutations.vertexPath = vertexPath;
+    permutations.fragmentPath = fragmentPath;
+    permutations.vertexSource = readShaderSource(vertexPath);
+    permutations.fragmentSource = readShaderSource(fragmentPath);
+    return permutations;
+}
+
+void destroyShaderPermutations(ShaderPermutations& permutations) {
+    for (auto& entry : permutations.programs)
+        glDeleteProgram(entry.second.id);
+    permutations.programs.clear();
+}
+
+ShaderProgram* findShaderPermutation(ShaderPermutations& permutations, const ShaderPermutation& permutation) {
+    auto it = permutations.programs.find(permutationKey(permutation));
+    return it == permutations.programs.end() ? nullptr : &it->second;
+}
+
+ShaderProgram& buildShaderPermutation(ShaderPermutations& permutations, const ShaderPermutation& permutation) {
+    std::vector<ShaderDefine> defines = permutationDefines(permutation);
+    ShaderProgram& program = permutations.programs[permutationKey(permutation)];
+    program = createShaderProgramFromSources(injectShaderDefines(permutations.vertexSource, defines),
+                                             injectShaderDefines(permutations.fragmentSource, defines));
+    return program;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "shader.h"
+
+// Optional parts of the gallery shader. A variant without a feature has no
+// trace of it in its code.
+enum ShaderFeature : uint32_t {
+    SHADER_PAINTING_ARRAY = 1 << 0,  // Samples the painting texture array by instance layer
+    SHADER_VIRTUAL_TEXTURE = 1 << 1, // Samples the virtual texture
+    SHADER_VIRTUAL_FEEDBACK = 1 << 2, // Writes virtual texture page requests, no lighting
+    SHADER_CLUSTERED_LIGHTS = 1 << 3, // Lights from the fragment's cluster list instead of the instance
+    SHADER_GBUFFER = 1 << 4,          // Writes the unlit colour for deferred shading
+    SHADER_LIGHTMAP = 1 << 5,         // Baked light from the lightmap instead of any light loop
+    SHADER_SHADOWS = 1 << 6,          // Lights are blocked by the casters in the shadow atlas
+    SHADER_PROBES = 1 << 7,           // Ambient light from the irradiance probes instead of a constant
+};
+
+// One specialisation: the number of lights the loop is unrolled for and the
+// features compiled in. Variants only differ in these defines:
+//   NUM_LIGHTS, MAX_LIGHTS, PAINTING_ARRAY, VIRTUAL_TEXTURE, VIRTUAL_FEEDBACK,
+//   VIRTUAL_MIP_BIAS, CLUSTERED_LIGHTS, CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z,
+//   GBUFFER, LIGHTMAP, LIGHTMAP_PADDING, SHADOWS, PROBES, PROBE_SLABS
+struct ShaderPermutation {
+    int lightCount;
+    uint32_t features; // ShaderFeature bits
+};
+
+// A vertex and fragment shader pair and the variants built from it so far.
+// Sources are read once; each variant is compiled, or loaded from the program
+// cache, the first time it is asked for.
+struct ShaderPermutations {
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string vertexSource;
+    std::string fragmentSource;
+    std::unordered_map<uint32_t, ShaderProgram> programs; // By permutationKey
+};
+
+uint32_t permutationKey(const ShaderPermutation& permutation);
+ShaderPermutation permutationFromKey(uint32_t key);
+std::vector<ShaderDefine> permutationDefines(const ShaderPermutation& permutation);
+
+ShaderPermutations createShaderPermutations(const char* vertexPath, const char* fragmentPath);
+void destroyShaderPermutations(ShaderPermutations& permutations);
+
+// The variant if it was built already, null otherwise
+ShaderProgram* findShaderPermutation(ShaderPermutations& permutations, const ShaderPermutation& permutation);
+
+// Builds a variant. The reference stays valid while permutations lives.
+ShaderProgram& buildShaderPermutation(ShaderPermutations& permutations, const ShaderPermutation& permutation);
@@ -0,0 +1,222 @@
+#include "shader_reload.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+struct ShaderReloader {
+    std::string paths[2]; // Vertex, fragment
+    SharedContextBinder bindContext;
+    std::thread thread;
+    std::atomic<bool> stop;
+
+    // Shared with the render thread
+    std::mutex mutex;
+    std::vector<uint32_t> keys; // Variants the renderer has built
+    bool ready = false;         // A rebuild waits to be applied
+    std::string vertexSource;
+    std::string fragmentSource;
+    std::vector<std::pair<uint32_t, ShaderProgram>> programs;
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Editors save in several steps, the rebuild waits until they are done
+const std::chrono::milliseconds SETTLE_TIME(100);
+const int WATCH_INTERVAL_MS = 100;
+
+void deletePrograms(std::vector<std::pair<uint32_t, ShaderProgram>>& programs) {
+    for (auto& entry : programs)
+        glDeleteProgram(entry.second.id);
+    programs.clear();
+}
+
+// Builds every variant the renderer has from the sources on disk, publishing
+// them only if all of them link
+void rebuildVariants(ShaderReloader& reloader) {
+    Clock::time_point start = Clock::now();
+    std::string vertexSource = readShaderSource(reloader.paths[0].c_str());
+    std::string fragmentSource = readShaderSource(reloader.paths[1].c_str());
+    std::vector<uint32_t> keys;
+    {
+        std::lock_guard<std::mutex> lock(reloader.mutex);
+        keys = reloader.keys;
+    }
+
+    std::vector<std::pair<uint32_t, ShaderProgram>> programs;
+    bool failed = false;
+    for (uint32_t key : keys) {
+        std::vector<ShaderDefine> defines = permutationDefines(permutationFromKey(key));
+        programs.push_back({ key, createShaderProgramFromSources(injectShaderDefines(vertexSource, defines),
+                                                                 injectShaderDefines(fragmentSource, defines)) });
+        int success;
+        glGetProgramiv(programs.back().second.id, GL_LINK_STATUS, &success);
+        if (!success) {
+            failed = true;
+            break;
+        }
+    }
+    // The render thread's context may only use them once they are complete
+    glFinish();
+
+    if (failed) {
+        deletePrograms(programs);
+        std::cout << "Shader reload failed, keeping the previous programs" << std::endl;
+        return;
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << "Reloaded " << reloader.paths[0] << " and " << reloader.paths[1] << ": " << programs.size()
+              << " variants in " << ms << " ms" << std::endl;
+
+    // Replaces a rebuild the renderer has not picked up yet
+    std::lock_guard<std::mutex> lock(reloader.mutex);
+    deletePrograms(reloader.programs);
+    reloader.programs = std::move(programs);
+    reloader.vertexSource = std::move(vertexSource);
+    reloader.fragmentSource = std::move(fragmentSource);
+    reloader.ready = true;
+}
+
+#ifdef __linux__
+
+// Watches the directories rather than the files, editors often save by
+// writing a new file and renaming it over the old one
+void watchSources(ShaderReloader& reloader) {
+    int inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify < 0) {
+        std::cout << "Shader hot reload unavailable: inotify_init1 failed" << std::endl;
+        return;
+    }
+    int watches[2];
+    std::string names[2];
+    for (int i = 0; i < 2; ++i) {
+        fs::path path(reloader.paths[i]);
+        std::string directory = path.has_parent_path() ? path.parent_path().string() : ".";
+        watches[i] = inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        names[i] = path.filename().string();
+    }
+
+    bool changed = false;
+    Clock::time_point changedAt;
+    alignas(inotify_event) char buffer[4096];
+    while (!reloader.stop) {
+        pollfd events = { inotify, POLLIN, 0 };
+        if (poll(&events, 1, WATCH_INTERVAL_MS) > 0) {
+            ssize_t length;
+            while ((length = read(inotify, buffer, sizeof(buffer))) > 0) {
+                for (char* at = buffer; at < buffer + length;) {
+                    const inotify_event* event = (const inotify_event*)at;
+                    for (int i = 0; i < 2; ++i) {
+                        if (event->len && event->wd == watches[i] && names[i] == event->name) {
+                            changed = true;
+                            changedAt = Clock::now();
+                        }
+                    }
+                    at += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+        if (changed && Clock::now() - changedAt >= SETTLE_TIME) {
+            changed = false;
+            rebuildVariants(reloader);
+        }
+    }
+    close(inotify);
+}
+
+#else
+
+void watchSources(ShaderReloader& reloader) {
+    std::error_code error;
+    fs::file_time_type times[2];
+    for (int i = 0; i < 2; ++i)
+        times[i] = fs::last_write_time(reloader.paths[i], error);
+
+    while (!reloader.stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_INTERVAL_MS));
+        bool changed = false;
+        for (int i = 0; i < 2; ++i) {
+            fs::file_time_type time = fs::last_write_time(reloader.paths[i], error);
+            if (!error && time != times[i]) {
+                times[i] = time;
+                changed = true;
+            }
+        }
+        if (changed) {
+            std::this_thread::sleep_for(SETTLE_TIME);
+            rebuildVariants(reloader);
+        }
+    }
+}
+
+#endif
+
+} // namespace
+
+ShaderReloader* createShaderReloader(const ShaderPermutations& shaders, SharedContextBinder bindContext) {
+    ShaderReloader* reloader = new ShaderReloader();
+    reloader->paths[0] = shaders.vertexPath;
+    reloader->paths[1] = shaders.fragmentPath;
+    reloader->bindContext = std::move(bindContext);
+    reloader->stop = false;
+    for (const auto& entry : shaders.programs)
+        reloader->keys.push_back(entry.first);
+
+    reloader->thread = std::thread([reloader] {
+        reloader->bindContext(true);
+        watchSources(*reloader);
+        reloader->bindContext(false);
+    });
+    return reloader;
+}
+
+void destroyShaderReloader(ShaderReloader* reloader) {
+    reloader->stop = true;
+    reloader->thread.join();
+    deletePrograms(reloader->programs);
+    delete reloader;
+}
+
+bool applyShaderReload(ShaderReloader& reloader, ShaderPermutations& shaders) {
+    // Never waits on a rebuild being published, the next frame will do
+    std::unique_lock<std::mutex> lock(reloader.mutex, std::try_to_lock);
+    if (!lock.owns_lock())
+        return false;
+
+    // Variants are only ever added between reloads
+    if (reloader.keys.size() != shaders.programs.size()) {
+        reloader.keys.clear();
+        for (const auto& entry : shaders.programs)
+            reloader.keys.push_back(entry.first);
+    }
+    if (!reloader.ready)
+        return false;
+
+    // Variants first built while the rebuild ran came from the old sources,
+    // they are dropped and built again from the new ones when next drawn
+    for (auto& entry : shaders.programs)
+        glDeleteProgram(entry.second.id);
+    shaders.programs.clear();
+    for (auto& entry : reloader.programs)
+        shaders.programs[entry.first] = std::move(entry.second);
+    reloader.programs.clear();
+    shaders.vertexSource = std::move(reloader.vertexSource);
+    shaders.fragmentSource = std::move(reloader.fragmentSource);
+    reloader.ready = false;
+    return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <functional>
+
+#include "shader_permutations.h"
+
+// Makes a GL context that shares objects with the renderer's current on the
+// calling thread when passed true, releases it when passed false
+using SharedContextBinder = std::function<void(bool)>;
+
+// Watches the sources of a ShaderPermutations and, when one is saved,
+// rebuilds every variant built so far on a background thread with its own
+// shared context. applyShaderReload swaps them all in together at a frame
+// boundary. If any variant fails, the previous programs stay in use and the
+// whole info log is printed.
+// Changes are picked up with inotify on Linux, by polling modification times
+// elsewhere.
+struct ShaderReloader;
+
+ShaderReloader* createShaderReloader(const ShaderPermutations& shaders, SharedContextBinder bindContext);
+void destroyShaderReloader(ShaderReloader* reloader);
+
+// Call once per frame, before drawing. Returns true when new programs
+// replaced the old ones; they still need their uniforms set.
+bool applyShaderReload(ShaderReloader& reloader, ShaderPermutations& shaders);
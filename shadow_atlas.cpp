@@ -0,0 +1,210 @@
+#include "shadow_atlas.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+
+const glm::vec3 FACE_DIRECTIONS[SHADOW_CUBE_FACES] = {
+    glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+};
+const glm::vec3 FACE_UPS[SHADOW_CUBE_FACES] = {
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+    glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+};
+
+bool sphereTouchesBox(const glm::vec4& sphere, const SceneBounds& bounds, size_t index) {
+    glm::vec3 center(bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index]);
+    glm::vec3 extent(bounds.extentX[index], bounds.extentY[index], bounds.extentZ[index]);
+    glm::vec3 sphereCenter(sphere);
+    glm::vec3 offset = sphereCenter - glm::clamp(sphereCenter, center - extent, center + extent);
+    return glm::dot(offset, offset) <= sphere.w * sphere.w;
+}
+
+// Casters whose AABB one face sees, drawn into its tile of the bound framebuffer
+int drawFaceCasters(const ShadowAtlas& atlas, const std::vector<unsigned int>& casters, int tile,
+                    const Scene& scene, const SceneBounds& bounds, const Mesh* meshes) {
+    const ShaderProgram& program = atlas.depthProgram;
+    glViewport((tile % SHADOW_CUBE_FACES) * SHADOW_FACE_SIZE, (tile / SHADOW_CUBE_FACES) * SHADOW_FACE_SIZE,
+               SHADOW_FACE_SIZE, SHADOW_FACE_SIZE);
+    glUniformMatrix4fv(program.location(program.handle("lightViewProjection")), 1, GL_FALSE,
+                       glm::value_ptr(atlas.faceViewProjections[tile]));
+    Frustum frustum = extractFrustum(atlas.faceViewProjections[tile]);
+    int draws = 0;
+    for (unsigned int index : casters) {
+        if (!boxInFrustum(frustum, bounds, index))
+            continue;
+        const Mesh& mesh = meshes[(int)scene.objects[index].mesh];
+        glUniformMatrix4fv(program.location(program.handle("model")), 1, GL_FALSE,
+                           glm::value_ptr(scene.modelMatrices[index]));
+        glBindVertexArray(mesh.vao);
+        glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void*)0);
+        ++draws;
+    }
+    return draws;
+}
+
+// Depth only, nothing to write but the depth attachment
+unsigned int createDepthFramebuffer(unsigned int attachment, bool renderbuffer) {
+    unsigned int framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    if (renderbuffer)
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, attachment);
+    else
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, attachment, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    return framebuffer;
+}
+
+// Binds the atlas for drawing, keeping what was bound and the viewport
+void beginShadowPass(ShadowAtlas& atlas, GLint* viewport) {
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &atlas.savedFramebuffer);
+    glUseProgram(atlas.depthProgram.id);
+}
+
+void endShadowPass(ShadowAtlas& atlas, const GLint* viewport) {
+    glBindFramebuffer(GL_FRAMEBUFFER, atlas.savedFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glBindVertexArray(0);
+}
+
+} // namespace
+
+ShadowAtlas* createShadowAtlas(const Scene& scene, const SceneBounds& bounds, const Mesh* meshes, int lightCount,
+                               int unit) {
+    ShadowAtlas* atlas = new ShadowAtlas();
+    atlas->lightCount = lightCount;
+    atlas->width = SHADOW_CUBE_FACES * SHADOW_FACE_SIZE;
+    atlas->height = lightCount * SHADOW_FACE_SIZE;
+
+    // A face sees out to the far side of its light's bounds, past that the
+    // light adds nothing to shadow
+    glm::vec3 tileScale(1.0f / SHADOW_CUBE_FACES, 1.0f / lightCount, 1.0f);
+    for (int light = 0; light < lightCount; ++light) {
+        glm::vec3 position = scene.lights[light].position;
+        glm::vec4 sphere = lightBounds(scene.lights[light]);
+        float farPlane = glm::length(glm::vec3(sphere) - position) + sphere.w;
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, SHADOW_NEAR_PLANE, farPlane);
+        atlas->lightSpheres.push_back(sphere);
+        for (int face = 0; face < SHADOW_CUBE_FACES; ++face) {
+            glm::mat4 view = glm::lookAt(position, position + FACE_DIRECTIONS[face], FACE_UPS[face]);
+            glm::mat4 viewProjection = projection * view;
+            glm::vec3 tileCorner = glm::vec3(face, light, 0.0f) * tileScale;
+            glm::mat4 toTile = glm::translate(glm::mat4(1.0f), tileCorner) * glm::scale(glm::mat4(1.0f), tileScale);
+            glm::mat4 toUnit = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) *
+                               glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+            atlas->faceViewProjections.push_back(viewProjection);
+            atlas->faceAtlasMatrices.push_back(toTile * toUnit * viewProjection);
+        }
+    }
+    atlas->dynamicFaces.assign(atlas->faceViewProjections.size(), 0);
+
+    for (size_t i = 0; i < scene.objects.size(); ++i) {
+        if (!scene.objects[i].castsShadows)
+            continue;
+        if (scene.objects[i].dynamic)
+            atlas->dynamicCasters.push_back((unsigned int)i);
+        else
+            atlas->staticCasters.push_back((unsigned int)i);
+    }
+
+    // Hardware comparison, bilinear filtering blends four of them
+    glGenTextures(1, &atlas->texture);
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, atlas->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, atlas->width, atlas->height, 0, GL_DEPTH_COMPONENT,
+                 GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glActiveTexture(GL_TEXTURE0);
+
+    glGenRenderbuffers(1, &atlas->staticDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, atlas->staticDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlas->width, atlas->height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    GLint viewport[4];
+    beginShadowPass(*atlas, viewport);
+    atlas->framebuffer = createDepthFramebuffer(atlas->texture, false);
+    atlas->staticFramebuffer = createDepthFramebuffer(atlas->staticDepth, true);
+    atlas->depthProgram = createShaderProgram("shadow.vert", "shadow.frag");
+    glUseProgram(atlas->depthProgram.id);
+
+    // The static casters once, each into the faces that see it, then the
+    // sampled atlas starts as a copy
+    glClear(GL_DEPTH_BUFFER_BIT);
+    for (int tile = 0; tile < (int)atlas->faceViewProjections.size(); ++tile)
+        atlas->staticDraws += drawFaceCasters(*atlas, atlas->staticCasters, tile, scene, bounds, meshes);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, atlas->staticFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, atlas->framebuffer);
+    glBlitFramebuffer(0, 0, atlas->width, atlas->height, 0, 0, atlas->width, atlas->height, GL_DEPTH_BUFFER_BIT,
+                      GL_NEAREST);
+    endShadowPass(*atlas, viewport);
+    return atlas;
+}
+
+void destroyShadowAtlas(ShadowAtlas* atlas) {
+    glDeleteProgram(atlas->depthProgram.id);
+    glDeleteFramebuffers(1, &atlas->framebuffer);
+    glDeleteFramebuffers(1, &atlas->staticFramebuffer);
+    glDeleteRenderbuffers(1, &atlas->staticDepth);
+    glDeleteTextures(1, &atlas->texture);
+    delete atlas;
+}
+
+void updateShadowAtlas(ShadowAtlas& atlas, const Scene& scene, const SceneBounds& bounds, const Mesh* meshes) {
+    atlas.facesUpdated = 0;
+    atlas.dynamicDraws = 0;
+    if (atlas.dynamicCasters.empty())
+        return;
+
+    GLint viewport[4];
+    bool begun = false;
+    for (int light = 0; light < atlas.lightCount; ++light) {
+        // Lights whose bounds no dynamic caster reaches keep their faces as they are
+        bool reached = false;
+        for (unsigned int index : atlas.dynamicCasters)
+            reached = reached || sphereTouchesBox(atlas.lightSpheres[light], bounds, index);
+
+        for (int face = 0; face < SHADOW_CUBE_FACES; ++face) {
+            int tile = light * SHADOW_CUBE_FACES + face;
+            bool seen = false;
+            if (reached) {
+                Frustum frustum = extractFrustum(atlas.faceViewProjections[tile]);
+                for (unsigned int index : atlas.dynamicCasters)
+                    seen = seen || boxInFrustum(frustum, bounds, index);
+            }
+            // A face the casters just left still needs their depth removed
+            if (!seen && !atlas.dynamicFaces[tile])
+                continue;
+            atlas.dynamicFaces[tile] = seen;
+            ++atlas.facesUpdated;
+
+            if (!begun) {
+                beginShadowPass(atlas, viewport);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, atlas.staticFramebuffer);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, atlas.framebuffer);
+                begun = true;
+            }
+            int x = face * SHADOW_FACE_SIZE, y = light * SHADOW_FACE_SIZE;
+            glBlitFramebuffer(x, y, x + SHADOW_FACE_SIZE, y + SHADOW_FACE_SIZE, x, y, x + SHADOW_FACE_SIZE,
+                              y + SHADOW_FACE_SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            if (seen)
+                atlas.dynamicDraws += drawFaceCasters(atlas, atlas.dynamicCasters, tile, scene, bounds, meshes);
+        }
+    }
+    if (begun)
+        endShadowPass(atlas, viewport);
+}
+
+size_t shadowAtlasBytes(const ShadowAtlas& atlas) {
+    return (size_t)atlas.width * atlas.height * 4 * 2;
+}
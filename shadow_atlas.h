@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "culling.h"
+#include "mesh.h"
+#include "scene.h"
+#include "shader.h"
+
+// Side of one cube face's tile in the atlas, in texels
+const int SHADOW_FACE_SIZE = 512;
+
+// Faces of a light's cube, in GL cube map order: +x, -x, +y, -y, +z, -z
+const int SHADOW_CUBE_FACES = 6;
+
+const float SHADOW_NEAR_PLANE = 0.05f;
+
+// Depth cube maps of the first lights, each face a tile of one 2D atlas: a
+// row of six per light. Static casters are drawn into a cached copy once at
+// startup. Every frame, only the faces a dynamic caster is in, or was in last
+// frame, get their cached depth copied back and the dynamic casters drawn over
+// it. Light that a caster blocks is not applied behind it.
+struct ShadowAtlas {
+    unsigned int texture;       // Sampled, DEPTH_COMPONENT24 with comparison
+    unsigned int framebuffer;   // Draws into texture
+    unsigned int staticDepth;   // Renderbuffer with only the static casters
+    unsigned int staticFramebuffer;
+    int lightCount = 0;
+    int width = 0;
+    int height = 0;
+    ShaderProgram depthProgram;
+    std::vector<glm::mat4> faceViewProjections; // Light * 6 + face, for drawing
+    std::vector<glm::mat4> faceAtlasMatrices;   // World to atlas texel and depth, for sampling
+    std::vector<glm::vec4> lightSpheres;        // Bounds of each light
+    std::vector<unsigned int> staticCasters;
+    std::vector<unsigned int> dynamicCasters;
+    std::vector<uint8_t> dynamicFaces; // Faces dynamic casters were drawn into last frame
+    int staticDraws = 0;   // At startup
+    int facesUpdated = 0;  // Last frame
+    int dynamicDraws = 0;  // Last frame
+    int savedFramebuffer = 0;
+};
+
+// Needs a current GL context and the meshes' VAOs. Lights past lightCount get
+// no shadows. The atlas is bound to unit once and stays there.
+ShadowAtlas* createShadowAtlas(const Scene& scene, const SceneBounds& bounds, const Mesh* meshes, int lightCount,
+                               int unit);
+void destroyShadowAtlas(ShadowAtlas* atlas);
+
+// Restores and redraws the faces the dynamic casters touch, after their
+// bounds were updated for this frame
+void updateShadowAtlas(ShadowAtlas& atlas, const Scene& scene, const SceneBounds& bounds, const Mesh* meshes);
+
+// Bytes of depth held by the atlas and its static copy
+size_t shadowAtlasBytes(const ShadowAtlas& atlas);
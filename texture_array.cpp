@@ -0,0 +1,122 @@
+#include "texture_array.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+
+namespace {
+
+int mipLevelCount(int width, int height) {
+    int count = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        ++count;
+    }
+    return count;
+}
+
+// Array texture with storage for capacity layers at every level
+unsigned int allocateArray(int width, int height, int levelCount, int capacity) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    for (int level = 0; level < levelCount; ++level) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, std::max(1, width >> level), std::max(1, height >> level),
+                     capacity, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
+
+// Doubles the capacity. GL 3.3 has no texture-to-texture copy, so every
+// uploaded layer of every level goes through a read framebuffer instead.
+void growArray(TextureArray& array) {
+    int capacity = array.capacity * 2;
+    unsigned int texture = allocateArray(array.width, array.height, array.levelCount, capacity);
+
+    GLint previousFramebuffer;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, array.copyFramebuffer);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    for (int level = 0; level < array.levelCount; ++level) {
+        for (int layer = 0; layer < (int)array.layers.size(); ++layer) {
+            if (array.layers[layer] != LayerState::Ready)
+                continue;
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array.texture, level, layer);
+            glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, 0, 0, std::max(1, array.width >> level),
+                                std::max(1, array.height >> level));
+        }
+    }
+    glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previousFramebuffer);
+
+    glDeleteTextures(1, &array.texture);
+    array.texture = texture;
+    array.capacity = capacity;
+}
+
+} // namespace
+
+TextureArray* createTextureArray(int width, int height, int capacity) {
+    TextureArray* array = new TextureArray();
+    array->width = width;
+    array->height = height;
+    array->levelCount = mipLevelCount(width, height);
+    array->capacity = capacity;
+    array->texture = allocateArray(width, height, array->levelCount, capacity);
+    glGenFramebuffers(1, &array->copyFramebuffer);
+    return array;
+}
+
+void destroyTextureArray(TextureArray* array) {
+    glDeleteTextures(1, &array->texture);
+    glDeleteFramebuffers(1, &array->copyFramebuffer);
+    delete array;
+}
+
+int addTextureLayer(TextureArray& array) {
+    int layer;
+    if (!array.freeLayers.empty()) {
+        layer = array.freeLayers.back();
+        array.freeLayers.pop_back();
+    }
+    else {
+        if ((int)array.layers.size() == array.capacity)
+            growArray(array);
+        layer = (int)array.layers.size();
+        array.layers.push_back(LayerState::Free);
+    }
+    array.layers[layer] = LayerState::Reserved;
+    return layer;
+}
+
+void removeTextureLayer(TextureArray& array, int layer) {
+    array.layers[layer] = LayerState::Free;
+    array.freeLayers.push_back(layer);
+}
+
+void uploadTextureLayer(TextureArray& array, int layer, const std::vector<uint8_t>& data,
+                        const std::vector<MipLevel>& levels) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+    for (int level = 0; level < array.levelCount && level < (int)levels.size(); ++level) {
+        const MipLevel& mip = levels[level];
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, mip.width, mip.height, 1, GL_RGBA,
+                        GL_UNSIGNED_BYTE, &data[mip.offset]);
+    }
+    array.layers[layer] = LayerState::Ready;
+}
+
+bool isTextureLayerReady(const TextureArray& array, int layer) {
+    return layer >= 0 && layer < (int)array.layers.size() && array.layers[layer] == LayerState::Ready;
+}
+
+size_t textureArrayBytes(const TextureArray& array) {
+    size_t bytes = 0;
+    for (int level = 0; level < array.levelCount; ++level)
+        bytes += (size_t)std::max(1, array.width >> level) * std::max(1, array.height >> level) * 4;
+    return bytes * array.capacity;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "dds.h"
+
+// Size every painting is resampled to, the 3:2 of the painting frames
+const int PAINTING_LAYER_WIDTH = 1536;
+const int PAINTING_LAYER_HEIGHT = 1024;
+
+// Layers a painting array starts with, it doubles when they run out
+const int PAINTING_ARRAY_CAPACITY = 4;
+
+enum class LayerState : uint8_t {
+    Free,
+    Reserved, // Handed out, contents not uploaded yet
+    Ready,
+};
+
+// Same-sized RGBA8 images with full mip chains in one GL_TEXTURE_2D_ARRAY, so
+// objects showing different images can share a texture binding and a draw.
+// Layers are added and removed one at a time; removed layers are reused
+// before the array grows, and growing copies the existing layers on the GPU.
+struct TextureArray {
+    unsigned int texture = 0;
+    int width = 0;
+    int height = 0;
+    int levelCount = 0;
+    int capacity = 0;
+    std::vector<LayerState> layers;
+    std::vector<int> freeLayers; // Removed layers below layers.size()
+    unsigned int copyFramebuffer = 0;
+};
+
+// Needs a current GL context. On the heap, loads in flight point at it.
+TextureArray* createTextureArray(int width, int height, int capacity);
+void destroyTextureArray(TextureArray* array);
+
+// Reserves a layer for an image uploaded later, growing the array if needed.
+// The texture name changes when it grows.
+int addTextureLayer(TextureArray& array);
+
+// The layer may be handed out again by the next addTextureLayer
+void removeTextureLayer(TextureArray& array, int layer);
+
+// Fills a reserved layer with a mip chain of width x height RGBA8 levels, as
+// built by buildMipChain
+void uploadTextureLayer(TextureArray& array, int layer, const std::vector<uint8_t>& data,
+                        const std::vector<MipLevel>& levels);
+
+bool isTextureLayerReady(const TextureArray& array, int layer);
+
+// Video memory of the whole array, free layers included
+size_t textureArrayBytes(const TextureArray& array);
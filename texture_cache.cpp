@@ -0,0 +1,167 @@
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char ARCHIVE_MAGIC[4] = { 'A', 'G', 'T', 'A' };
+const uint32_t ARCHIVE_VERSION = 1;
+
+uint64_t hashBytes(const uint8_t* data, size_t size, uint64_t hash) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Entries larger than this are taken for damage, not textures
+const uint32_t MAX_ENTRY_SIDE = 1 << 16;
+
+// The entry lies inside the file, and so does every level its size implies
+bool isEntryValid(const TextureArchiveEntry& entry, size_t fileSize) {
+    if (entry.format > (uint32_t)BlockFormat::BC7 || entry.width == 0 || entry.height == 0 ||
+        entry.width > MAX_ENTRY_SIDE || entry.height > MAX_ENTRY_SIDE)
+        return false;
+    if (entry.offset > fileSize || entry.size > fileSize - entry.offset)
+        return false;
+
+    // A full chain has floor(log2(max(w, h))) + 1 levels
+    uint32_t fullChain = 1;
+    for (uint32_t side = std::max(entry.width, entry.height); side > 1; side /= 2)
+        ++fullChain;
+    if (entry.levelCount == 0 || entry.levelCount > fullChain)
+        return false;
+
+    uint64_t levelBytes = 0;
+    for (const MipLevel& level : archiveEntryLevels(entry))
+        levelBytes += level.size;
+    return levelBytes <= entry.size;
+}
+
+size_t alignUp(size_t value) {
+    return (value + TEXTURE_ARCHIVE_ALIGNMENT - 1) / TEXTURE_ARCHIVE_ALIGNMENT * TEXTURE_ARCHIVE_ALIGNMENT;
+}
+
+} // namespace
+
+std::string textureArchivePath(const char* sourceDirectory) {
+    return (fs::path(sourceDirectory) / TEXTURE_CACHE_DIRECTORY / TEXTURE_ARCHIVE_NAME).string();
+}
+
+bool openTextureArchive(const char* path, TextureArchive& archive) {
+    if (!openMappedFile(path, archive.file))
+        return false;
+
+    const MappedFile& file = archive.file;
+    const TextureArchiveHeader* header = (const TextureArchiveHeader*)file.data;
+    bool valid = file.size >= sizeof(TextureArchiveHeader) && std::memcmp(header->magic, ARCHIVE_MAGIC, 4) == 0 &&
+                 header->version == ARCHIVE_VERSION &&
+                 file.size >= sizeof(TextureArchiveHeader) + header->entryCount * sizeof(TextureArchiveEntry);
+    const TextureArchiveEntry* entries = (const TextureArchiveEntry*)(file.data + sizeof(TextureArchiveHeader));
+    for (uint32_t i = 0; valid && i < header->entryCount; ++i)
+        valid = isEntryValid(entries[i], file.size);
+
+    if (!valid) {
+        std::cout << "Ignoring damaged texture archive: " << path << std::endl;
+        closeMappedFile(archive.file);
+        return false;
+    }
+    archive.header = header;
+    archive.entries = entries;
+    return true;
+}
+
+void closeTextureArchive(TextureArchive& archive) {
+    closeMappedFile(archive.file);
+    archive = TextureArchive();
+}
+
+const TextureArchiveEntry* findArchiveEntry(const TextureArchive& archive, const char* name) {
+    if (!archive.header)
+        return nullptr;
+    for (uint32_t i = 0; i < archive.header->entryCount; ++i) {
+        if (std::strncmp(archive.entries[i].name, name, sizeof(archive.entries[i].name)) == 0)
+            return &archive.entries[i];
+    }
+    return nullptr;
+}
+
+std::vector<MipLevel> archiveEntryLevels(const TextureArchiveEntry& entry) {
+    std::vector<MipLevel> levels;
+    int width = (int)entry.width, height = (int)entry.height;
+    size_t offset = 0;
+    for (uint32_t level = 0; level < entry.levelCount; ++level) {
+        size_t size = compressedImageSize((BlockFormat)entry.format, width, height);
+        levels.push_back({ width, height, offset, size });
+        offset += size;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return levels;
+}
+
+const uint8_t* archiveEntryData(const TextureArchive& archive, const TextureArchiveEntry& entry) {
+    return archive.file.data + entry.offset;
+}
+
+bool isArchiveEntryCurrent(const TextureArchiveEntry& entry, const char* sourcePath) {
+    std::error_code error;
+    uintmax_t size = fs::file_size(sourcePath, error);
+    if (error)
+        return true; // A cache without its source is still usable
+    fs::file_time_type time = fs::last_write_time(sourcePath, error);
+    return !error && size == entry.sourceSize && (int64_t)time.time_since_epoch().count() == entry.sourceTime;
+}
+
+bool describeSource(const char* sourcePath, TextureArchiveEntry& entry) {
+    MappedFile source;
+    if (!openMappedFile(sourcePath, source))
+        return false;
+
+    // Zeroed first, so a cut name still ends in a terminator
+    std::string name = fs::path(sourcePath).filename().string();
+    std::memset(entry.name, 0, sizeof(entry.name));
+    std::memcpy(entry.name, name.data(), std::min(name.size(), sizeof(entry.name) - 1));
+    entry.sourceSize = source.size;
+    entry.sourceTime = (int64_t)fs::last_write_time(sourcePath).time_since_epoch().count();
+    entry.sourceHash = hashBytes(source.data, source.size, 0xcbf29ce484222325ull);
+    closeMappedFile(source);
+    return true;
+}
+
+bool writeTextureArchive(const char* path, std::vector<TextureArchiveEntry>& entries,
+                         const std::vector<const uint8_t*>& blocks) {
+    size_t offset = alignUp(sizeof(TextureArchiveHeader) + entries.size() * sizeof(TextureArchiveEntry));
+    for (TextureArchiveEntry& entry : entries) {
+        entry.offset = offset;
+        offset = alignUp(offset + entry.size);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to write texture archive: " << path << std::endl;
+        return false;
+    }
+
+    TextureArchiveHeader header = {};
+    std::memcpy(header.magic, ARCHIVE_MAGIC, 4);
+    header.version = ARCHIVE_VERSION;
+    header.entryCount = (uint32_t)entries.size();
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)entries.data(), entries.size() * sizeof(TextureArchiveEntry));
+
+    const char padding[TEXTURE_ARCHIVE_ALIGNMENT] = {};
+    for (size_t i = 0; i < entries.size(); ++i) {
+        file.write(padding, entries[i].offset - (size_t)file.tellp());
+        file.write((const char*)blocks[i], entries[i].size);
+    }
+    return (bool)file;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dds.h"
+#include "mapped_file.h"
+
+// Cooked textures for a source directory live in one archive:
+// textures/cache/textures.agta
+const char* const TEXTURE_CACHE_DIRECTORY = "cache";
+const char* const TEXTURE_ARCHIVE_NAME = "textures.agta";
+
+// Every entry's blocks start on a page boundary, so an entry can be mapped,
+// prefetched and uploaded without touching its neighbours
+const size_t TEXTURE_ARCHIVE_ALIGNMENT = 4096;
+
+// On disk: TextureArchiveHeader, entryCount TextureArchiveEntry records, then
+// the aligned block data of each entry with its mip levels back to back
+struct TextureArchiveHeader {
+    char magic[4]; // "AGTA"
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+};
+
+struct TextureArchiveEntry {
+    char name[64]; // Source file name, without the directory
+    uint64_t sourceSize;
+    int64_t sourceTime; // Modification time, in the file clock's ticks
+    uint64_t sourceHash; // FNV-1a of the source bytes
+    uint32_t format; // BlockFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint64_t offset; // From the start of the archive
+    uint64_t size;
+};
+
+struct TextureArchive {
+    MappedFile file;
+    const TextureArchiveHeader* header = nullptr;
+    const TextureArchiveEntry* entries = nullptr;
+};
+
+std::string textureArchivePath(const char* sourceDirectory);
+
+// Maps the archive and checks its header and table of contents: every entry
+// must have a plausible size and level count, and its levels must fit in its
+// blocks, which must fit in the file
+bool openTextureArchive(const char* path, TextureArchive& archive);
+void closeTextureArchive(TextureArchive& archive);
+
+const TextureArchiveEntry* findArchiveEntry(const TextureArchive& archive, const char* name);
+
+// Mip levels of an entry, offsets relative to archiveEntryData
+std::vector<MipLevel> archiveEntryLevels(const TextureArchiveEntry& entry);
+const uint8_t* archiveEntryData(const TextureArchive& archive, const TextureArchiveEntry& entry);
+
+// Cheap check against the source's size and modification time
+bool isArchiveEntryCurrent(const TextureArchiveEntry& entry, const char* sourcePath);
+
+// Fills name, size, time and hash of an entry from its source file
+bool describeSource(const char* sourcePath, TextureArchiveEntry& entry);
+
+// Writes entries and their blocks, assigning offsets
+bool writeTextureArchive(const char* path, std::vector<TextureArchiveEntry>& entries,
+                         const std::vector<const uint8_t*>& blocks);
@@ -0,0 +1,244 @@
+// Texture Cooker: compresses textures/ into the block-compressed archive the
+// gallery maps at startup. Built as its own project, it needs no GL context.
+//
+//     TextureCooker [--format auto|bc1|bc3|bc7] [--filter kaiser|box] [--force] [--dds]
+//                   [--virtual <image name>]... [source dir]
+//
+// --virtual also cuts the named source into a page pyramid for virtual texturing.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "block_compression.h"
+#include "dds.h"
+#include "mipmap.h"
+#include "page_pyramid.h"
+#include "texture_cache.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::high_resolution_clock;
+
+bool hasAlpha(const std::vector<uint8_t>& rgba) {
+    for (size_t i = 3; i < rgba.size(); i += 4) {
+        if (rgba[i] != 255)
+            return true;
+    }
+    return false;
+}
+
+BlockFormat cookedFormat(const char* formatOption) {
+    if (std::strcmp(formatOption, "bc3") == 0)
+        return BlockFormat::BC3;
+    if (std::strcmp(formatOption, "bc7") == 0)
+        return BlockFormat::BC7;
+    return BlockFormat::BC1;
+}
+
+// Compresses a source image with its whole mip chain
+bool cookTexture(const fs::path& path, const char* formatOption, MipFilter filter, CompressedTexture& texture,
+                 size_t& rawBytes) {
+    int width, height, components;
+    unsigned char* pixels = stbi_load(path.string().c_str(), &width, &height, &components, 4);
+    if (!pixels) {
+        std::cout << "Failed to load texture: " << path.string() << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> chain;
+    std::vector<MipLevel> levels;
+    buildMipChain(pixels, width, height, filter, chain, levels);
+    stbi_image_free(pixels);
+
+    if (std::strcmp(formatOption, "auto") == 0)
+        texture.format = hasAlpha(chain) ? BlockFormat::BC3 : BlockFormat::BC1;
+    else
+        texture.format = cookedFormat(formatOption);
+
+    // Uncompressed RGBA8 with a full mip chain, as the source path uploads it
+    rawBytes = chain.size();
+    for (const MipLevel& level : levels)
+        addMipLevel(texture, level.width, level.height,
+                    compressImage(texture.format, &chain[level.offset], level.width, level.height));
+    return true;
+}
+
+// Page pyramid next to the archive, rewritten when older than its source
+bool cookPagePyramid(const fs::path& sourceDir, const char* name, const char* formatOption, bool force) {
+    fs::path sourcePath = sourceDir / name;
+    std::string pyramidPath = pagePyramidPath(sourceDir.string().c_str(), name);
+    std::error_code error;
+    if (!force && fs::exists(pyramidPath, error) &&
+        fs::last_write_time(pyramidPath, error) >= fs::last_write_time(sourcePath, error))
+        return true;
+
+    Clock::time_point start = Clock::now();
+    int width, height, components;
+    unsigned char* pixels = stbi_load(sourcePath.string().c_str(), &width, &height, &components, 4);
+    if (!pixels) {
+        std::cout << "Failed to load texture: " << sourcePath.string() << std::endl;
+        return false;
+    }
+    // Pages are opaque unless asked otherwise, BC1 halves BC3's size
+    BlockFormat format = std::strcmp(formatOption, "auto") == 0 ? BlockFormat::BC1 : cookedFormat(formatOption);
+    bool written = writePagePyramid(pyramidPath.c_str(), pixels, width, height, format);
+    stbi_image_free(pixels);
+    if (!written)
+        return false;
+
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << name << ": " << width << "x" << height << " page pyramid, "
+              << fs::file_size(pyramidPath, error) / 1024 << " KB in " << ms << " ms -> " << pyramidPath << std::endl;
+    return true;
+}
+
+const char* formatName(BlockFormat format) {
+    return format == BlockFormat::BC1 ? "BC1" : format == BlockFormat::BC3 ? "BC3" : "BC7";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* formatOption = "auto";
+    MipFilter filter = MipFilter::Kaiser;
+    bool force = false, writeDDSFiles = false;
+    const char* sourceOption = "textures";
+    std::vector<const char*> virtualNames;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+            formatOption = argv[++i];
+        else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = std::strcmp(argv[++i], "box") == 0 ? MipFilter::Box : MipFilter::Kaiser;
+        else if (std::strcmp(argv[i], "--force") == 0)
+            force = true;
+        else if (std::strcmp(argv[i], "--dds") == 0)
+            writeDDSFiles = true;
+        else if (std::strcmp(argv[i], "--virtual") == 0 && i + 1 < argc)
+            virtualNames.push_back(argv[++i]);
+        else
+            sourceOption = argv[i];
+    }
+    fs::path sourceDir = sourceOption;
+    if (!fs::is_directory(sourceDir)) {
+        std::cout << "No texture directory: " << sourceDir.string() << std::endl;
+        return -1;
+    }
+    fs::create_directories(sourceDir / TEXTURE_CACHE_DIRECTORY);
+    std::string archivePath = textureArchivePath(sourceOption);
+
+    // Entries of the previous archive are reused while their source is unchanged
+    TextureArchive previous;
+    if (!force)
+        openTextureArchive(archivePath.c_str(), previous);
+    bool explicitFormat = std::strcmp(formatOption, "auto") != 0;
+
+    // Images are stored bottom row first, as the loader would flip them
+    stbi_set_flip_vertically_on_load(true);
+
+    std::vector<fs::path> sources;
+    for (const fs::directory_entry& entry : fs::directory_iterator(sourceDir)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension == ".jpg" || extension == ".jpeg" || extension == ".png")
+            sources.push_back(entry.path());
+    }
+    std::sort(sources.begin(), sources.end());
+
+    std::vector<TextureArchiveEntry> entries;
+    std::vector<const uint8_t*> blocks;
+    std::vector<std::unique_ptr<CompressedTexture>> cookedTextures;
+    size_t totalRaw = 0, totalCompressed = 0;
+    int cooked = 0, reused = 0;
+    for (const fs::path& path : sources) {
+        Clock::time_point start = Clock::now();
+        TextureArchiveEntry entry = {};
+        if (!describeSource(path.string().c_str(), entry)) {
+            std::cout << "Failed to read texture: " << path.string() << std::endl;
+            continue;
+        }
+
+        // Same size and time, or touched but identical bytes
+        const TextureArchiveEntry* old = findArchiveEntry(previous, entry.name);
+        if (old && (!explicitFormat || (BlockFormat)old->format == cookedFormat(formatOption)) &&
+            ((old->sourceSize == entry.sourceSize && old->sourceTime == entry.sourceTime) ||
+             old->sourceHash == entry.sourceHash)) {
+            TextureArchiveEntry kept = *old;
+            kept.sourceTime = entry.sourceTime;
+            entries.push_back(kept);
+            blocks.push_back(archiveEntryData(previous, *old));
+            ++reused;
+            continue;
+        }
+
+        cookedTextures.emplace_back(new CompressedTexture());
+        CompressedTexture& texture = *cookedTextures.back();
+        size_t rawBytes;
+        if (!cookTexture(path, formatOption, filter, texture, rawBytes))
+            continue;
+
+        entry.format = (uint32_t)texture.format;
+        entry.width = texture.levels[0].width;
+        entry.height = texture.levels[0].height;
+        entry.levelCount = (uint32_t)texture.levels.size();
+        entry.size = texture.data.size();
+        entries.push_back(entry);
+        blocks.push_back(texture.data.data());
+
+        if (writeDDSFiles) {
+            fs::path ddsPath = sourceDir / TEXTURE_CACHE_DIRECTORY / (path.stem().string() + ".dds");
+            writeDDS(ddsPath.string().c_str(), texture);
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::cout << path.filename().string() << ": " << entry.width << "x" << entry.height << " "
+                  << formatName(texture.format) << ", " << entry.levelCount << " levels, "
+                  << rawBytes / 1024 << " KB -> " << entry.size / 1024 << " KB ("
+                  << (double)rawBytes / entry.size << ":1) in " << ms << " ms" << std::endl;
+        totalRaw += rawBytes;
+        totalCompressed += entry.size;
+        ++cooked;
+    }
+
+    // Nothing cooked and no source removed: the archive is already current
+    bool changed = cooked > 0 || !previous.header || previous.header->entryCount != entries.size() ||
+                   std::any_of(entries.begin(), entries.end(), [&previous](const TextureArchiveEntry& entry) {
+                       const TextureArchiveEntry* old = findArchiveEntry(previous, entry.name);
+                       return old->sourceTime != entry.sourceTime;
+                   });
+    if (changed) {
+        std::string temporaryPath = archivePath + ".tmp";
+        if (!writeTextureArchive(temporaryPath.c_str(), entries, blocks))
+            return -1;
+
+        // The old mapping must go before the file can be replaced on Windows
+        closeTextureArchive(previous);
+        std::error_code error;
+        fs::rename(temporaryPath, archivePath, error);
+        if (error) {
+            std::cout << "Failed to replace texture archive: " << archivePath << std::endl;
+            return -1;
+        }
+    }
+    closeTextureArchive(previous);
+
+    std::cout << "Cooked " << cooked << " textures, reused " << reused;
+    if (cooked > 0)
+        std::cout << ", " << totalRaw / 1024 << " KB -> " << totalCompressed / 1024 << " KB";
+    std::cout << (changed ? ", wrote " : ", unchanged ") << archivePath << std::endl;
+
+    for (const char* name : virtualNames) {
+        if (!cookPagePyramid(sourceDir, name, formatOption, force))
+            return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,490 @@
+#include "texture_loader.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <filesystem>
+
+#include "mipmap.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+namespace {
+
+// From EXT_texture_compression_s3tc and ARB_texture_compression_bptc, which
+// the GL 3.3 core loader does not include
+const GLenum COMPRESSED_RGB_S3TC_DXT1 = 0x83F0;
+const GLenum COMPRESSED_RGBA_S3TC_DXT5 = 0x83F3;
+const GLenum COMPRESSED_RGBA_BPTC_UNORM = 0x8E8C;
+
+bool hasExtension(const char* name) {
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; ++i) {
+        if (std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Finest level within TEXTURE_TAIL_SIZE on both sides
+int tailLevelOf(const std::vector<MipLevel>& levels) {
+    int level = (int)levels.size() - 1;
+    while (level > 0 && std::max(levels[level - 1].width, levels[level - 1].height) <= TEXTURE_TAIL_SIZE)
+        --level;
+    return level;
+}
+
+bool formatSupported(const TextureLoader& loader, BlockFormat format) {
+    return format == BlockFormat::BC7 ? loader.supportsBC7 : loader.supportsBC1BC3;
+}
+
+// Layers share one size, so images are resampled to it before their chain is
+// built. Cooked blocks cannot be resampled, layers always decode the source.
+void decodeLayer(TextureLoad& load) {
+    int components;
+    unsigned char* pixels = stbi_load(load.path.c_str(), &load.width, &load.height, &components, 4);
+    load.failed = pixels == nullptr;
+    if (pixels) {
+        std::vector<uint8_t> resampled;
+        resampleImage(pixels, load.width, load.height, load.array->width, load.array->height, resampled);
+        buildMipChain(resampled.data(), load.array->width, load.array->height, MipFilter::Kaiser, load.pixels,
+                      load.levels);
+        stbi_image_free(pixels);
+    }
+}
+
+// Prefers a current archive entry the context can sample, else decodes the
+// source. Only the first decode describes the image; later ones, for levels
+// evicted since, just refill the pixels while the GL thread reads the rest.
+void decodeLoad(const TextureLoader& loader, TextureLoad& load) {
+    if (load.array) {
+        decodeLayer(load);
+        return;
+    }
+
+    bool firstDecode = load.levels.empty();
+    std::string name = std::filesystem::path(load.path).filename().string();
+    const TextureArchiveEntry* entry = findArchiveEntry(loader.archive, name.c_str());
+    if (firstDecode && entry && formatSupported(loader, (BlockFormat)entry->format) &&
+        isArchiveEntryCurrent(*entry, load.path.c_str())) {
+        load.isCompressed = true;
+        load.format = (BlockFormat)entry->format;
+        load.levels = archiveEntryLevels(*entry);
+        load.blocks = archiveEntryData(loader.archive, *entry);
+        load.width = (int)entry->width;
+        load.height = (int)entry->height;
+
+        // Page faults for the tail happen here rather than in the upload on the
+        // GL thread, finer levels are only touched when they stream in
+        const MipLevel& tail = load.levels[tailLevelOf(load.levels)];
+        prefetchMappedRange(load.blocks + tail.offset, (size_t)entry->size - tail.offset);
+        return;
+    }
+
+    // Always four channels, so rows stay 4-byte aligned for the upload
+    int width, height, components;
+    unsigned char* pixels = stbi_load(load.path.c_str(), &width, &height, &components, 4);
+    if (firstDecode) {
+        load.width = width;
+        load.height = height;
+        load.failed = pixels == nullptr;
+    }
+    // The levels describe the first decode. A source resized since would not
+    // match them, so its pixels are left empty and the load fails.
+    if (pixels && (firstDecode || (width == load.width && height == load.height))) {
+        std::vector<MipLevel> levels;
+        buildMipChain(pixels, width, height, MipFilter::Kaiser, load.pixels, levels);
+        if (firstDecode)
+            load.levels = levels;
+    }
+    stbi_image_free(pixels);
+}
+
+void decodeWorker(TextureLoader* loader) {
+    // The flip flag is per thread
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    for (;;) {
+        TextureLoad* load;
+        {
+            std::unique_lock<std::mutex> lock(loader->mutex);
+            loader->workAvailable.wait(lock, [loader] { return loader->stopping || !loader->toDecode.empty(); });
+            if (loader->stopping)
+                return;
+            load = loader->toDecode.front();
+            loader->toDecode.pop_front();
+        }
+
+        decodeLoad(*loader, *load);
+
+        {
+            std::lock_guard<std::mutex> lock(loader->mutex);
+            loader->decoded.push_back(load);
+        }
+        loader->decodeFinished.notify_all();
+    }
+}
+
+void queueDecode(TextureLoader& loader, TextureLoad& load) {
+    load.decoding = true;
+    {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        loader.toDecode.push_back(&load);
+    }
+    loader.workAvailable.notify_one();
+}
+
+void queueUpload(TextureLoader& loader, TextureLoad& load) {
+    if (!load.streaming) {
+        load.streaming = true;
+        loader.streaming.push_back(&load);
+    }
+}
+
+// Creates the texture of a freshly decoded image, without storage yet
+void createStreamedTexture(TextureLoad& load) {
+    glGenTextures(1, &load.texture);
+    glBindTexture(GL_TEXTURE_2D, load.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)load.levels.size() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    load.tailLevel = tailLevelOf(load.levels);
+    load.residentLevel = (int)load.levels.size();
+    load.allocatedLevel = load.residentLevel;
+    load.targetLevel = load.tailLevel;
+    load.wantedLevel = load.tailLevel;
+}
+
+// Gives a level its storage in the texture; a zero-sized image frees it again
+void specifyLevel(const TextureLoad& load, int level, bool allocate) {
+    const MipLevel& mip = load.levels[level];
+    int width = allocate ? mip.width : 0;
+    int height = allocate ? mip.height : 0;
+    glBindTexture(GL_TEXTURE_2D, load.texture);
+    if (load.isCompressed) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, compressedInternalFormat(load.format), width, height, 0,
+                               allocate ? (int)mip.size : 0, NULL);
+    }
+    else {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+}
+
+// Drops the finest allocated level, complete or still uploading
+void evictLevel(TextureLoader& loader, TextureLoad& load) {
+    int level = load.allocatedLevel;
+    if (level == load.residentLevel) {
+        // Sampling must stop at the next level before this one goes away
+        load.residentLevel = level + 1;
+        glBindTexture(GL_TEXTURE_2D, load.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, load.residentLevel);
+    }
+    specifyLevel(load, level, false);
+    load.allocatedLevel = level + 1;
+    load.rowsUploaded = 0;
+    load.targetLevel = std::max(load.targetLevel, load.residentLevel);
+    load.residentBytes -= load.levels[level].size;
+    loader.residentBytes -= load.levels[level].size;
+    loader.evictedBytes += load.levels[level].size;
+}
+
+// Frees bytes for a level of the requesting texture. Detail no texture needs
+// this frame goes first, then detail of textures smaller on screen than the
+// requester, least visible first. Tails are never evicted.
+bool makeRoom(TextureLoader& loader, const TextureLoad& requester, size_t bytes) {
+    if (loader.residentBytes + bytes <= loader.budgetBytes)
+        return true;
+
+    std::vector<TextureLoad*> victims;
+    for (std::unique_ptr<TextureLoad>& load : loader.loads) {
+        if (load.get() != &requester && load->texture && load->allocatedLevel < load->tailLevel)
+            victims.push_back(load.get());
+    }
+    std::sort(victims.begin(), victims.end(),
+              [](const TextureLoad* a, const TextureLoad* b) { return a->screenSize < b->screenSize; });
+
+    // Nothing is evicted unless enough can be
+    size_t evictable = 0;
+    for (TextureLoad* victim : victims) {
+        int keepLevel = victim->screenSize < requester.screenSize ? victim->tailLevel : victim->wantedLevel;
+        for (int level = victim->allocatedLevel; level < keepLevel; ++level)
+            evictable += victim->levels[level].size;
+    }
+    if (loader.residentBytes + bytes > loader.budgetBytes + evictable)
+        return false;
+
+    for (int pass = 0; pass < 2; ++pass) {
+        for (TextureLoad* victim : victims) {
+            if (pass == 1 && victim->screenSize >= requester.screenSize)
+                break;
+            int keepLevel = pass == 0 ? victim->wantedLevel : victim->tailLevel;
+            while (victim->allocatedLevel < keepLevel && loader.residentBytes + bytes > loader.budgetBytes)
+                evictLevel(loader, *victim);
+            if (loader.residentBytes + bytes <= loader.budgetBytes)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Sends the next chunk of rows of the level being uploaded, returns its size
+// in bytes. Decoded images go through a pixel buffer; compressed levels
+// advance a row of blocks, four texel rows, at a time and are read by GL
+// straight from the mapped archive.
+size_t uploadChunk(TextureLoader& loader, TextureLoad& load) {
+    glBindTexture(GL_TEXTURE_2D, load.texture);
+    int level = load.residentLevel - 1;
+    const MipLevel& mip = load.levels[level];
+    size_t bytes;
+
+    if (load.isCompressed) {
+        size_t rowBytes = compressedImageSize(load.format, mip.width, 4);
+        int rowGroups = std::max(1, (int)(TEXTURE_UPLOAD_CHUNK_BYTES / rowBytes));
+        int rows = std::min(rowGroups * 4, mip.height - load.rowsUploaded);
+        bytes = (size_t)((rows + 3) / 4) * rowBytes;
+        const uint8_t* source = load.blocks + mip.offset + (size_t)(load.rowsUploaded / 4) * rowBytes;
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, load.rowsUploaded, mip.width, rows,
+                                  compressedInternalFormat(load.format), (int)bytes, source);
+        load.rowsUploaded += rows;
+    }
+    else {
+        size_t rowBytes = (size_t)mip.width * 4;
+        int rows = std::max(1, (int)(TEXTURE_UPLOAD_CHUNK_BYTES / rowBytes));
+        rows = std::min(rows, mip.height - load.rowsUploaded);
+        bytes = rows * rowBytes;
+
+        // Orphaning gives fresh storage, the driver may still be reading the old one
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, loader.uploadBuffers[loader.nextUploadBuffer]);
+        loader.nextUploadBuffer = (loader.nextUploadBuffer + 1) % TEXTURE_UPLOAD_BUFFERS;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        std::memcpy(mapped, &load.pixels[mip.offset + load.rowsUploaded * rowBytes], bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, load.rowsUploaded, mip.width, rows, GL_RGBA,
+                        GL_UNSIGNED_BYTE, (void*)0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        load.rowsUploaded += rows;
+    }
+
+    // The level joins the sampled range once every row is in
+    if (load.rowsUploaded == mip.height) {
+        load.residentLevel = level;
+        load.rowsUploaded = 0;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    }
+    return bytes;
+}
+
+// Coarsest level that still has a texel for every pixel of screenSize
+int requiredMipLevel(const TextureLoad& load, float screenSize) {
+    int level = 0;
+    while (level < load.tailLevel &&
+           (float)std::max(load.levels[level + 1].width, load.levels[level + 1].height) >= screenSize)
+        ++level;
+    return level;
+}
+
+} // namespace
+
+unsigned int compressedInternalFormat(BlockFormat format) {
+    if (format == BlockFormat::BC1)
+        return COMPRESSED_RGB_S3TC_DXT1;
+    if (format == BlockFormat::BC3)
+        return COMPRESSED_RGBA_S3TC_DXT5;
+    return COMPRESSED_RGBA_BPTC_UNORM;
+}
+
+TextureLoader* createTextureLoader(const char* archivePath, size_t budgetBytes, int workerCount) {
+    TextureLoader* loader = new TextureLoader();
+    if (archivePath)
+        openTextureArchive(archivePath, loader->archive);
+    loader->supportsBC1BC3 = hasExtension("GL_EXT_texture_compression_s3tc");
+    loader->supportsBC7 = hasExtension("GL_ARB_texture_compression_bptc");
+    loader->budgetBytes = budgetBytes;
+
+    // Mid grey, close to the average painting, so unloaded surfaces do not flash
+    const unsigned char grey[4] = { 128, 128, 128, 255 };
+    glGenTextures(1, &loader->placeholder);
+    glBindTexture(GL_TEXTURE_2D, loader->placeholder);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenBuffers(TEXTURE_UPLOAD_BUFFERS, loader->uploadBuffers);
+
+    // Leave one core to the render thread
+    if (workerCount <= 0)
+        workerCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    for (int i = 0; i < workerCount; ++i)
+        loader->workers.emplace_back(decodeWorker, loader);
+    return loader;
+}
+
+void destroyTextureLoader(TextureLoader* loader) {
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->stopping = true;
+    }
+    loader->workAvailable.notify_all();
+    for (std::thread& worker : loader->workers)
+        worker.join();
+
+    // Textures still without their tail never reached a slot
+    for (std::unique_ptr<TextureLoad>& load : loader->loads) {
+        if (!load->finished)
+            glDeleteTextures(1, &load->texture);
+    }
+    closeTextureArchive(loader->archive);
+    glDeleteBuffers(TEXTURE_UPLOAD_BUFFERS, loader->uploadBuffers);
+    glDeleteTextures(1, &loader->placeholder);
+    delete loader;
+}
+
+unsigned int requestTexture(TextureLoader& loader, const char* path, int slot) {
+    loader.loads.emplace_back(new TextureLoad());
+    TextureLoad* load = loader.loads.back().get();
+    load->path = path;
+    load->slot = slot;
+    ++loader.pending;
+    queueDecode(loader, *load);
+    return loader.placeholder;
+}
+
+int requestTextureLayer(TextureLoader& loader, const char* path, TextureArray& array) {
+    loader.loads.emplace_back(new TextureLoad());
+    TextureLoad* load = loader.loads.back().get();
+    load->path = path;
+    load->slot = -1;
+    load->array = &array;
+    load->layer = addTextureLayer(array);
+    ++loader.pending;
+    queueDecode(loader, *load);
+    return load->layer;
+}
+
+void updateTextureStreaming(TextureLoader& loader, const float* screenSizes) {
+    for (std::unique_ptr<TextureLoad>& load : loader.loads) {
+        if (!load->finished || load->failed || load->array)
+            continue;
+        load->screenSize = screenSizes[load->slot];
+        load->wantedLevel = requiredMipLevel(*load, load->screenSize);
+        // Detail no longer needed stops streaming in, but stays until evicted
+        load->targetLevel = std::min(load->wantedLevel, load->residentLevel);
+        if (load->targetLevel < load->residentLevel)
+            queueUpload(loader, *load);
+    }
+}
+
+int updateTextureLoader(TextureLoader& loader, unsigned int* textures, size_t byteBudget) {
+    // Images decoded since the last call, for their tail or evicted levels.
+    // Empty pixels mean the source was unreadable or changed size.
+    std::vector<TextureLoad*> decoded;
+    {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        decoded.assign(loader.decoded.begin(), loader.decoded.end());
+        loader.decoded.clear();
+    }
+    for (TextureLoad* load : decoded) {
+        load->decoding = false;
+        if (!load->failed && !load->isCompressed && load->pixels.empty())
+            load->failed = true;
+        if (load->failed) {
+            std::cout << "Failed to load texture: " << load->path << std::endl;
+            if (!load->finished) {
+                load->finished = true;
+                --loader.pending;
+            }
+            continue;
+        }
+        if (load->array) {
+            uploadTextureLayer(*load->array, load->layer, load->pixels, load->levels);
+            load->pixels = std::vector<uint8_t>();
+            load->finished = true;
+            --loader.pending;
+            continue;
+        }
+        if (load->texture == 0)
+            createStreamedTexture(*load);
+        queueUpload(loader, *load);
+    }
+
+    // Missing tails first, then the textures largest on screen
+    std::sort(loader.streaming.begin(), loader.streaming.end(), [](const TextureLoad* a, const TextureLoad* b) {
+        if (a->finished != b->finished)
+            return !a->finished;
+        return a->screenSize > b->screenSize;
+    });
+
+    int finished = 0;
+    size_t uploaded = 0;
+    for (TextureLoad* load : loader.streaming) {
+        while (uploaded < byteBudget && !load->failed && load->targetLevel < load->residentLevel) {
+            // Evicted levels of a decoded image need the source decoded again
+            if (load->decoding)
+                break;
+            if (!load->isCompressed && load->pixels.empty()) {
+                queueDecode(loader, *load);
+                break;
+            }
+
+            int level = load->residentLevel - 1;
+            if (load->allocatedLevel > level) {
+                size_t bytes = load->levels[level].size;
+                // The tail is always loaded, finer levels only while they fit
+                if (level < load->tailLevel && !makeRoom(loader, *load, bytes)) {
+                    load->targetLevel = load->residentLevel;
+                    break;
+                }
+                specifyLevel(*load, level, true);
+                load->allocatedLevel = level;
+                load->residentBytes += bytes;
+                loader.residentBytes += bytes;
+            }
+            uploaded += uploadChunk(loader, *load);
+
+            if (!load->finished && load->residentLevel == load->tailLevel) {
+                load->finished = true;
+                --loader.pending;
+                loader.compressedCount += load->isCompressed ? 1 : 0;
+                textures[load->slot] = load->texture;
+                ++finished;
+            }
+        }
+        if (uploaded >= byteBudget)
+            break;
+    }
+
+    // Done textures leave the list, decoded ones free their pixels until more
+    // of them is needed
+    size_t kept = 0;
+    for (TextureLoad* load : loader.streaming) {
+        if (load->decoding || (!load->failed && load->targetLevel < load->residentLevel)) {
+            loader.streaming[kept++] = load;
+        }
+        else {
+            load->streaming = false;
+            load->pixels = std::vector<uint8_t>();
+        }
+    }
+    loader.streaming.resize(kept);
+    return finished;
+}
+
+void finishTextureLoads(TextureLoader& loader, unsigned int* textures) {
+    for (;;) {
+        updateTextureLoader(loader, textures, (size_t)-1);
+        if (loader.pending == 0)
+            break;
+        std::unique_lock<std::mutex> lock(loader.mutex);
+        loader.decodeFinished.wait(lock, [&loader] { return !loader.decoded.empty(); });
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dds.h"
+#include "texture_array.h"
+#include "texture_cache.h"
+
+// Pixel buffers used round-robin, so a chunk can be filled while the previous
+// one is still being copied into its texture
+const int TEXTURE_UPLOAD_BUFFERS = 2;
+
+// Bytes copied through one pixel buffer at a time
+const size_t TEXTURE_UPLOAD_CHUNK_BYTES = 1 << 20;
+
+// Default per-frame upload budget for updateTextureLoader
+const size_t TEXTURE_UPLOAD_FRAME_BYTES = 4 << 20;
+
+// Levels no larger than this on either side make up the tail of the mip chain
+// that is loaded at startup and never evicted
+const int TEXTURE_TAIL_SIZE = 64;
+
+// Default for RendererOptions::textureBudgetBytes
+const size_t TEXTURE_DEFAULT_BUDGET_BYTES = (size_t)256 << 20;
+
+// One image from disk and its texture, streamed a mip level at a time: either a
+// decoded source image or its block-compressed archive entry
+struct TextureLoad {
+    std::string path;
+    int slot;
+    std::vector<uint8_t> pixels; // RGBA8 levels of a decoded image, kept only while levels are uploading
+    bool isCompressed = false;
+    BlockFormat format = BlockFormat::BC1;
+    std::vector<MipLevel> levels;
+    const uint8_t* blocks = nullptr; // Inside the mapped archive
+    int width = 0;
+    int height = 0;
+    bool failed = false;
+    bool decoding = false; // Queued or running on a worker, which may write pixels
+    TextureArray* array = nullptr; // Set for images resampled into an array layer
+    int layer = -1;
+
+    unsigned int texture = 0; // Swapped into the slot once the tail is resident
+    int tailLevel = 0;        // Finest level within TEXTURE_TAIL_SIZE
+    int residentLevel = 0;    // Finest complete level, the texture's base level
+    int allocatedLevel = 0;   // Finest level with storage, one finer while uploading
+    int targetLevel = 0;      // Finest level to stream in
+    int wantedLevel = 0;      // Finest level the camera needs this frame
+    float screenSize = 0.0f;  // Largest on-screen size in pixels this frame
+    int rowsUploaded = 0;     // Of level residentLevel - 1
+    size_t residentBytes = 0; // Storage of levels allocatedLevel and coarser
+    bool streaming = false;   // In the loader's upload list
+    bool finished = false;    // Tail resident, or failed
+};
+
+// Images decode and build their mip chains on worker threads. The GL thread
+// then uploads them through pixel buffer objects a few rows at a time, within
+// a per-frame byte budget, coarsest level first.
+// Until its tail is resident every texture slot holds a shared 1x1 placeholder.
+// Finer levels stream in as the camera gets close and are evicted again, least
+// needed first, to keep every texture within a video memory budget.
+// Sources with a current entry in the mapped texture archive skip decoding and
+// mip generation; their compressed blocks go from the mapping straight to GL.
+struct TextureLoader {
+    TextureArchive archive; // Not open when the cache is off or missing
+    bool supportsBC1BC3; // EXT_texture_compression_s3tc
+    bool supportsBC7;    // ARB_texture_compression_bptc
+    unsigned int placeholder;
+    unsigned int uploadBuffers[TEXTURE_UPLOAD_BUFFERS];
+    int nextUploadBuffer = 0;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable decodeFinished;
+    std::deque<TextureLoad*> toDecode;
+    std::deque<TextureLoad*> decoded;
+    bool stopping = false;
+
+    // Only touched on the GL thread
+    std::vector<std::unique_ptr<TextureLoad>> loads;
+    std::vector<TextureLoad*> streaming; // Textures with levels to upload
+    int pending = 0; // Textures without their tail yet
+    int compressedCount = 0;
+    size_t budgetBytes = TEXTURE_DEFAULT_BUDGET_BYTES;
+    size_t residentBytes = 0; // Video memory of every texture's allocated levels
+    size_t evictedBytes = 0;  // Total freed to stay within the budget
+};
+
+// GL internal format of a block format, from the extensions the loader checks for
+unsigned int compressedInternalFormat(BlockFormat format);
+
+// Needs a current GL context. archivePath may be null to always decode the
+// sources; workerCount 0 picks one worker per spare core.
+TextureLoader* createTextureLoader(const char* archivePath, size_t budgetBytes = TEXTURE_DEFAULT_BUDGET_BYTES,
+                                   int workerCount = 0);
+void destroyTextureLoader(TextureLoader* loader);
+
+// Queues an image for textures[slot] and returns the placeholder to use meanwhile
+unsigned int requestTexture(TextureLoader& loader, const char* path, int slot);
+
+// Queues an image to be resampled into a layer of array, which stays
+// reserved until the upload makes it ready. Returns the layer. Array layers
+// are uploaded whole and are not streamed.
+int requestTextureLayer(TextureLoader& loader, const char* path, TextureArray& array);
+
+// Picks the levels each texture needs from the largest size in pixels it is
+// drawn at this frame, screenSizes[slot], 0 when not drawn at all
+void updateTextureStreaming(TextureLoader& loader, const float* screenSizes);
+
+// Uploads up to byteBudget bytes of mip levels, most needed texture first.
+// Textures whose tail is complete replace the placeholder in textures[slot].
+// Returns the number of those this call.
+int updateTextureLoader(TextureLoader& loader, unsigned int* textures, size_t byteBudget);
+
+// Blocks until every requested texture has its tail uploaded
+void finishTextureLoads(TextureLoader& loader, unsigned int* textures);
@@ -0,0 +1,21 @@
+#include "timing.h"
+
+#include <algorithm>
+#include <numeric>
+
+TimingSummary summarizeTimings(std::vector<double> samples) {
+    TimingSummary summary;
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+    summary.min = samples.front();
+    summary.max = samples.back();
+    summary.avg = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+
+    // Nearest-rank percentile: the ceil(0.99 n)th smallest sample, in integers
+    // so 0.99 * 100 cannot round up to 100
+    size_t rank = (99 * samples.size() + 99) / 100;
+    summary.p99 = samples[rank - 1];
+    return summary;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <vector>
+
+// Summary of a series of per-frame timings, all in milliseconds
+struct TimingSummary {
+    double min = 0.0;
+    double avg = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+TimingSummary summarizeTimings(std::vector<double> samples);
@@ -0,0 +1,292 @@
+#include "virtual_texture.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+
+#include "texture_loader.h"
+
+namespace {
+
+const uint32_t NO_PAGE = ~0u;
+const uint32_t PINNED = ~0u;
+
+int cacheSide() {
+    return VIRTUAL_CACHE_PAGES * VIRTUAL_PAGE_STRIDE;
+}
+
+void uploadPage(VirtualTexture& texture, uint32_t page, int slot) {
+    int x = slot % VIRTUAL_CACHE_PAGES * VIRTUAL_PAGE_STRIDE;
+    int y = slot / VIRTUAL_CACHE_PAGES * VIRTUAL_PAGE_STRIDE;
+    glBindTexture(GL_TEXTURE_2D, texture.cacheTexture);
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VIRTUAL_PAGE_STRIDE, VIRTUAL_PAGE_STRIDE, texture.format,
+                              (int)pyramidPageBytes(texture.pyramid), pyramidPageData(texture.pyramid, page));
+
+    if (texture.slotPages[slot] != NO_PAGE)
+        texture.pageSlots[texture.slotPages[slot]] = -1;
+    else
+        ++texture.residentPages;
+    texture.pageSlots[page] = slot;
+    texture.slotPages[slot] = page;
+    texture.slotLastUsed[slot] = texture.frame;
+    ++texture.pagesUploaded;
+    texture.indirectionDirty = true;
+}
+
+// Slot of the page used longest ago, not requested this frame, -1 if none
+int leastRecentlyUsedSlot(const VirtualTexture& texture) {
+    int best = -1;
+    for (int slot = 0; slot < (int)texture.slotLastUsed.size(); ++slot) {
+        uint32_t lastUsed = texture.slotLastUsed[slot];
+        if (lastUsed < texture.frame && (best < 0 || lastUsed < texture.slotLastUsed[best]))
+            best = slot;
+    }
+    return best;
+}
+
+// Every page points at its own slot, or inherits its parent's entry. The
+// coarsest page is pinned, so the walk from coarse to fine always has one.
+void rebuildIndirection(VirtualTexture& texture) {
+    const PagePyramid& pyramid = texture.pyramid;
+    for (int level = (int)pyramid.header->levelCount - 1; level >= 0; --level) {
+        int side = pyramidPagesPerSide(pyramid, level);
+        std::vector<uint8_t>& entries = texture.indirection[level];
+        for (int y = 0; y < side; ++y) {
+            for (int x = 0; x < side; ++x) {
+                uint8_t* entry = &entries[((size_t)y * side + x) * 4];
+                int slot = texture.pageSlots[pyramidPageIndex(pyramid, level, x, y)];
+                if (slot >= 0) {
+                    entry[0] = (uint8_t)(slot % VIRTUAL_CACHE_PAGES);
+                    entry[1] = (uint8_t)(slot / VIRTUAL_CACHE_PAGES);
+                    entry[2] = (uint8_t)level;
+                    entry[3] = 255;
+                }
+                else {
+                    int parentSide = side / 2;
+                    const uint8_t* parent = &texture.indirection[level + 1][((size_t)(y / 2) * parentSide + x / 2) * 4];
+                    std::copy(parent, parent + 4, entry);
+                }
+            }
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture.indirectionTexture);
+    for (int level = 0; level < (int)pyramid.header->levelCount; ++level) {
+        int side = pyramidPagesPerSide(pyramid, level);
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, side, side, GL_RGBA, GL_UNSIGNED_BYTE,
+                        texture.indirection[level].data());
+    }
+    texture.indirectionDirty = false;
+}
+
+// Feedback texels hold the page as x and y low bytes, their high nibbles, and
+// level + 1, with 0 where no virtual texture was drawn
+void readFeedback(VirtualTexture& texture, const uint8_t* pixels, int count) {
+    const PagePyramid& pyramid = texture.pyramid;
+    int levelCount = (int)pyramid.header->levelCount;
+    for (int i = 0; i < count; ++i) {
+        const uint8_t* pixel = pixels + i * 4;
+        if (pixel[3] == 0 || pixel[3] > levelCount)
+            continue;
+        int level = pixel[3] - 1;
+        int x = pixel[0] | (pixel[2] & 15) << 8;
+        int y = pixel[1] | (pixel[2] >> 4) << 8;
+        int side = pyramidPagesPerSide(pyramid, level);
+        if (x >= side || y >= side)
+            continue;
+
+        // The ancestors too, they are what shows while the page is loading
+        for (; level < levelCount; ++level, x /= 2, y /= 2) {
+            uint32_t page = pyramidPageIndex(pyramid, level, x, y);
+            if (texture.pageRequested[page] == texture.frame)
+                break;
+            texture.pageRequested[page] = texture.frame;
+            texture.requests.push_back(page);
+        }
+    }
+}
+
+} // namespace
+
+VirtualTexture* openVirtualTexture(const char* path, bool supportsBC1BC3, bool supportsBC7) {
+    PagePyramid pyramid;
+    if (!openPagePyramid(path, pyramid))
+        return nullptr;
+    BlockFormat blockFormat = (BlockFormat)pyramid.header->format;
+    if (!(blockFormat == BlockFormat::BC7 ? supportsBC7 : supportsBC1BC3)) {
+        std::cout << "Virtual texture format not supported by the driver: " << path << std::endl;
+        closePagePyramid(pyramid);
+        return nullptr;
+    }
+
+    VirtualTexture* texture = new VirtualTexture();
+    texture->pyramid = pyramid;
+    texture->format = compressedInternalFormat(blockFormat);
+    int levelCount = (int)pyramid.header->levelCount;
+
+    // Physical cache, block-compressed like the pages, no mips: every level of
+    // the pyramid is a page of its own
+    glGenTextures(1, &texture->cacheTexture);
+    glBindTexture(GL_TEXTURE_2D, texture->cacheTexture);
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, texture->format, cacheSide(), cacheSide(), 0,
+                           (int)compressedImageSize(blockFormat, cacheSide(), cacheSide()), NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Indirection, read with exact texels and levels
+    glGenTextures(1, &texture->indirectionTexture);
+    glBindTexture(GL_TEXTURE_2D, texture->indirectionTexture);
+    texture->indirection.resize(levelCount);
+    for (int level = 0; level < levelCount; ++level) {
+        int side = pyramidPagesPerSide(pyramid, level);
+        texture->indirection[level].resize((size_t)side * side * 4);
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, side, side, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    int slotCount = VIRTUAL_CACHE_PAGES * VIRTUAL_CACHE_PAGES;
+    texture->pageSlots.assign(pyramid.pageCount, -1);
+    texture->pageRequested.assign(pyramid.pageCount, 0);
+    texture->slotPages.assign(slotCount, NO_PAGE);
+    texture->slotLastUsed.assign(slotCount, 0);
+
+    // The single page of the coarsest level is always there to fall back on
+    uploadPage(*texture, pyramidPageIndex(pyramid, levelCount - 1, 0, 0), 0);
+    texture->slotLastUsed[0] = PINNED;
+    rebuildIndirection(*texture);
+
+    glGenFramebuffers(1, &texture->feedbackFramebuffer);
+    glGenRenderbuffers(1, &texture->feedbackColor);
+    glGenRenderbuffers(1, &texture->feedbackDepth);
+    glGenBuffers(VIRTUAL_FEEDBACK_BUFFERS, texture->feedbackBuffers);
+    return texture;
+}
+
+void closeVirtualTexture(VirtualTexture* texture) {
+    for (GLsync fence : texture->feedbackFences) {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    glDeleteBuffers(VIRTUAL_FEEDBACK_BUFFERS, texture->feedbackBuffers);
+    glDeleteRenderbuffers(1, &texture->feedbackColor);
+    glDeleteRenderbuffers(1, &texture->feedbackDepth);
+    glDeleteFramebuffers(1, &texture->feedbackFramebuffer);
+    glDeleteTextures(1, &texture->cacheTexture);
+    glDeleteTextures(1, &texture->indirectionTexture);
+    closePagePyramid(texture->pyramid);
+    delete texture;
+}
+
+void bindVirtualTexture(const VirtualTexture& texture, int cacheUnit, int indirectionUnit) {
+    glActiveTexture(GL_TEXTURE0 + cacheUnit);
+    glBindTexture(GL_TEXTURE_2D, texture.cacheTexture);
+    glActiveTexture(GL_TEXTURE0 + indirectionUnit);
+    glBindTexture(GL_TEXTURE_2D, texture.indirectionTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void beginVirtualTextureFeedback(VirtualTexture& texture) {
+    glGetIntegerv(GL_VIEWPORT, texture.savedViewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &texture.savedFramebuffer);
+
+    int width = std::max(1, texture.savedViewport[2] / VIRTUAL_FEEDBACK_DIVISOR);
+    int height = std::max(1, texture.savedViewport[3] / VIRTUAL_FEEDBACK_DIVISOR);
+    glBindFramebuffer(GL_FRAMEBUFFER, texture.feedbackFramebuffer);
+    if (width != texture.feedbackWidth || height != texture.feedbackHeight) {
+        glBindRenderbuffer(GL_RENDERBUFFER, texture.feedbackColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, texture.feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, texture.feedbackColor);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, texture.feedbackDepth);
+        texture.feedbackWidth = width;
+        texture.feedbackHeight = height;
+    }
+    glViewport(0, 0, width, height);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void endVirtualTextureFeedback(VirtualTexture& texture) {
+    // A readback still unread this late is dropped rather than waited for
+    int slot = texture.nextFeedback;
+    texture.nextFeedback = (slot + 1) % VIRTUAL_FEEDBACK_BUFFERS;
+    if (texture.feedbackFences[slot])
+        glDeleteSync(texture.feedbackFences[slot]);
+
+    size_t bytes = (size_t)texture.feedbackWidth * texture.feedbackHeight * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, texture.feedbackBuffers[slot]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+    glReadPixels(0, 0, texture.feedbackWidth, texture.feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    texture.feedbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    texture.feedbackSizes[slot][0] = texture.feedbackWidth;
+    texture.feedbackSizes[slot][1] = texture.feedbackHeight;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, texture.savedFramebuffer);
+    glViewport(texture.savedViewport[0], texture.savedViewport[1], texture.savedViewport[2], texture.savedViewport[3]);
+}
+
+void updateVirtualTexture(VirtualTexture& texture, int maxUploads) {
+    ++texture.frame;
+
+    // Oldest readback first, stopping at the first the GPU has not finished
+    for (int i = 0; i < VIRTUAL_FEEDBACK_BUFFERS; ++i) {
+        int slot = (texture.nextFeedback + i) % VIRTUAL_FEEDBACK_BUFFERS;
+        GLsync fence = texture.feedbackFences[slot];
+        if (!fence)
+            continue;
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(fence);
+        texture.feedbackFences[slot] = 0;
+
+        int count = texture.feedbackSizes[slot][0] * texture.feedbackSizes[slot][1];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, texture.feedbackBuffers[slot]);
+        const uint8_t* pixels = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (size_t)count * 4,
+                                                                 GL_MAP_READ_BIT);
+        if (pixels)
+            readFeedback(texture, pixels, count);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // Requested pages in the cache stay, the missing ones load coarsest first
+    // so every area sharpens a level at a time
+    std::vector<uint32_t> missing;
+    for (uint32_t page : texture.requests) {
+        int slot = texture.pageSlots[page];
+        if (slot >= 0)
+            texture.slotLastUsed[slot] = std::max(texture.slotLastUsed[slot], texture.frame);
+        else if (pyramidPageData(texture.pyramid, page))
+            missing.push_back(page);
+    }
+    texture.requests.clear();
+    std::sort(missing.begin(), missing.end(), std::greater<uint32_t>());
+
+    for (int i = 0; i < (int)missing.size() && i < maxUploads; ++i) {
+        int slot = leastRecentlyUsedSlot(texture);
+        if (slot < 0)
+            break;
+        uploadPage(texture, missing[i], slot);
+    }
+
+    if (texture.indirectionDirty)
+        rebuildIndirection(texture);
+}
+
+size_t virtualTextureBytes(const VirtualTexture& texture) {
+    size_t bytes = compressedImageSize((BlockFormat)texture.pyramid.header->format, cacheSide(), cacheSide());
+    for (const std::vector<uint8_t>& level : texture.indirection)
+        bytes += level.size();
+    return bytes;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+
+#include "page_pyramid.h"
+
+// Pages the physical cache holds per side
+const int VIRTUAL_CACHE_PAGES = 16;
+
+// The feedback pass renders at this fraction of the framebuffer per side
+const int VIRTUAL_FEEDBACK_DIVISOR = 8;
+
+// Feedback readbacks in flight; each is read two frames after it was issued
+const int VIRTUAL_FEEDBACK_BUFFERS = 3;
+
+// Default page upload budget for updateVirtualTexture
+const int VIRTUAL_PAGE_UPLOADS_PER_FRAME = 16;
+
+// Sparse virtual texture over a page pyramid. A low resolution feedback pass
+// writes the page every visible texel needs; the pages are read back a couple
+// of frames later and uploaded into a fixed physical cache, least recently
+// used first out. An indirection texture, one texel per page and one level per
+// pyramid level, points every page at its own cache slot, or at its nearest
+// resident ancestor until it arrives. Memory follows the screen, not the image.
+struct VirtualTexture {
+    PagePyramid pyramid;
+    GLenum format;
+    unsigned int cacheTexture;
+    unsigned int indirectionTexture;
+    std::vector<std::vector<uint8_t>> indirection; // RGBA8 per level: slot x, slot y, level, 255
+    bool indirectionDirty = true;
+
+    std::vector<int> pageSlots;       // Cache slot of each page, -1 when not resident
+    std::vector<uint32_t> slotPages;  // Page in each slot
+    std::vector<uint32_t> slotLastUsed; // Frame the page was last requested, pinned slots never age
+    std::vector<uint32_t> pageRequested; // Frame each page was last requested, deduplicates feedback
+    std::vector<uint32_t> requests;
+    uint32_t frame = 1;
+
+    unsigned int feedbackFramebuffer;
+    unsigned int feedbackColor;
+    unsigned int feedbackDepth;
+    int feedbackWidth = 0;
+    int feedbackHeight = 0;
+    unsigned int feedbackBuffers[VIRTUAL_FEEDBACK_BUFFERS];
+    GLsync feedbackFences[VIRTUAL_FEEDBACK_BUFFERS] = {};
+    int feedbackSizes[VIRTUAL_FEEDBACK_BUFFERS][2] = {};
+    int nextFeedback = 0;
+    int savedFramebuffer = 0;
+    int savedViewport[4] = {};
+
+    int residentPages = 0;
+    int pagesUploaded = 0; // Since opening
+};
+
+// Needs a current GL context and a pyramid in a block format the driver can
+// sample, as the texture loader found them; returns null otherwise
+VirtualTexture* openVirtualTexture(const char* path, bool supportsBC1BC3, bool supportsBC7);
+void closeVirtualTexture(VirtualTexture* texture);
+
+// Binds the cache and indirection textures to their units
+void bindVirtualTexture(const VirtualTexture& texture, int cacheUnit, int indirectionUnit);
+
+// Redirects drawing into the feedback target sized for the current viewport;
+// draws between these write page requests instead of colours
+void beginVirtualTextureFeedback(VirtualTexture& texture);
+void endVirtualTextureFeedback(VirtualTexture& texture);
+
+// Collects finished feedback, uploads up to maxUploads missing pages coarsest
+// first and updates the indirection texture
+void updateVirtualTexture(VirtualTexture& texture, int maxUploads);
+
+// Physical pages, indirection included
+size_t virtualTextureBytes(const VirtualTexture& texture);